@@ -4,12 +4,265 @@
 #include <string.h>
 #include <stdarg.h>
 
-char *RawArenaPush(Arena *a, memsize size) {
-    assert((memsize)(a->end - a->current) >= size);
+#ifndef _WIN32
+#   include <sys/mman.h>
+#   ifndef MAP_POPULATE
+#       define MAP_POPULATE 0
+#   endif
+#   ifndef MAP_NORESERVE
+#       define MAP_NORESERVE 0
+#   endif
+#endif
+
+// Picks the size of the next block to chain on. Each new block doubles, up
+// to ARENA_MAX_BLOCK_SIZE, so a big site only ever has a handful of blocks.
+static memsize ArenaNextBlockSize(Arena *a, memsize needed) {
+    memsize size = a->block_size;
+
+    if (size < ARENA_MAX_BLOCK_SIZE) {
+        a->block_size = size * 2;
+    }
+
+    while (size < needed) { size *= 2; }
+    return size;
+}
+
+static int ArenaBlockContains(ArenaBlock *block, char *p) {
+    return p >= (char*)(block + 1) && p <= block->end;
+}
+
+#ifndef _WIN32
+// Virtual memory blocks (POSIX only)
+//
+// A virtual block reserves a big range of address space up front with
+// PROT_NONE, and then commits it a chunk at a time as the arena advances.
+// Untouched memory costs nothing, and ArenaTrim can hand pages back to the
+// OS after a big restore.
+
+static memsize ArenaCommitGranularity(Arena *a) {
+    return (a->flags & ArenaFlag_HugePages) ? ARENA_HUGE_PAGE_SIZE : ARENA_COMMIT_SIZE;
+}
+
+static char *ArenaRoundUp(char *p, memsize granularity) {
+    uintptr_t v = ((uintptr_t)p + granularity - 1) & ~(uintptr_t)(granularity - 1);
+    return (char*)v;
+}
+
+static int ArenaCommitRange(Arena *a, char *from, char *to) {
+    if (from >= to) { return 1; }
+
+    // MAP_POPULATE only works on a fresh mapping, so in populate mode the
+    // committed range is mapped over the reservation instead of just having
+    // its protection changed.
+    if (a->flags & ArenaFlag_Populate) {
+        void *mem = mmap(from, (memsize)(to - from), PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_POPULATE,
+                         -1, 0);
+        return mem != MAP_FAILED;
+    }
+
+    return mprotect(from, (memsize)(to - from), PROT_READ | PROT_WRITE) == 0;
+}
+
+static int ArenaCommit(Arena *a, memsize size) {
+    ArenaBlock *block = a->block;
+    if (!block->reserve_end) { return 0; }
+    if ((memsize)(block->reserve_end - a->current) < size) { return 0; }
+
+    char *new_end = ArenaRoundUp(a->current + size, ArenaCommitGranularity(a));
+    if (new_end > block->reserve_end) { new_end = block->reserve_end; }
+    if (!ArenaCommitRange(a, block->end, new_end)) { return 0; }
+
+    block->end = new_end;
+    a->end     = new_end;
+    return 1;
+}
+
+void ArenaTrim(Arena *a) {
+    ArenaBlock *block = a->block;
+    if (!block->reserve_end) { return; }
+
+    // Keep one commit chunk past the current position, so a loop that
+    // restores and pushes again doesn't bounce off the OS every time.
+    memsize granularity = ArenaCommitGranularity(a);
+    char   *keep        = ArenaRoundUp(a->current, granularity) + granularity;
+    if (keep >= block->end) { return; }
+
+    madvise(keep, (memsize)(block->end - keep), MADV_DONTNEED);
+    mprotect(keep, (memsize)(block->end - keep), PROT_NONE);
+    block->end = keep;
+    a->end     = keep;
+}
+
+static ArenaBlock *ArenaReserveBlock(Arena *a, memsize reserve, memsize commit) {
+    // Only worth it with a 64 bit address space
+    if (sizeof(void*) < 8) { return 0; }
+
+    // Huge pages need the reservation aligned to the huge page size, so
+    // over-reserve and unmap the slop on either side.
+    memsize align = (a->flags & ArenaFlag_HugePages) ? ARENA_HUGE_PAGE_SIZE : 0;
+    char   *base  = mmap(0, reserve + align, PROT_NONE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) { return 0; }
+
+    if (align) {
+        char *aligned = ArenaRoundUp(base, align);
+        if (aligned > base) { munmap(base, (memsize)(aligned - base)); }
+        munmap(aligned + reserve, (memsize)(base + align - aligned));
+        base = aligned;
+#ifdef MADV_HUGEPAGE
+        madvise(base, reserve, MADV_HUGEPAGE);
+#endif
+    }
+
+    char *end = ArenaRoundUp(base + sizeof(ArenaBlock) + commit,
+                             ArenaCommitGranularity(a));
+    if (!ArenaCommitRange(a, base, end)) {
+        munmap(base, reserve);
+        return 0;
+    }
+
+    ArenaBlock *block = (ArenaBlock*)base;
+    *block = (ArenaBlock) {
+        .end         = end,
+        .reserve_end = base + reserve,
+        .owned       = 1,
+    };
+    return block;
+}
+
+static void ArenaFreeBlock(ArenaBlock *block) {
+    if (block->reserve_end) {
+        munmap(block, (memsize)(block->reserve_end - (char*)block));
+    } else {
+        free(block);
+    }
+}
+#else
+// Windows arenas only chain heap blocks, so there is never a reservation to
+// commit into or trim back.
+static int ArenaCommit(Arena *a, memsize size) {
+    (void)a;
+    (void)size;
+    return 0;
+}
+
+void ArenaTrim(Arena *a) {
+    (void)a;
+}
+
+static ArenaBlock *ArenaReserveBlock(Arena *a, memsize reserve, memsize commit) {
+    (void)a;
+    (void)reserve;
+    (void)commit;
+    return 0;
+}
+
+static void ArenaFreeBlock(ArenaBlock *block) {
+    free(block);
+}
+#endif
+
+static void ArenaReleaseBlock(Arena *a, ArenaBlock *block) {
+    if (!block->owned) { return; }
+
+    // Keep the biggest released block around, since a restore is
+    // usually followed by the same kind of work that caused the growth.
+    if (!a->spare) {
+        a->spare = block;
+    } else if (a->spare->end - (char*)(a->spare + 1) <
+               block->end - (char*)(block + 1)) {
+        ArenaFreeBlock(a->spare);
+        a->spare = block;
+    } else {
+        ArenaFreeBlock(block);
+    }
+}
+
+static void ArenaUseBlock(Arena *a, ArenaBlock *block) {
+    a->block = block;
+    a->begin = (char*)(block + 1);
+    a->end   = block->end;
+}
+
+static void ArenaStatsInUse(ArenaStats *s, memsize size) {
+    ArenaPhaseStats *phase = s->phases + s->phase;
+    s->in_use += size;
+
+    if (s->in_use > phase->peak) {
+        phase->peak = s->in_use;
+    }
+
+    if (s->in_use > s->peak) {
+        s->peak               = s->in_use;
+        s->peak_phase         = s->phase;
+        s->peak_label_pending = 1;
+    }
+}
+
+static void ArenaStatsPush(ArenaStats *s, memsize size) {
+    s->pushed     += size;
+    s->push_count += 1;
+    s->phases[s->phase].pushed     += size;
+    s->phases[s->phase].push_count += 1;
+    ArenaStatsInUse(s, size);
+}
+
+void ArenaReserve(Arena *a, memsize size) {
+    if ((memsize)(a->end - a->current) >= size) { return; }
+    if (ArenaCommit(a, size)) { return; }
 
+    // An open string has to stay contiguous, so it moves with us into the
+    // new block. Everything before it stays where it is.
+    char   *carry     = a->string_depth ? a->string_begin : a->current;
+    memsize carry_len = (memsize)(a->current - carry);
+    memsize needed    = carry_len + size;
+
+    ArenaBlock *block = 0;
+    if (a->spare && (memsize)(a->spare->end - (char*)(a->spare + 1)) >= needed) {
+        block    = a->spare;
+        a->spare = 0;
+    } else {
+        memsize block_size = ArenaNextBlockSize(a, needed);
+        block = malloc(sizeof(ArenaBlock) + block_size);
+
+        if (!block) {
+            fprintf(stderr, "Could not grow memory arena, block size was %zu\n",
+                    block_size);
+            exit(-1);
+        }
+
+        *block = (ArenaBlock) {
+            .end   = (char*)(block + 1) + block_size,
+            .owned = 1,
+        };
+    }
+
+    a->block->used_end = a->current;
+    block->prev        = a->block;
+    block->moved_from  = carry;
+    ArenaUseBlock(a, block);
+    memcpy(a->begin, carry, carry_len);
+    a->current = a->begin + carry_len;
+
+    if (a->stats) {
+        a->stats->blocks_added++;
+        a->stats->carried += carry_len;
+        ArenaStatsInUse(a->stats, carry_len);
+    }
+
+    if (a->string_depth) {
+        a->string_begin = a->begin;
+    }
+}
+
+char *RawArenaPush(Arena *a, memsize size) {
     if ((memsize)(a->end - a->current) < size) {
-        fprintf(stderr, "Need more memory! Arena is full.\n");
-        exit(-1);
+        ArenaReserve(a, size);
+    }
+
+    if (a->stats) {
+        ArenaStatsPush(a->stats, size);
     }
 
     char *buf = a->current;
@@ -17,7 +270,103 @@ char *RawArenaPush(Arena *a, memsize size) {
     return buf;
 }
 
+void ArenaRestoreBlocks(Arena *a, ArenaPos pos) {
+    char *p = (char*)pos;
+
+    while (!ArenaBlockContains(a->block, p)) {
+        ArenaBlock *block = a->block;
+        assert(block->prev && "ArenaRestore to a position not in this arena");
+        if (!block->prev) { return; }
+
+        // If an open string was carried into this block, it is back
+        // where it came from once the block is gone.
+        if (a->string_depth) {
+            a->string_begin = block->moved_from;
+        }
+
+        if (a->stats) {
+            ArenaStatsRollBack(a->stats, (memsize)(a->current - a->begin));
+        }
+
+        ArenaUseBlock(a, block->prev);
+        a->current = a->block->used_end;
+        ArenaReleaseBlock(a, block);
+    }
+
+    if (a->stats && p < a->current) {
+        ArenaStatsRollBack(a->stats, (memsize)(a->current - p));
+    }
+
+    a->current = p;
+
+    if (a->string_depth && a->string_begin > p) {
+        a->string_depth = 0;
+    }
+
+    if ((memsize)(a->end - p) > a->trim_threshold) {
+        ArenaTrim(a);
+    }
+}
+
+void ArenaReset(Arena *a) {
+    ArenaBlock *first = a->block;
+    while (first->prev) { first = first->prev; }
+    ArenaRestore(a, (char*)(first + 1));
+    a->string_depth = 0;
+}
+
+// Replays each carry, oldest first, to map a pointer in an older block to
+// where those bytes live in `block`
+static char *ArenaCarryForward(ArenaBlock *block, char *s) {
+    assert(block && "ArenaEndString with a string not in this arena");
+    if (!block || ArenaBlockContains(block, s)) { return s; }
+
+    s = ArenaCarryForward(block->prev, s);
+    return (char*)(block + 1) + (s - block->moved_from);
+}
+
+char *ArenaStringLocation(Arena *a, ArenaString s) {
+    return ArenaCarryForward(a->block, s);
+}
+
+Arena MakeArena(char *buffer, memsize size) {
+    assert(size > sizeof(ArenaBlock));
+    ArenaBlock *block = (ArenaBlock*)buffer;
+
+    *block = (ArenaBlock) {
+        .prev       = 0,
+        .end        = buffer + size,
+        .moved_from = 0,
+        .owned      = 0,
+    };
+
+    Arena a = {0};
+    a.block_size     = size < ARENA_BLOCK_SIZE ? ARENA_BLOCK_SIZE : size;
+    a.trim_threshold = (memsize)-1;
+    ArenaUseBlock(&a, block);
+    a.current = a.begin;
+    return a;
+}
+
 Arena AllocArena(memsize size) {
+    return AllocArenaEx(size, 0);
+}
+
+Arena AllocArenaEx(memsize size, int flags) {
+    Arena a = {0};
+    a.flags = flags;
+
+    // Prefer reserving address space and committing as we go. If that
+    // isn't available, fall back to a plain heap buffer.
+    ArenaBlock *block = ArenaReserveBlock(&a, ARENA_RESERVE_SIZE, size);
+    if (block) {
+        a.block_size     = size < ARENA_BLOCK_SIZE ? ARENA_BLOCK_SIZE : size;
+        a.trim_threshold = (flags & ArenaFlag_Trim) ? ARENA_TRIM_SIZE : (memsize)-1;
+        ArenaUseBlock(&a, block);
+        a.current = a.begin;
+        return a;
+    }
+
     char *buffer = malloc(size);
 
     if (!buffer) {
@@ -25,11 +374,141 @@ Arena AllocArena(memsize size) {
         exit(-1);
     }
 
-    return MakeArena(buffer, size);
+    a = MakeArena(buffer, size);
+    a.block->owned = 1;
+    return a;
 }
 
 void FreeArena(Arena *a) { 
-    free(a->begin); 
+    ArenaBlock *block = a->block;
+
+    while (block) {
+        ArenaBlock *prev = block->prev;
+        if (block->owned) { ArenaFreeBlock(block); }
+        block = prev;
+    }
+
+    if (a->spare) { ArenaFreeBlock(a->spare); }
+    *a = (Arena) {0};
+}
+
+
+// Arena usage stats
+
+void ArenaEnableStats(Arena *a, ArenaStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    a->stats = stats;
+
+    ArenaBlock *first = a->block;
+    while (first->prev) { first = first->prev; }
+    stats->initial_size = (memsize)(first->end - (char*)(first + 1));
+
+    for (ArenaBlock *block = a->block; block; block = block->prev) {
+        char *used = block == a->block ? a->current : block->used_end;
+        ArenaStatsInUse(stats, (memsize)(used - (char*)(block + 1)));
+    }
+}
+
+int ArenaStatsPhase(Arena *a, int phase) {
+    if (!a->stats) { return 0; }
+    assert(phase >= 0 && phase < ARENA_STATS_MAX_PHASES);
+    int previous = a->stats->phase;
+    a->stats->phase = phase;
+    return previous;
+}
+
+// The label may not outlive the next ArenaStatsLabel call (it's usually in
+// the arena), so it is copied out if the peak happened under it
+static void ArenaStatsSavePeakLabel(ArenaStats *s) {
+    if (s->peak_label_pending) {
+        snprintf(s->peak_label, sizeof(s->peak_label), "%s", s->label ? s->label : "");
+        s->peak_label_pending = 0;
+    }
+}
+
+const char *ArenaStatsLabel(Arena *a, const char *label) {
+    ArenaStats *s = a->stats;
+    if (!s) { return 0; }
+
+    ArenaStatsSavePeakLabel(s);
+    const char *previous = s->label;
+    s->label = label;
+    return previous;
+}
+
+static double ArenaStatsMB(memsize bytes) {
+    return (double)bytes / (1024.0 * 1024.0);
+}
+
+void PrintArenaStats(ArenaStats *s, const char **phase_names, int phase_count, FILE *out) {
+    ArenaStatsSavePeakLabel(s);
+
+    fprintf(out, "Memory stats:\n");
+    fprintf(out, "  Initial size:  %10.2f MB\n", ArenaStatsMB(s->initial_size));
+    fprintf(out, "  Peak in use:   %10.2f MB, during %s\n", ArenaStatsMB(s->peak),
+            s->peak_phase < phase_count ? phase_names[s->peak_phase] : "?");
+    if (s->peak_label[0]) {
+        fprintf(out, "                 in %s\n", s->peak_label);
+    }
+    fprintf(out, "  Pushed:        %10.2f MB in %zu pushes\n", ArenaStatsMB(s->pushed),
+            (size_t)s->push_count);
+    fprintf(out, "  Rolled back:   %10.2f MB\n", ArenaStatsMB(s->rolled_back));
+    fprintf(out, "  Carried:       %10.2f MB, %zu blocks added\n", ArenaStatsMB(s->carried),
+            (size_t)s->blocks_added);
+
+    fprintf(out, "  %-14s %10s %10s %10s %12s\n",
+            "Phase", "Peak MB", "Pushed MB", "Pushes", "Rolled MB");
+    for (int i = 0; i < phase_count && i < ARENA_STATS_MAX_PHASES; i++) {
+        ArenaPhaseStats *p = s->phases + i;
+        fprintf(out, "  %-14s %10.2f %10.2f %10zu %12.2f\n", phase_names[i],
+                ArenaStatsMB(p->peak), ArenaStatsMB(p->pushed),
+                (size_t)p->push_count, ArenaStatsMB(p->rolled_back));
+    }
+}
+
+static void PrintJSONString(const char *str, FILE *out) {
+    fputc('"', out);
+    for (; *str; str++) {
+        unsigned char c = (unsigned char)*str;
+        if (c == '"' || c == '\\') {
+            fprintf(out, "\\%c", c);
+        } else if (c < 0x20) {
+            fprintf(out, "\\u%04x", c);
+        } else {
+            fputc(c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+void PrintArenaStatsJSON(ArenaStats *s, const char **phase_names, int phase_count, FILE *out) {
+    ArenaStatsSavePeakLabel(s);
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"initial_size\": %zu,\n", (size_t)s->initial_size);
+    fprintf(out, "  \"peak\": %zu,\n", (size_t)s->peak);
+    fprintf(out, "  \"peak_phase\": ");
+    PrintJSONString(s->peak_phase < phase_count ? phase_names[s->peak_phase] : "", out);
+    fprintf(out, ",\n  \"peak_label\": ");
+    PrintJSONString(s->peak_label, out);
+    fprintf(out, ",\n");
+    fprintf(out, "  \"pushed\": %zu,\n", (size_t)s->pushed);
+    fprintf(out, "  \"push_count\": %zu,\n", (size_t)s->push_count);
+    fprintf(out, "  \"rolled_back\": %zu,\n", (size_t)s->rolled_back);
+    fprintf(out, "  \"carried\": %zu,\n", (size_t)s->carried);
+    fprintf(out, "  \"blocks_added\": %zu,\n", (size_t)s->blocks_added);
+    fprintf(out, "  \"phases\": {\n");
+    for (int i = 0; i < phase_count && i < ARENA_STATS_MAX_PHASES; i++) {
+        ArenaPhaseStats *p = s->phases + i;
+        fprintf(out, "    ");
+        PrintJSONString(phase_names[i], out);
+        fprintf(out, ": {\"peak\": %zu, \"pushed\": %zu, \"push_count\": %zu, "
+                     "\"rolled_back\": %zu}%s\n",
+                (size_t)p->peak, (size_t)p->pushed, (size_t)p->push_count,
+                (size_t)p->rolled_back, i + 1 < phase_count ? "," : "");
+    }
+    fprintf(out, "  }\n");
+    fprintf(out, "}\n");
 }
 
 
@@ -41,22 +520,33 @@ void ArenaPushData(Arena *a, char *data, memsize data_count) {
 }
 
 void ArenaPushCStr(Arena *a, const char *cstr) {
-    while (*cstr && a->current < a->end) {
-        *a->current++ = *cstr++;
-    }
+    ArenaPushData(a, (char*)cstr, strlen(cstr));
 }
 
 Slice ArenaPushSlice(Arena *a, Slice s) {
-    char *begin = a->current;
     memsize len = (memsize)(s.end - s.begin);
-    ArenaPushData(a, s.begin, len);
-    return (Slice) {begin, a->current};
+    char *begin = RawArenaPush(a, len);
+    memcpy(begin, s.begin, len);
+    return (Slice) {begin, begin + len};
 }
 
 void ArenaPushfv(Arena *a, const char *fmt, va_list ap) {
+    va_list retry;
+    va_copy(retry, ap);
     int amt = vsnprintf(a->current, ArenaSpace(a), fmt, ap);
-    if (amt > ArenaSpace(a)-1) { amt = (int)ArenaSpace(a)-1; }
-    a->current += amt;
+
+    // Didn't fit (vsnprintf wants room for the null terminator too), so
+    // grow and print again now that we know the length
+    if (amt >= 0 && (memsize)amt >= ArenaSpace(a)) {
+        ArenaReserve(a, (memsize)amt + 1);
+        vsnprintf(a->current, ArenaSpace(a), fmt, retry);
+    }
+
+    va_end(retry);
+    if (amt > 0) { 
+        a->current += amt; 
+        if (a->stats) { ArenaStatsPush(a->stats, (memsize)amt); }
+    }
 }
 
 void ArenaPushf(Arena *a, const char *fmt, ...) {
@@ -67,30 +557,96 @@ void ArenaPushf(Arena *a, const char *fmt, ...) {
 }
 
 Slice ArenaPrintf(Arena *a, const char *fmt, ...) {
-    char *begin = a->current;
+    ArenaString begin = ArenaBeginString(a);
 
     va_list ap;
     va_start(ap, fmt);
     ArenaPushfv(a, fmt, ap);
     va_end(ap);
 
-    return (Slice) {begin, a->current};
+    return ArenaEndString(a, begin);
 }
 
 const char *ArenaPrintfCStr(Arena *a, const char *fmt, ...) {
-    char *begin = a->current;
+    ArenaString begin = ArenaBeginString(a);
     va_list ap;
     va_start(ap, fmt);
     ArenaPushfv(a, fmt, ap);
     va_end(ap);
     *RawArenaPush(a, 1) = 0;
-    return begin;
+    return ArenaEndString(a, begin).begin;
 }
 
 const char *ArenaCloneCStr(Arena *a, const char *str) {
-    char *begin = a->current;
-    ArenaPushCStr(a, str);
-    *RawArenaPush(a, 1) = 0;
+    memsize len = strlen(str);
+    char *begin = RawArenaPush(a, len + 1);
+    memcpy(begin, str, len + 1);
     return begin;
 }
 
+
+#ifndef NDEBUG
+void TEST_Arena(void) {
+    printf("Testing arena growth\n");
+    char *buffer = malloc(MIN_ARENA_SIZE);
+    Arena a = MakeArena(buffer, MIN_ARENA_SIZE);
+    ArenaPos start = ArenaSave(&a);
+    ArenaStats stats;
+    ArenaEnableStats(&a, &stats);
+
+    // Build a string that can't fit in the first block, with a
+    // nested string inside of it, and make sure it comes out whole
+    ArenaString outer = ArenaBeginString(&a);
+    ArenaPushCStr(&a, "<outer>");
+    ArenaString inner = ArenaBeginString(&a);
+    ArenaPushCStr(&a, "inner");
+    ArenaPos middle = ArenaSave(&a);
+    for (int i = 0; i < 300000; i++) { ArenaPushf(&a, "%04d", i % 10000); }
+    Slice inner_slice = ArenaEndString(&a, inner);
+    ArenaPushCStr(&a, "</outer>");
+    Slice outer_slice = ArenaEndString(&a, outer);
+
+    assert(a.block->prev);
+    assert(SliceLength(outer_slice) == 7 + 5 + 300000 * 4 + 8);
+    assert(SliceStartsWithCStr(outer_slice, "<outer>inner0000"));
+    assert(SliceEndsWithCStr(outer_slice, "9999</outer>"));
+    assert(SliceStartsWithCStr(inner_slice, "inner0000"));
+    assert(inner_slice.begin == outer_slice.begin + 7);
+
+    // Restoring into the middle of a carried string lands back in the
+    // first block, where the bytes before the save point still are
+    ArenaRestore(&a, middle);
+    assert(!a.block->prev);
+    assert(memcmp(a.current - 5, "inner", 5) == 0);
+
+    // And the released block is reused for the next big allocation
+    ArenaPushMany(&a, char, MIN_ARENA_SIZE);
+    assert(a.block->prev && !a.spare);
+
+    ArenaRestore(&a, start);
+    assert(a.current == a.begin && !a.string_depth);
+    assert(stats.in_use == 0 && stats.blocks_added == 2);
+    assert(stats.rolled_back == stats.pushed + stats.carried);
+    assert(stats.peak >= SliceLength(outer_slice) + stats.carried);
+    FreeArena(&a);
+    free(buffer);
+
+    // A virtual memory arena should hand memory back after a big restore,
+    // and hand out zeroed pages when it commits them again
+    a = AllocArenaEx(MIN_ARENA_SIZE, ArenaFlag_Trim);
+    if (a.block->reserve_end) {
+        memsize big = 4 * ARENA_TRIM_SIZE;
+        start = ArenaSave(&a);
+        memset(ArenaPushMany(&a, char, big), 1, big);
+        assert(!a.block->prev);
+
+        ArenaRestore(&a, start);
+        assert(ArenaSpace(&a) <= 2 * ARENA_COMMIT_SIZE);
+
+        char *again = ArenaPushMany(&a, char, big);
+        assert(again == start && again[big / 2] == 0);
+    }
+    FreeArena(&a);
+    printf("Seems good.\n");
+}
+#endif
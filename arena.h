@@ -3,22 +3,96 @@
 #define ARENA_H
 #include "common.h"
 #include "slice.h"
+#include <stdarg.h>
+#include <string.h>
+
+// An ArenaBlock is one chunk of arena memory. The block header lives at the
+// start of the allocation and the usable bytes follow it.
+//
+// When an arena runs out of room, it chains on a new, larger block. If a
+// string is being built when that happens (see ArenaBeginString), the
+// partial string is carried over into the new block so that it stays
+// contiguous. moved_from remembers where the carried bytes came from, so
+// ArenaEndString and ArenaRestore can find their way back.
+//
+// A virtual block (see AllocArenaEx) reserves address space up to
+// reserve_end, and only commits memory up to end as the arena needs it.
+// Heap blocks have a null reserve_end.
+typedef struct ArenaBlock {
+    struct ArenaBlock *prev;
+    char              *end;
+    char              *reserve_end;
+    char              *moved_from;
+    char              *used_end;    // Where the arena was when it moved on
+    int                owned;
+} ArenaBlock;
+
+// Options for AllocArenaEx. These only matter for virtual memory arenas.
+typedef enum ArenaFlag {
+    ArenaFlag_Trim      = 1 << 0, // Give pages back to the OS on big restores
+    ArenaFlag_HugePages = 1 << 1, // Ask for transparent huge pages
+    ArenaFlag_Populate  = 1 << 2, // Prefault memory as it is committed
+} ArenaFlag;
+
+#define ARENA_STATS_MAX_PHASES 8
+
+typedef struct ArenaPhaseStats {
+    memsize peak;
+    memsize pushed;
+    memsize push_count;
+    memsize rolled_back;
+} ArenaPhaseStats;
+
+// Optional usage counters for an arena. Hook them up with ArenaEnableStats.
+//
+// Usage can be attributed to phases (arbitrary small integers picked by the
+// caller, see ArenaStatsPhase) and to a label, like the directory being
+// worked on (see ArenaStatsLabel). The label that was active when the peak
+// was reached is remembered in peak_label.
+typedef struct ArenaStats {
+    memsize     in_use;
+    memsize     peak;
+    memsize     pushed;
+    memsize     push_count;
+    memsize     rolled_back;
+    memsize     carried;      // Bytes copied to keep open strings contiguous
+    memsize     blocks_added;
+    memsize     initial_size;
+
+    int         phase;
+    int         peak_phase;
+    const char *label;
+    int         peak_label_pending;
+    char        peak_label[BUF_SIZE];
+
+    ArenaPhaseStats phases[ARENA_STATS_MAX_PHASES];
+} ArenaStats;
 
 // An Arena is a basic linear allocator
 // All memory is grabbed from an arena, and all strings
 // are constructed by pushing onto it too.
+//
+// begin/end always describe the current (newest) block.
 typedef struct Arena {
-    char *current;
-    char *begin;
-    char *end;
+    char       *current;
+    char       *begin;
+    char       *end;
+    ArenaBlock *block;
+    ArenaBlock *spare;      // Last released block, kept around for reuse
+    memsize     block_size; // Minimum size of the next block
+    char       *string_begin;
+    int         string_depth;
+    int         flags;
+    memsize     trim_threshold; // Restores with more than this committed past them trim
+    ArenaStats *stats;          // Null unless counting is turned on
 } Arena;
 
 typedef void* ArenaPos;
 
-static inline
-Arena MakeArena(char *buffer, memsize size) {
-    return (Arena) {buffer, buffer, buffer + size};
-}
+// Sets up an arena in a caller provided buffer. The block header is carved
+// out of the front of the buffer. If the buffer fills up, additional blocks
+// are allocated from the heap.
+Arena MakeArena(char *buffer, memsize size);
 
 // Allocates `size` bytes from the arena
 char *RawArenaPush(Arena *a, memsize size); 
@@ -27,46 +101,132 @@ char *RawArenaPush(Arena *a, memsize size);
 // argument, generate a call to RawPushArena with the correct byte count, and
 // cast the result to the requested type.
 #define  ArenaPush(a, T) (T*)RawArenaPush((a), sizeof(T))
-#define  ArenaPushMany(a, T, count) (T*)RawArenaPush((a), sizeof(T) * count)
+#define  ArenaPushMany(a, T, count) (T*)RawArenaPush((a), sizeof(T) * (count))
 
-static inline
-void ArenaReset(Arena *a) { 
-    a->current = a->begin; 
-}
+// Rolls the arena all the way back to the start of its first block
+void ArenaReset(Arena *a);
 
+// Space left in the current block
 static inline
 memsize ArenaSpace(Arena *a) { 
     return (memsize)(a->end - a->current); 
 }
 
+// Makes sure there are at least `size` contiguous bytes available at
+// a->current, chaining on a new block if needed.
+void ArenaReserve(Arena *a, memsize size);
+
+// Pads the arena so the next allocation starts on an `alignment` byte
+// boundary (a power of two). Text doesn't care, but arrays of structs that
+// get pushed after text should.
+static inline
+void ArenaAlign(Arena *a, memsize alignment) {
+    ArenaReserve(a, alignment);
+    memsize padding = (memsize)(-(uintptr_t)a->current) & (alignment - 1);
+    if (padding) { RawArenaPush(a, padding); }
+}
+
 // Save and Restore allow arena space to be reused. You can mark a position in
 // the arena, do a ton of work that involves allocation from the arena, and
 // roll back in one instruction once its done.
+//
+// If the arena grew into new blocks since the save, the restore releases
+// them, which takes a few more instructions.
 static inline
 ArenaPos ArenaSave(Arena *a) { 
     return (void*)a->current; 
 }
 
+void ArenaRestoreBlocks(Arena *a, ArenaPos pos);
+
+// Decommits the memory past the current position, returning the pages to the
+// OS. Called by ArenaRestore for ArenaFlag_Trim arenas when a restore leaves
+// more than ARENA_TRIM_SIZE of committed memory behind.
+void ArenaTrim(Arena *a);
+
+static inline
+void ArenaStatsRollBack(ArenaStats *s, memsize size) {
+    s->in_use      -= size;
+    s->rolled_back += size;
+    s->phases[s->phase].rolled_back += size;
+}
+
 static inline
 void ArenaRestore(Arena *a, ArenaPos pos) { 
-    a->current = pos; 
+    char *p = (char*)pos;
+
+    if (p < a->begin || p > a->end) {
+        ArenaRestoreBlocks(a, pos);
+        return;
+    }
+
+    if (a->stats && p < a->current) {
+        ArenaStatsRollBack(a->stats, (memsize)(a->current - p));
+    }
+
+    a->current = p;
+
+    // Any string that began after pos was thrown away
+    if (a->string_depth && a->string_begin > p) {
+        a->string_depth = 0;
+    }
+
+    if ((memsize)(a->end - p) > a->trim_threshold) {
+        ArenaTrim(a);
+    }
 }
 
 // BeginString/EndString marks the start of a string and
 // then produces a slice after building it with the Push functions below
+//
+// Strings can be nested. While any string is open, the arena guarantees
+// that it stays contiguous, even if the arena has to grow.
 typedef char* ArenaString;
 
 static inline
 ArenaString ArenaBeginString(Arena *a) { 
+    if (!a->string_depth++) {
+        a->string_begin = a->current;
+    }
+
     return a->current; 
 }
 
+// Finds where an open string lives now, in case it was carried into a newer
+// block while it was being built.
+char *ArenaStringLocation(Arena *a, ArenaString s);
+
 static inline
 Slice ArenaEndString(Arena *a, ArenaString s) {
+    if (s < a->begin || s > a->end) {
+        s = ArenaStringLocation(a, s);
+    }
+
+    if (a->string_depth) {
+        a->string_depth--;
+    }
+
     return (Slice) {s, a->current};
 }
 
+// The number of bytes in an open string so far
+static inline
+memsize ArenaStringLength(Arena *a, ArenaString s) {
+    if (s < a->begin || s > a->end) {
+        s = ArenaStringLocation(a, s);
+    }
+
+    return (memsize)(a->current - s);
+}
+
+// Allocates an arena with `size` bytes ready to go.
+//
+// On 64 bit POSIX systems, the arena reserves ARENA_RESERVE_SIZE of address
+// space and commits it as it goes, so it never has to chain blocks in
+// practice, and peak memory use is whatever was actually touched. Elsewhere
+// it mallocs `size` bytes and chains heap blocks as needed.
 Arena AllocArena(memsize size); 
+Arena AllocArenaEx(memsize size, int flags);
 void FreeArena(Arena *a); 
 
 ////////////////////////////////////////////////
@@ -81,6 +241,13 @@ void ArenaPushChar(Arena *a, char value) {
 
 void ArenaPushData(Arena *a, char *data, memsize data_count); 
 void ArenaPushCStr(Arena *a, const char *cstr); 
+
+// Pushes a string literal (ex: ArenaPushLiteral(a, "<p>\n")). The length is
+// known at compile time, so this is one memcpy of a fixed size, with no
+// strlen. The "" makes anything other than a literal a compile error.
+#define ArenaPushLiteral(a, literal) \
+    memcpy(RawArenaPush((a), sizeof("" literal) - 1), (literal), sizeof("" literal) - 1)
+
 Slice ArenaPushSlice(Arena *a, Slice s);
 
 void ArenaPushfv(Arena *a, const char *fmt, va_list ap); 
@@ -97,5 +264,26 @@ const char *ArenaPrintfCStr(Arena *a, const char *fmt, ...);
 
 const char *ArenaCloneCStr(Arena *a, const char *str); 
 
+////////////////////////////////////////////////
+// Arena usage stats
+////////////////////////////////////////////////
+
+// Starts counting usage of the arena into `stats`. Whatever is already in
+// the arena counts as in use.
+void ArenaEnableStats(Arena *a, ArenaStats *stats);
+
+// Sets the phase / label that usage is attributed to, returning the previous
+// one so it can be put back. These do nothing if stats are off.
+int ArenaStatsPhase(Arena *a, int phase);
+const char *ArenaStatsLabel(Arena *a, const char *label);
+
+// Prints a human readable summary, or a JSON object, of the stats.
+// phase_names gives a name to each phase used with ArenaStatsPhase.
+void PrintArenaStats(ArenaStats *s, const char **phase_names, int phase_count, FILE *out);
+void PrintArenaStatsJSON(ArenaStats *s, const char **phase_names, int phase_count, FILE *out);
+
+#ifndef NDEBUG
+void TEST_Arena(void);
 #endif
 
+#endif
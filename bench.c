@@ -0,0 +1,279 @@
+/*
+Benchmarks for the hot parts of site.c
+
+Build it like the unity build of site.c, ex:
+
+    clang -O2 -DNDEBUG bench.c -o bench
+
+and run it with some SC files to time, or with no arguments to time a
+generated file:
+
+    ./bench [file.sc ...]
+
+Each benchmark runs a few times over every file, and the best time is
+reported as GB/s of SC source.
+*/
+#include "common.h"
+#include "slice.h"
+#include "arena.h"
+#include "paths.h"
+#include "sc_file.h"
+#include "sc_to_html.h"
+#include "threads.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+static double BenchSeconds(void) {
+    LARGE_INTEGER counter, frequency;
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+    return (double)counter.QuadPart / (double)frequency.QuadPart;
+}
+#else
+#include <time.h>
+static double BenchSeconds(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (double)t.tv_sec + (double)t.tv_nsec * 1e-9;
+}
+#endif
+
+#define BENCH_REPEATS  7
+#define BENCH_MAX_FILES 256
+
+typedef struct BenchInput {
+    Slice       files[BENCH_MAX_FILES];
+    const char *names[BENCH_MAX_FILES];
+    int         files_count;
+    memsize     total_size;
+} BenchInput;
+
+// Every benchmark is a function run over one file. The return value is
+// summed up and printed, so the compiler can't throw the work away.
+typedef memsize BenchFunc(Slice file, const char *name, Arena *arena);
+
+static void RunBench(const char *label, BenchFunc *func, BenchInput *in, Arena *arena) {
+    double  best  = 1e30;
+    memsize check = 0;
+
+    for (int rep = 0; rep < BENCH_REPEATS; rep++) {
+        double start = BenchSeconds();
+
+        for (int i = 0; i < in->files_count; i++) {
+            ArenaPos pos = ArenaSave(arena);
+            check += func(in->files[i], in->names[i], arena);
+            ArenaRestore(arena, pos);
+        }
+
+        double elapsed = BenchSeconds() - start;
+        if (elapsed < best) { best = elapsed; }
+    }
+
+    printf("  %-28s %9.3f ms %8.3f GB/s   (%llu)\n", label, best * 1e3,
+           (double)in->total_size / best / (1024.0 * 1024.0 * 1024.0),
+           (unsigned long long)(check / BENCH_REPEATS));
+}
+
+////////////////////////////////////////////////
+// Reading SC files
+////////////////////////////////////////////////
+
+static memsize BenchStreamRead(Slice file, const char *name, Arena *arena) {
+    (void)arena; // Streaming reads never touch the arena
+    SCReader reader = MakeSCReader(file, "bench", name);
+    SCObject obj;
+    memsize  funcs = 0;
+
+    do {
+        SCRead(&reader, &obj);
+        funcs += obj.type == SCObjectType_Func;
+    } while (obj.type != SCObjectType_End &&
+             obj.type != SCObjectType_Error);
+
+    return funcs;
+}
+
+static memsize BenchDocumentRead(Slice file, const char *name, Arena *arena) {
+    SCReader   reader = MakeSCReader(file, "bench", name);
+    SCDocument doc;
+    SCReadDocument(&reader, arena, &doc);
+
+    memsize funcs = 0;
+    for (int i = 0; i < doc.count; i++) {
+        funcs += doc.types[i] == SCObjectType_Func;
+    }
+
+    return funcs;
+}
+
+// Two consumers that each look at every object of the same file (ex: an
+// indexer collecting links, then the converter), each driving their own
+// reader
+static memsize BenchStreamTwice(Slice file, const char *name, Arena *arena) {
+    SCReader reader = MakeSCReader(file, "bench", name);
+    SCObject obj;
+    memsize  links = 0;
+
+    do {
+        SCRead(&reader, &obj);
+        links += obj.command == SCCommand_Link;
+    } while (obj.type != SCObjectType_End &&
+             obj.type != SCObjectType_Error);
+
+    return links + BenchStreamRead(file, name, arena);
+}
+
+// The same two consumers, sharing a document
+static memsize BenchDocumentTwice(Slice file, const char *name, Arena *arena) {
+    SCReader   reader = MakeSCReader(file, "bench", name);
+    SCDocument doc;
+    memsize    links = 0, funcs = 0;
+    SCReadDocument(&reader, arena, &doc);
+
+    for (int i = 0; i < doc.count; i++) {
+        links += doc.commands[i] == SCCommand_Link;
+    }
+
+    for (int i = 0; i < doc.count; i++) {
+        funcs += doc.types[i] == SCObjectType_Func;
+    }
+
+    return links + funcs;
+}
+
+static memsize BenchToHTML(Slice file, const char *name, Arena *arena) {
+    SCInfo info;
+    Slice  html;
+    if (!SCToHTML(file, "bench", name, arena, &info, &html)) { return 0; }
+    return SliceLength(html);
+}
+
+// The same, reading and converting on every processor
+static memsize BenchParallelToHTML(Slice file, const char *name, Arena *arena) {
+    SCReader   reader = MakeSCReader(file, "bench", name);
+    SCDocument doc;
+    SCInfo     info;
+    Slice      html;
+    SCReadDocumentParallel(&reader, arena, &doc, ProcessorCount());
+    if (!SCDocumentToHTMLParallel(&doc, arena, &info, ProcessorCount(), &html)) { return 0; }
+    return SliceLength(html);
+}
+
+////////////////////////////////////////////////
+// Escaping text
+////////////////////////////////////////////////
+
+// Every byte of prose goes through HTMLWriteEscapedText, so it gets the
+// whole file at once here
+static memsize BenchEscape(Slice file, const char *name, Arena *arena) {
+    (void)name;
+    ArenaString html = ArenaBeginString(arena);
+    HTMLWriteEscapedText(file, arena);
+    return SliceLength(ArenaEndString(arena, html));
+}
+
+// The old byte at a time escaping, to compare against
+static memsize BenchEscapeBytes(Slice file, const char *name, Arena *arena) {
+    (void)name;
+    ArenaString html = ArenaBeginString(arena);
+    for (char *p = file.begin; p < file.end; p++) {
+        switch (*p) {
+        case '"':  ArenaPushCStr(arena, "&quot;"); break;
+        case '&':  ArenaPushCStr(arena, "&amp;"); break;
+        case '\'': ArenaPushCStr(arena, "&#39;"); break;
+        case '<':  ArenaPushCStr(arena, "&lt;"); break;
+        case '>':  ArenaPushCStr(arena, "&gt;"); break;
+        default:   ArenaPushChar(arena, *p); break;
+        }
+    }
+    return SliceLength(ArenaEndString(arena, html));
+}
+
+////////////////////////////////////////////////
+
+// Makes an SC file that looks like a long page, with a bit of everything
+static Slice MakeBenchFile(Arena *arena, memsize size) {
+    ArenaString file = ArenaBeginString(arena);
+    ArenaPushCStr(arena, "\\info(title=\"Benchmark\", date=\"2019-01-01\")\n");
+
+    for (int i = 0; (memsize)(arena->current - file) < size; i++) {
+        ArenaPushf(arena, "\\section{Section %d}\n\n", i);
+        ArenaPushCStr(arena,
+            "Lorem ipsum dolor sit amet, consectetur adipiscing elit, sed do\n"
+            "eiusmod tempor incididunt ut labore et dolore magna aliqua. Ut\n"
+            "enim ad minim veniam, quis nostrud \\bold{exercitation} ullamco\n"
+            "laboris nisi ut aliquip ex ea commodo consequat. A < B & C > D\n"
+            "and a backslash \\\\ for good measure.\n\n"
+            "\\paragraph\n"
+            "See \\link(url=\"http://example.com/page.html\"){this page} and\n"
+            "\\italic{that one}, or run \\inline{make -j8} first.\n\n"
+            "\\unordered_list\n"
+            "    \\item First thing\n"
+            "    \\item Second thing, with \\bold{bold} text\n"
+            "    \\item Third thing\n"
+            "\\paragraph\n"
+            "\\code{\n"
+            "int main(int argc, char **argv) {\n"
+            "    return argc > 1 ? 0 : 1;\n"
+            "}\n"
+            "}\n\n");
+    }
+
+    return ArenaEndString(arena, file);
+}
+
+int main(int argc, char **argv) {
+    Arena      arena = AllocArena(ARENA_SIZE);
+    BenchInput in    = {0};
+
+    for (int i = 1; i < argc && in.files_count < BENCH_MAX_FILES; i++) {
+        Slice file;
+        if (!ReadEntireFile(argv[i], &arena, &file)) {
+            fprintf(stderr, "Could not read file: %s\n", argv[i]);
+            return -1;
+        }
+
+        in.files[in.files_count] = file;
+        in.names[in.files_count] = argv[i];
+        in.files_count++;
+        in.total_size += SliceLength(file);
+    }
+
+    if (!in.files_count) {
+        in.files[0]    = MakeBenchFile(&arena, 16 * 1024 * 1024);
+        in.names[0]    = "generated.sc";
+        in.files_count = 1;
+        in.total_size  = SliceLength(in.files[0]);
+    }
+
+    printf("%d files, %.1f MB\n", in.files_count,
+           (double)in.total_size / (1024.0 * 1024.0));
+
+    printf("Reading:\n");
+    RunBench("SCRead stream",              BenchStreamRead,    &in, &arena);
+    RunBench("SCReadDocument + walk",      BenchDocumentRead,  &in, &arena);
+    RunBench("SCRead stream, 2 consumers", BenchStreamTwice,   &in, &arena);
+    RunBench("SCDocument, 2 consumers",    BenchDocumentTwice, &in, &arena);
+
+    printf("Escaping:\n");
+    RunBench("HTMLWriteEscapedText",       BenchEscape,        &in, &arena);
+    RunBench("Byte at a time",             BenchEscapeBytes,   &in, &arena);
+
+    printf("Converting:\n");
+    RunBench("SCToHTML",                   BenchToHTML,        &in, &arena);
+    RunBench("Parallel read + convert",    BenchParallelToHTML, &in, &arena);
+
+    FreeArena(&arena);
+    return 0;
+}
+
+#include "slice.c"
+#include "arena.c"
+#include "paths.c"
+#include "sc_file.c"
+#include "sc_cache.c"
+#include "sc_to_html.c"
+#include "threads.c"
@@ -10,9 +10,24 @@ typedef size_t   memsize;
 
 #define ArrayCount(arr) (sizeof(arr)/sizeof(arr[0]))
 
-// Main arena size for loading and writing files
-#define ARENA_SIZE     (128 * 1024 * 1024) 
-#define MIN_ARENA_SIZE (16 * 1024 * 1024)
+// Initial arena size for loading and writing files.
+// The arena chains on more blocks as needed, so this is just a starting point
+#define ARENA_SIZE     (4 * 1024 * 1024) 
+#define MIN_ARENA_SIZE (1 * 1024 * 1024)
+
+// Minimum and maximum size of the blocks an arena grows by
+#define ARENA_BLOCK_SIZE     (4 * 1024 * 1024)
+#define ARENA_MAX_BLOCK_SIZE (256 * 1024 * 1024)
+
+// Virtual memory arenas reserve this much address space, and commit it in
+// ARENA_COMMIT_SIZE chunks (ARENA_HUGE_PAGE_SIZE with huge pages on)
+#define ARENA_RESERVE_SIZE   ((memsize)64 * 1024 * 1024 * 1024)
+#define ARENA_COMMIT_SIZE    (1024 * 1024)
+#define ARENA_HUGE_PAGE_SIZE (2 * 1024 * 1024)
+
+// With trimming on, a restore that leaves more than this much committed
+// memory past the restored position gives it back to the OS
+#define ARENA_TRIM_SIZE      (16 * 1024 * 1024)
 
 // Used for paths, since they have to be null
 // terminated thanks to the OS APIs
@@ -1,6 +1,8 @@
 #include "paths.h"
+#include "threads.h"
 #include <stdio.h>
 #include <string.h>
+#include <stdlib.h>
 #include <stdarg.h>
 
 // IMPORTANT(eric): The varargs for this function are null terminated!
@@ -37,7 +39,151 @@ const char *MakePath(Arena *arena, ...) {
     ArenaPushChar(arena, 0);
     va_end(ap);
 
-    return (const char *)path;
+    return (const char *)ArenaEndString(arena, path).begin;
+}
+
+// What a FileBatch does where there is nothing better, and for any file the
+// batch couldn't handle itself
+static void ReadFilesOneByOne(DirHandle *dir, FileBatchItem *items, int count, Arena *arena) {
+    for (int i = 0; i < count; i++) {
+        items[i].ok = ReadEntireFileAt(dir, items[i].name, arena, &items[i].data);
+    }
+}
+
+static void WriteFilesOneByOne(DirHandle *dir, FileBatchItem *items, int count) {
+    for (int i = 0; i < count; i++) {
+        items[i].ok = UpdateEntireFilePartsAt(dir, items[i].name, 
+                                              items[i].parts, items[i].parts_count,
+                                              &items[i].changed);
+    }
+}
+
+// NOTE: Outputs are only written when their bytes change, so files
+// that come out the same keep their modified times, and whatever syncs the
+// output (rsync, a CDN, HTTP caches) only sees what really changed. The
+// bytes on disk are read back and compared, instead of keeping hashes
+// anywhere, so nothing can get out of date.
+#define COMPARE_BUFFER_SIZE (32 * 1024)
+
+// Compares the next len bytes of parts, from where *part and *part_at say,
+// with data, moving them along
+static int PartsMatch(Slice *parts, int *part, memsize *part_at, char *data, memsize len) {
+    for (memsize at = 0; at < len;) {
+        memsize left = SliceLength(parts[*part]) - *part_at;
+        if (!left) {
+            (*part)++;
+            *part_at = 0;
+            continue;
+        }
+
+        memsize amount = len - at < left ? len - at : left;
+        if (memcmp(data + at, parts[*part].begin + *part_at, amount) != 0) { return 0; }
+        at       += amount;
+        *part_at += amount;
+    }
+
+    return 1;
+}
+
+static uint64_t PartsLength(Slice *parts, int parts_count) {
+    uint64_t total = 0;
+    for (int i = 0; i < parts_count; i++) { total += SliceLength(parts[i]); }
+    return total;
+}
+
+static int SliceHasParts(Slice data, Slice *parts, int parts_count) {
+    int     part    = 0;
+    memsize part_at = 0;
+    return SliceLength(data) == PartsLength(parts, parts_count) && 
+           PartsMatch(parts, &part, &part_at, data.begin, SliceLength(data));
+}
+
+// Whether file "name" inside of dir holds exactly the bytes in parts
+static int FileHasPartsAt(DirHandle *dir, const char *name, Slice *parts, int parts_count) {
+    uint64_t total = PartsLength(parts, parts_count);
+    FileInfo info  = {0};
+    if (!GetFileInfoAt(dir, name, &info) || info.size != total) { return 0; }
+
+    FILE *file = OpenFileAt(dir, name, "rb");
+    if (!file) { return 0; }
+
+    char    buffer[COMPARE_BUFFER_SIZE];
+    int     same    = 1;
+    int     part    = 0;
+    memsize part_at = 0;
+    for (uint64_t done = 0; same && done < total;) {
+        memsize want   = total - done < sizeof(buffer) ? (memsize)(total - done) : sizeof(buffer);
+        memsize amount = fread(buffer, 1, want, file);
+        same  = amount == want && PartsMatch(parts, &part, &part_at, buffer, amount);
+        done += amount;
+    }
+
+    fclose(file);
+    return same;
+}
+
+// Whether files a and b inside of dir hold the same bytes
+static int FilesMatchAt(DirHandle *dir, const char *a, const char *b) {
+    FileInfo a_info = {0};
+    FileInfo b_info = {0};
+    if (!GetFileInfoAt(dir, a, &a_info) || !GetFileInfoAt(dir, b, &b_info) ||
+        a_info.size != b_info.size) {
+        return 0; 
+    }
+
+    FILE *a_file = OpenFileAt(dir, a, "rb");
+    FILE *b_file = OpenFileAt(dir, b, "rb");
+    int   same   = a_file && b_file;
+
+    char a_buffer[COMPARE_BUFFER_SIZE];
+    char b_buffer[COMPARE_BUFFER_SIZE];
+    for (uint64_t done = 0; same && done < a_info.size;) {
+        memsize want = a_info.size - done < sizeof(a_buffer) ? (memsize)(a_info.size - done) 
+                                                              : sizeof(a_buffer);
+        same  = fread(a_buffer, 1, want, a_file) == want && 
+                fread(b_buffer, 1, want, b_file) == want &&
+                memcmp(a_buffer, b_buffer, want) == 0;
+        done += want;
+    }
+
+    if (a_file) { fclose(a_file); }
+    if (b_file) { fclose(b_file); }
+    return same;
+}
+
+int TempFileName(const char *name, char *buf, memsize buf_size) {
+    const char *base = name;
+    for (const char *c = name; *c; c++) {
+        if (*c == '/' || *c == '\\') { base = c + 1; }
+    }
+
+    int length = snprintf(buf, buf_size, "%.*s.%s.tmp", (int)(base - name), name, base);
+    return length >= 0 && (memsize)length < buf_size;
+}
+
+int ReplaceFileAt(DirHandle *dir, const char *temp_name, const char *name, int *changed) {
+    *changed = !FilesMatchAt(dir, temp_name, name);
+    if (!*changed) { return RemoveFileAt(dir, temp_name); }
+    if (RenameFileAt(dir, temp_name, name)) { return 1; }
+
+    RemoveFileAt(dir, temp_name);
+    return 0;
+}
+
+int UpdateEntireFilePartsAt(DirHandle *dir, const char *name, 
+                            Slice *parts, int parts_count, int *changed) {
+    *changed = !FileHasPartsAt(dir, name, parts, parts_count);
+    if (!*changed) { return 1; }
+
+    char temp_name[BUF_SIZE];
+    if (!TempFileName(name, temp_name, sizeof(temp_name))) { return 0; }
+    if (WriteEntireFilePartsAt(dir, temp_name, parts, parts_count) &&
+        RenameFileAt(dir, temp_name, name)) {
+        return 1; 
+    }
+
+    RemoveFileAt(dir, temp_name);
+    return 0;
 }
 
 #ifdef _WIN32
@@ -147,30 +293,39 @@ int ReadEntireFile(const char *file_path, Arena *arena, Slice *out) {
     LARGE_INTEGER val;
     memset(&val, 0, sizeof(val));
 
-    if (!GetFileSizeEx(file, &val) || val.HighPart) { 
+    if (!GetFileSizeEx(file, &val) || (uint64_t)val.QuadPart > (memsize)-1) { 
         CloseHandle(file);
         return 0; 
     }
 
-    ArenaPos pos = ArenaSave(arena);
-    char *buf = RawArenaPush(arena, val.LowPart);
-    unsigned long bytes_read = 0;
+    memsize  size = (memsize)val.QuadPart;
+    ArenaPos pos  = ArenaSave(arena);
+    char    *buf  = RawArenaPush(arena, size);
 
-    if (!ReadFile(file, buf, val.LowPart, &bytes_read, 0) || 
-        bytes_read != val.LowPart) {
-        CloseHandle(file);
-        ArenaRestore(arena, pos);
-        return 0;
+    // ReadFile takes a 32 bit size, so big files are read in pieces
+    for (memsize done = 0; done < size;) {
+        memsize       want       = size - done;
+        unsigned long bytes_read = 0;
+        if (want > (1 << 30)) { want = 1 << 30; }
+
+        if (!ReadFile(file, buf + done, (unsigned long)want, &bytes_read, 0) || 
+            bytes_read != want) {
+            CloseHandle(file);
+            ArenaRestore(arena, pos);
+            return 0; 
+        }
+
+        done += want;
     }
 
-    *out = MakeSlice(buf, val.LowPart);
+    *out = MakeSlice(buf, size);
     CloseHandle(file);
     return 1;
 }
 
-// Write whole file from slice data.
+// Write whole file from several slices.
 // Returns false on failure
-int WriteEntireFile(Slice data, const char *file_path) {
+int WriteEntireFileParts(Slice *parts, int parts_count, const char *file_path) {
     HANDLE file = CreateFileA(file_path, 
                               GENERIC_WRITE,
                               0, // share mode
@@ -180,57 +335,258 @@ int WriteEntireFile(Slice data, const char *file_path) {
                               0); // template
 
     if (file == INVALID_HANDLE_VALUE) { return 0; }
-    memsize len = SliceLength(data);
-    unsigned long bytes_read = 0;
 
-    if (!WriteFile(file, data.begin, (DWORD)len, &bytes_read, 0) ||
-        bytes_read != len) {
+    for (int i = 0; i < parts_count; i++) {
+        memsize len = SliceLength(parts[i]);
+        unsigned long bytes_read = 0;
+
+        if (!WriteFile(file, parts[i].begin, (DWORD)len, &bytes_read, 0) ||
+            bytes_read != len) {
+            CloseHandle(file);
+            return 0; 
+        }
+    }
+
+    CloseHandle(file);
+    return 1;
+}
+
+int GetFileInfo(const char *file_path, FileInfo *out) {
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExA(file_path, GetFileExInfoStandard, &data)) {
+        return 0; 
+    }
+
+    out->size     = ((uint64_t)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    out->modified = (int64_t)(((uint64_t)data.ftLastWriteTime.dwHighDateTime << 32) | 
+                              data.ftLastWriteTime.dwLowDateTime);
+    return 1;
+}
+
+int MapEntireFile(const char *file_path, Slice *out) {
+    HANDLE file = CreateFileA(file_path, 
+                              GENERIC_READ,
+                              FILE_SHARE_READ,
+                              0, // security
+                              OPEN_EXISTING,
+                              0, // file attr
+                              0); // template
+    if (file == INVALID_HANDLE_VALUE) { return 0; }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
         CloseHandle(file);
-        return 0;
+        return 0; 
     }
 
+    // NOTE: The view keeps the file open, the handles can go
+    HANDLE mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
     CloseHandle(file);
+    if (!mapping) { return 0; }
+
+    char *view = (char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (!view) { return 0; }
+
+    *out = MakeSlice(view, (memsize)size.QuadPart);
+    return 1;
+}
+
+void UnmapEntireFile(Slice data) {
+    UnmapViewOfFile(data.begin);
+}
+
+// NOTE: There is nothing like openat here, so handles just go by
+// path, and names are joined onto it in buf.
+static const char *JoinAt(DirHandle *dir, const char *name, char *buf) {
+    if (!dir) { return name; }
+    snprintf(buf, BUF_SIZE, "%s\\%s", dir->path, name);
+    return buf;
+}
+
+int OpenDirHandle(DirHandle *dir, const char *name, Arena *arena, DirHandle *out) {
+    char  buf[BUF_SIZE];
+    DWORD attributes = GetFileAttributesA(JoinAt(dir, name, buf));
+    if (attributes == INVALID_FILE_ATTRIBUTES || 
+        !(attributes & FILE_ATTRIBUTE_DIRECTORY)) { 
+        return 0; 
+    }
+
+    if (dir) {
+        out->path = MakePath(arena, dir->path, name, 0);
+    } else {
+        char full[BUF_SIZE];
+        DWORD len = GetFullPathNameA(name, BUF_SIZE, full, 0);
+        if (len == 0 || len >= BUF_SIZE) { return 0; }
+        out->path = ArenaCloneCStr(arena, full);
+    }
+
+    out->fd = -1;
     return 1;
 }
 
+void CloseDirHandle(DirHandle *dir) {
+    dir->fd = -1;
+}
+
+void BeginDirIterAt(DirIter *iter, DirHandle *dir) {
+    BeginDirIter(iter, dir->path);
+}
+
+int MakeDirectoryAt(DirHandle *dir, const char *name) {
+    char buf[BUF_SIZE];
+    return MakeDirectory(JoinAt(dir, name, buf));
+}
+
+int ReadEntireFileAt(DirHandle *dir, const char *name, Arena *arena, Slice *out) {
+    char buf[BUF_SIZE];
+    return ReadEntireFile(JoinAt(dir, name, buf), arena, out);
+}
+
+int ReadOrMapEntireFileAt(DirHandle *dir, const char *name, uint64_t map_above,
+                          Arena *arena, Slice *out, int *mapped) {
+    char        buf[BUF_SIZE];
+    const char *path = JoinAt(dir, name, buf);
+    FileInfo    info = {0};
+    *mapped = GetFileInfo(path, &info) && info.size > map_above && MapEntireFile(path, out);
+    return *mapped || ReadEntireFile(path, arena, out);
+}
+
+int WriteEntireFilePartsAt(DirHandle *dir, const char *name, Slice *parts, int parts_count) {
+    char buf[BUF_SIZE];
+    return WriteEntireFileParts(parts, parts_count, JoinAt(dir, name, buf));
+}
+
+int GetFileInfoAt(DirHandle *dir, const char *name, FileInfo *out) {
+    char buf[BUF_SIZE];
+    return GetFileInfo(JoinAt(dir, name, buf), out);
+}
+
+FILE *OpenFileAt(DirHandle *dir, const char *name, const char *mode) {
+    char buf[BUF_SIZE];
+    return fopen(JoinAt(dir, name, buf), mode);
+}
+
+int RemoveFileAt(DirHandle *dir, const char *name) {
+    char buf[BUF_SIZE];
+    return remove(JoinAt(dir, name, buf)) == 0;
+}
+
+int LinkFileAt(DirHandle *dir, const char *name, const char *link_name) {
+    char buf[BUF_SIZE], link_buf[BUF_SIZE], temp_buf[BUF_SIZE], temp_name[256];
+    if (snprintf(temp_name, sizeof(temp_name), ".%s.link", link_name) >= (int)sizeof(temp_name)) {
+        return 0; 
+    }
+
+    const char *path      = JoinAt(dir, name, buf);
+    const char *link_path = JoinAt(dir, link_name, link_buf);
+    const char *temp_path = JoinAt(dir, temp_name, temp_buf);
+
+    DeleteFileA(temp_path);
+    if (!CreateHardLinkA(temp_path, path, 0)) { return 0; }
+    if (!MoveFileExA(temp_path, link_path, MOVEFILE_REPLACE_EXISTING)) {
+        DeleteFileA(temp_path);
+        return 0; 
+    }
+
+    return 1;
+}
+
+int RenameFileAt(DirHandle *dir, const char *name, const char *new_name) {
+    char buf[BUF_SIZE], new_buf[BUF_SIZE];
+    return MoveFileExA(JoinAt(dir, name, buf), JoinAt(dir, new_name, new_buf), 
+                       MOVEFILE_REPLACE_EXISTING) != 0;
+}
+
+struct FileBatch {
+    int unused;
+};
+
+FileBatch *AllocFileBatch(void) {
+    return (FileBatch*)calloc(1, sizeof(FileBatch));
+}
+
+void FreeFileBatch(FileBatch *batch) {
+    free(batch);
+}
+
+void ReadEntireFilesAt(FileBatch *batch, DirHandle *dir, 
+                       FileBatchItem *items, int count, Arena *arena) {
+    ReadFilesOneByOne(dir, items, count, arena);
+}
+
+void WriteEntireFilesAt(FileBatch *batch, DirHandle *dir, 
+                        FileBatchItem *items, int count, Arena *arena) {
+    WriteFilesOneByOne(dir, items, count);
+}
+
 // I still cannot find a good way to do these.
 // There is SHFileOperationA, but it is apparently deprecated and 
 // replaced by the IFileOperation COM object.
 
-void CopyDirectory(const char *src_path, const char *src_name,
-                   const char *dst_path, const char *dst_name, 
-                   Arena *arena) {
+// NOTE: xcopy /D only copies files that are newer than their copy,
+// which is the closest thing to the POSIX version's skipping of unchanged
+// files. It goes one file at a time, so threads is unused.
+int CopyDirectory(const char *src_path, const char *src_name,
+                  const char *dst_path, const char *dst_name, 
+                  int threads, Arena *arena) {
     const char *full_src = MakePath(arena, src_path, src_name, 0);
     const char *full_dst = MakePath(arena, dst_path, dst_name, 0);
+    if (GetFileAttributesA(full_src) == INVALID_FILE_ATTRIBUTES) { return 1; }
+
     const char * cmd = ArenaPrintfCStr(arena,
-                           "xcopy /Y /I /Q /E \"%s\" \"%s\"",
+                           "xcopy /Y /I /Q /E /D \"%s\" \"%s\"",
                            full_src,
                            full_dst);
-    system(cmd);
+    return system(cmd) == 0;
 }
 
-void CopyFileToDir(const char *src_path, const char *src_name,
-              const char *dst_path, Arena *arena) {
+int CopyFileToDir(const char *src_path, const char *src_name,
+                  const char *dst_path, Arena *arena) {
     const char *full_src = MakePath(arena, src_path, src_name, 0);
     const char *full_dst = MakePath(arena, dst_path, src_name, 0);
-    const char * cmd = ArenaPrintfCStr(arena,
-                           "copy /Y \"%s\" \"%s\"",
-                           full_src,
-                           full_dst);
-    system(cmd);
+
+    // CopyFileA keeps the last write time, so an unchanged copy matches
+    FileInfo src_info = {0};
+    FileInfo dst_info = {0};
+    if (!GetFileInfo(full_src, &src_info)) { return 1; }
+    if (GetFileInfo(full_dst, &dst_info) && 
+        src_info.size     == dst_info.size && 
+        src_info.modified == dst_info.modified) { return 1; }
+
+    return CopyFileA(full_src, full_dst, FALSE) != 0;
 }
 
 #else // Linux/Unix/macOS/POSIX
 #   include <dirent.h>
 #   include <unistd.h>
+#   include <fcntl.h>
 #   include <sys/stat.h>
+#   include <sys/mman.h>
+#   include <sys/uio.h>
+#   include <errno.h>
+#   include <limits.h>
+#   ifdef __linux__
+#       include <sys/ioctl.h>
+#       include <sys/syscall.h>
+#   endif
+#   if defined(__linux__) && defined(__has_include)
+#       if __has_include(<linux/fs.h>)
+#           include <linux/fs.h>
+#       endif
+#       if __has_include(<linux/io_uring.h>)
+#           define PATHS_IO_URING 1
+#           include <linux/io_uring.h>
+#           include <sys/syscall.h>
+#       endif
+#   endif
 // See windows impls for commentary
 //
 struct DirIter {
     char buf[BUF_SIZE];
     DIR *dirp;
     struct dirent *dirent;
-} DirIter;
+};
 
 void BeginDirIter(DirIter *dir, const char *path) {
     memset(dir, 0, sizeof(*dir));
@@ -252,8 +608,16 @@ int GetNextFile(DirIter *dir) {
     return 1;
 }
 
+// NOTE: Some filesystems don't fill in d_type, and say DT_UNKNOWN for
+// everything, so then the entry has to be looked up. Not following links,
+// same as d_type.
 int IsDirectory(DirIter *dir) {
-    return dir->dirent->d_type & DT_DIR;
+    unsigned char type = dir->dirent->d_type;
+    if (type != DT_UNKNOWN) { return type == DT_DIR; }
+
+    struct stat st;
+    return fstatat(dirfd(dir->dirp), dir->dirent->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0 && 
+           S_ISDIR(st.st_mode);
 }
 
 const char *GetFileName(DirIter *dir) {
@@ -261,7 +625,7 @@ const char *GetFileName(DirIter *dir) {
 }
 
 void EndDirIter(DirIter *dir) {
-    closedir(dir->dirp);
+    if (dir->dirp) { closedir(dir->dirp); }
 }
 
 int ChangeDirectory(const char *path) {
@@ -272,87 +636,926 @@ void CurrentDirectory(char *buf, memsize buf_len) {
     getcwd(buf, buf_len);
 }
 
+// Works out what to hand the *at functions for "name" inside of dir. The
+// plain path functions pass a null dir, which means the current directory.
+// Handles that only have a path get name joined onto it, in buf.
+static int ResolveAt(DirHandle *dir, const char *name, char *buf, const char **out_name) {
+    *out_name = name;
+    if (!dir)         { return AT_FDCWD; }
+    if (dir->fd >= 0) { return dir->fd; }
+
+    snprintf(buf, BUF_SIZE, "%s/%s", dir->path, name);
+    *out_name = buf;
+    return AT_FDCWD;
+}
+
+int OpenDirHandle(DirHandle *dir, const char *name, Arena *arena, DirHandle *out) {
+    char        buf[BUF_SIZE];
+    const char *at_name;
+    int         at = ResolveAt(dir, name, buf, &at_name);
+    int         fd = openat(at, at_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) { return 0; }
+
+    if (dir) {
+        out->path = MakePath(arena, dir->path, name, 0);
+    } else {
+        char full[PATH_MAX];
+        if (!realpath(name, full)) { 
+            close(fd);
+            return 0; 
+        }
+        out->path = ArenaCloneCStr(arena, full);
+    }
+
+    out->fd = fd;
+    return 1;
+}
+
+void CloseDirHandle(DirHandle *dir) {
+    if (dir->fd >= 0) { close(dir->fd); }
+    dir->fd = -1;
+}
+
+// NOTE: fdopendir takes over the fd it is given, so the iterator gets
+// its own, and the handle stays usable.
+void BeginDirIterAt(DirIter *iter, DirHandle *dir) {
+    char        buf[BUF_SIZE];
+    const char *at_name;
+    int         at = ResolveAt(dir, ".", buf, &at_name);
+
+    memset(iter, 0, sizeof(*iter));
+    int fd = openat(at, at_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) { return; }
+
+    iter->dirp = fdopendir(fd);
+    if (!iter->dirp) { close(fd); }
+}
+
 int MakeDirectory(const char *path) {
-    return 0 == mkdir(path, 0777);
+    return MakeDirectoryAt(0, path);
+}
+
+int MakeDirectoryAt(DirHandle *dir, const char *name) {
+    char        buf[BUF_SIZE];
+    const char *at_name;
+    int         at = ResolveAt(dir, name, buf, &at_name);
+    return 0 == mkdirat(at, at_name, 0777);
 }
 
 int ReadEntireFile(const char *file_path, Arena *arena, Slice *out) {
-    FILE *file = fopen(file_path, "rb");
-    if (!file) { return 0; }
+    return ReadEntireFileAt(0, file_path, arena, out);
+}
 
-    int start = ftell(file);
-    if (start < 0) { goto failure; }
-    if (fseek(file, 0, SEEK_END) < 0) { goto failure; }
-    int end = ftell(file);
-    if (end < 0) { goto failure; }
-    if (fseek(file, 0, SEEK_SET) < 0) { goto failure; }
-    memsize size  = (memsize)(end - start);
+int ReadEntireFileAt(DirHandle *dir, const char *name, Arena *arena, Slice *out) {
+    int mapped = 0;
+    return ReadOrMapEntireFileAt(dir, name, UINT64_MAX, arena, out, &mapped);
+}
 
-    char *buffer = ArenaPushMany(arena, char, size);
+// NOTE: MADV_SEQUENTIAL, since files are gone through front to back.
+// The kernel reads further ahead, and can drop pages that were passed over.
+static int MapOpenFile(int file, uint64_t size, Slice *out) {
+    if (size == 0 || size > (memsize)-1) { return 0; }
 
-    memsize amt_read = fread(buffer, sizeof(char), size, file);
+    void *data = mmap(0, (size_t)size, PROT_READ, MAP_PRIVATE, file, 0);
+    if (data == MAP_FAILED) { return 0; }
 
-    if (amt_read != size) {
-        goto failure;
+    madvise(data, (size_t)size, MADV_SEQUENTIAL);
+    *out = MakeSlice((char*)data, (memsize)size);
+    return 1;
+}
+
+static int ReadOpenFile(int file, uint64_t file_size, Arena *arena, Slice *out) {
+    if (file_size > (memsize)-1) { return 0; }
+
+    memsize  size   = (memsize)file_size;
+    ArenaPos pos    = ArenaSave(arena);
+    char    *buffer = ArenaPushMany(arena, char, size);
+
+    // read can come back short, so it goes until it has everything
+    for (memsize done = 0; done < size;) {
+        ssize_t amt_read = read(file, buffer + done, size - done);
+        if (amt_read < 0 && errno == EINTR) { continue; }
+        if (amt_read <= 0) {
+            ArenaRestore(arena, pos);
+            return 0; 
+        }
+
+        done += (memsize)amt_read;
     }
 
-    fclose(file);
     *out = MakeSlice(buffer, size);
     return 1;
+}
+
+int ReadOrMapEntireFileAt(DirHandle *dir, const char *name, uint64_t map_above,
+                          Arena *arena, Slice *out, int *mapped) {
+    char        buf[BUF_SIZE];
+    const char *at_name;
+    int         at   = ResolveAt(dir, name, buf, &at_name);
+    int         file = openat(at, at_name, O_RDONLY | O_CLOEXEC);
+    *mapped = 0;
+    if (file < 0) { return 0; }
+
+    // NOTE: fstat instead of ftell, since ftell returns a long, which
+    // tops out at 2 GB on some platforms
+    struct stat st;
+    if (fstat(file, &st) != 0) { 
+        close(file);
+        return 0; 
+    }
+
+    uint64_t size = (uint64_t)st.st_size;
+    *mapped = size > map_above && MapOpenFile(file, size, out);
+    int ok  = *mapped || ReadOpenFile(file, size, arena, out);
+    close(file);
+    return ok;
+}
+
+// NOTE: The parts are handed to writev, a batch at a time, instead of
+// going through a stdio buffer, so they are written straight from wherever
+// they are (see HTMLSpans). writev can stop partway through, so this keeps
+// track of how far into the parts it has got.
+#define WRITE_PARTS_BATCH 64
+
+int WriteEntireFileParts(Slice *parts, int parts_count, const char *file_path) {
+    return WriteEntireFilePartsAt(0, file_path, parts, parts_count);
+}
+
+int WriteEntireFilePartsAt(DirHandle *dir, const char *name, Slice *parts, int parts_count) {
+    char        buf[BUF_SIZE];
+    const char *at_name;
+    int         at   = ResolveAt(dir, name, buf, &at_name);
+    int         file = openat(at, at_name, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (file < 0) { 
+        return 0; 
+    }
+
+    struct iovec iov[WRITE_PARTS_BATCH];
+    int     next   = 0; // First part that isn't all written
+    memsize offset = 0; // How much of parts[next] is written
+
+    while (next < parts_count) {
+        int     count = 0;
+        memsize total = 0;
+        for (int i = next; i < parts_count && count < WRITE_PARTS_BATCH; i++) {
+            memsize skip = i == next ? offset : 0;
+            iov[count].iov_base = parts[i].begin + skip;
+            iov[count].iov_len  = SliceLength(parts[i]) - skip;
+            total += iov[count].iov_len;
+            count++;
+        }
+
+        ssize_t written = writev(file, iov, count);
+        if (written < 0 && errno == EINTR) { continue; }
+        if (written < 0 || (written == 0 && total)) {
+            close(file);
+            return 0; 
+        }
+
+        memsize left = (memsize)written;
+        while (next < parts_count && left >= SliceLength(parts[next]) - offset) {
+            left  -= SliceLength(parts[next]) - offset;
+            offset = 0;
+            next++;
+        }
+        offset += left;
+    }
+
+    return close(file) == 0;
+}
+
+int GetFileInfo(const char *file_path, FileInfo *out) {
+    return GetFileInfoAt(0, file_path, out);
+}
+
+static struct timespec StatModified(struct stat *st) {
+#ifdef __APPLE__
+    return st->st_mtimespec;
+#else
+    return st->st_mtim;
+#endif
+}
+
+static struct timespec StatAccessed(struct stat *st) {
+#ifdef __APPLE__
+    return st->st_atimespec;
+#else
+    return st->st_atim;
+#endif
+}
+
+int GetFileInfoAt(DirHandle *dir, const char *name, FileInfo *out) {
+    char        buf[BUF_SIZE];
+    const char *at_name;
+    int         at = ResolveAt(dir, name, buf, &at_name);
+
+    struct stat st;
+    if (fstatat(at, at_name, &st, 0) != 0) { return 0; }
+
+    struct timespec mtime = StatModified(&st);
+    out->size     = (uint64_t)st.st_size;
+    out->modified = (int64_t)mtime.tv_sec * 1000000000 + mtime.tv_nsec;
+    return 1;
+}
+
+FILE *OpenFileAt(DirHandle *dir, const char *name, const char *mode) {
+    int flags = 0;
+    switch (mode[0]) {
+    case 'r': flags = O_RDONLY;                      break;
+    case 'w': flags = O_WRONLY | O_CREAT | O_TRUNC;  break;
+    case 'a': flags = O_WRONLY | O_CREAT | O_APPEND; break;
+    default:  return 0;
+    }
+
+    if (strchr(mode, '+')) { flags = (flags & ~O_ACCMODE) | O_RDWR; }
+
+    char        buf[BUF_SIZE];
+    const char *at_name;
+    int         at = ResolveAt(dir, name, buf, &at_name);
+    int         fd = openat(at, at_name, flags | O_CLOEXEC, 0666);
+    if (fd < 0) { return 0; }
+
+    FILE *file = fdopen(fd, mode);
+    if (!file) { close(fd); }
+    return file;
+}
+
+int RemoveFileAt(DirHandle *dir, const char *name) {
+    char        buf[BUF_SIZE];
+    const char *at_name;
+    int         at = ResolveAt(dir, name, buf, &at_name);
+    return unlinkat(at, at_name, 0) == 0;
+}
+
+// NOTE: The link is made under a temporary name, and then renamed over
+// link_name, so link_name is never missing, even for a moment
+int LinkFileAt(DirHandle *dir, const char *name, const char *link_name) {
+    char        buf[BUF_SIZE], link_buf[BUF_SIZE], temp_buf[BUF_SIZE], temp_name[256];
+    const char *at_name;
+    const char *at_link;
+    const char *at_temp;
+    if (snprintf(temp_name, sizeof(temp_name), ".%s.link", link_name) >= (int)sizeof(temp_name)) {
+        return 0; 
+    }
+    int at = ResolveAt(dir, name, buf, &at_name);
+    ResolveAt(dir, link_name, link_buf, &at_link);
+    ResolveAt(dir, temp_name, temp_buf, &at_temp);
+
+    // Still linked from last time
+    struct stat file_st;
+    struct stat link_st;
+    if (fstatat(at, at_name, &file_st, 0) != 0) { return 0; }
+    if (fstatat(at, at_link, &link_st, 0) == 0 && 
+        file_st.st_dev == link_st.st_dev && file_st.st_ino == link_st.st_ino) {
+        return 1; 
+    }
+
+    unlinkat(at, at_temp, 0);
+    if (linkat(at, at_name, at, at_temp, 0) != 0) { return 0; }
+    if (renameat(at, at_temp, at, at_link) != 0) {
+        unlinkat(at, at_temp, 0);
+        return 0; 
+    }
+
+    return 1;
+}
+
+int RenameFileAt(DirHandle *dir, const char *name, const char *new_name) {
+    char        buf[BUF_SIZE], new_buf[BUF_SIZE];
+    const char *at_name;
+    const char *at_new;
+    int         at    = ResolveAt(dir, name, buf, &at_name);
+    int         at_to = ResolveAt(dir, new_name, new_buf, &at_new);
+    return renameat(at, at_name, at_to, at_new) == 0;
+}
+
+int MapEntireFile(const char *file_path, Slice *out) {
+    int fd = open(file_path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) { return 0; }
+
+    struct stat st;
+    int ok = fstat(fd, &st) == 0 && MapOpenFile(fd, (uint64_t)st.st_size, out);
+    close(fd);
+    return ok;
+}
+
+void UnmapEntireFile(Slice data) {
+    munmap(data.begin, SliceLength(data));
+}
+
+#ifdef PATHS_IO_URING
+// NOTE: No liburing, just the raw system calls. Each file is a chain of
+// three requests: open it into a slot in the ring's own table of files, read
+// or write it through the slot, and close the slot. The chains for a whole
+// batch go to the kernel with one io_uring_enter, which also waits for them.
+//
+// Anything that doesn't go exactly as planned (ex: the file changed size, or
+// the kernel is too old for opening into slots) is just done again one file
+// at a time, so this never gives a different answer than that would.
+#define FILE_BATCH_RING_SIZE 256   // At least 3 * FILE_BATCH_MAX_ITEMS
+#define FILE_BATCH_MAX_READ  (1 << 30)
+
+struct FileBatch {
+    int                  ring;      // -1 if io_uring can't be used
+    unsigned            *sq_tail;
+    unsigned            *sq_mask;
+    unsigned            *sq_array;
+    struct io_uring_sqe *sqes;
+    unsigned            *cq_head;
+    unsigned            *cq_tail;
+    unsigned            *cq_mask;
+    struct io_uring_cqe *cqes;
+
+    void                *sq_map;
+    size_t               sq_map_size;
+    void                *cq_map;    // Same as sq_map on newer kernels
+    size_t               cq_map_size;
+    size_t               sqes_size;
+};
+
+static void CloseFileBatchRing(FileBatch *b) {
+    if (b->sqes && (void*)b->sqes != MAP_FAILED)     { munmap(b->sqes, b->sqes_size); }
+    if (b->cq_map && b->cq_map != MAP_FAILED && 
+        b->cq_map != b->sq_map)                      { munmap(b->cq_map, b->cq_map_size); }
+    if (b->sq_map && b->sq_map != MAP_FAILED)        { munmap(b->sq_map, b->sq_map_size); }
+    if (b->ring >= 0)                                { close(b->ring); }
+
+    memset(b, 0, sizeof(*b));
+    b->ring = -1;
+}
+
+FileBatch *AllocFileBatch(void) {
+    FileBatch *b = (FileBatch*)calloc(1, sizeof(FileBatch));
+    b->ring = -1;
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    b->ring = (int)syscall(__NR_io_uring_setup, FILE_BATCH_RING_SIZE, &params);
+    if (b->ring < 0) { 
+        b->ring = -1;
+        return b; 
+    }
+
+    b->sq_map_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    b->cq_map_size = params.cq_off.cqes  + params.cq_entries * sizeof(struct io_uring_cqe);
+    b->sqes_size   = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    int single_map = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_map && b->cq_map_size > b->sq_map_size) { b->sq_map_size = b->cq_map_size; }
+
+    b->sq_map = mmap(0, b->sq_map_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                     b->ring, IORING_OFF_SQ_RING);
+    if (b->sq_map == MAP_FAILED) { goto failure; }
+
+    b->cq_map = single_map ? b->sq_map 
+                           : mmap(0, b->cq_map_size, PROT_READ | PROT_WRITE, 
+                                  MAP_SHARED | MAP_POPULATE, b->ring, IORING_OFF_CQ_RING);
+    if (b->cq_map == MAP_FAILED) { goto failure; }
+
+    b->sqes = (struct io_uring_sqe*)mmap(0, b->sqes_size, PROT_READ | PROT_WRITE, 
+                                         MAP_SHARED | MAP_POPULATE, b->ring, IORING_OFF_SQES);
+    if ((void*)b->sqes == MAP_FAILED) { goto failure; }
+
+    char *sq = (char*)b->sq_map;
+    char *cq = (char*)b->cq_map;
+    b->sq_tail  = (unsigned*)(sq + params.sq_off.tail);
+    b->sq_mask  = (unsigned*)(sq + params.sq_off.ring_mask);
+    b->sq_array = (unsigned*)(sq + params.sq_off.array);
+    b->cq_head  = (unsigned*)(cq + params.cq_off.head);
+    b->cq_tail  = (unsigned*)(cq + params.cq_off.tail);
+    b->cq_mask  = (unsigned*)(cq + params.cq_off.ring_mask);
+    b->cqes     = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    // Empty slots for the files to be opened into
+    int slots[FILE_BATCH_MAX_ITEMS];
+    for (int i = 0; i < FILE_BATCH_MAX_ITEMS; i++) { slots[i] = -1; }
+    if (syscall(__NR_io_uring_register, b->ring, IORING_REGISTER_FILES, 
+                slots, FILE_BATCH_MAX_ITEMS) < 0) { 
+        goto failure;
+    }
+
+    return b;
 
 failure:
-    fclose(file);
-    return 0;
+    CloseFileBatchRing(b);
+    return b;
 }
 
-int WriteEntireFile(Slice data, const char *file_path) {
-    FILE *file = fopen(file_path, "wb");
-    if (!file) { 
+void FreeFileBatch(FileBatch *b) {
+    CloseFileBatchRing(b);
+    free(b);
+}
+
+// Sets up the next request after *tail. Nothing is handed to the kernel
+// until RunFileBatch.
+static struct io_uring_sqe *FileBatchRequest(FileBatch *b, unsigned *tail, int opcode, 
+                                             unsigned flags, int result_index) {
+    unsigned             index = *tail & *b->sq_mask;
+    struct io_uring_sqe *sqe   = b->sqes + index;
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode       = (unsigned char)opcode;
+    sqe->flags        = (unsigned char)flags;
+    sqe->user_data    = (uint64_t)result_index;
+    b->sq_array[index] = index;
+    (*tail)++;
+    return sqe;
+}
+
+// Hands the kernel every request up to tail, and waits for all `count` of
+// them to finish. Each one's result goes in results[result_index]. Anything
+// that doesn't finish keeps whatever the caller put there first.
+static void RunFileBatch(FileBatch *b, unsigned tail, int count, int *results) {
+    __atomic_store_n(b->sq_tail, tail, __ATOMIC_RELEASE);
+
+    int submitted = 0;
+    int done      = 0;
+    while (done < count) {
+        long entered = syscall(__NR_io_uring_enter, b->ring, count - submitted, 
+                               count - done, IORING_ENTER_GETEVENTS, 0, 0);
+        if (entered < 0) {
+            if (errno == EINTR) { continue; }
+
+            // NOTE: Shouldn't happen. The ring is given up on, and
+            // everything that didn't finish gets done one at a time.
+            CloseFileBatchRing(b);
+            return;
+        }
+
+        submitted += (int)entered;
+
+        unsigned head = *b->cq_head;
+        unsigned end  = __atomic_load_n(b->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != end; head++, done++) {
+            struct io_uring_cqe *cqe = b->cqes + (head & *b->cq_mask);
+            results[cqe->user_data] = cqe->res;
+        }
+        __atomic_store_n(b->cq_head, head, __ATOMIC_RELEASE);
+    }
+}
+
+// Queues up the chain for item i: open name inside of dir into slot i, do
+// the request that is returned (for the caller to fill in) through the slot,
+// then close the slot. The request only happens if the open worked, and the
+// close happens either way. The results go in results[i * 3 + 0, 1, 2].
+static struct io_uring_sqe *FileBatchChain(FileBatch *b, unsigned *tail, 
+                                           DirHandle *dir, const char *name, 
+                                           int open_flags, int opcode, int i) {
+    struct io_uring_sqe *open = FileBatchRequest(b, tail, IORING_OP_OPENAT, 
+                                                 IOSQE_IO_LINK, i * 3);
+    open->fd         = dir->fd;
+    open->addr       = (uint64_t)(uintptr_t)name;
+    open->open_flags = (unsigned)open_flags;
+    open->len        = 0666;
+    open->file_index = (unsigned)i + 1;
+
+    struct io_uring_sqe *request = FileBatchRequest(b, tail, opcode, 
+                                                    IOSQE_FIXED_FILE | IOSQE_IO_HARDLINK, 
+                                                    i * 3 + 1);
+    request->fd = i;
+
+    struct io_uring_sqe *close = FileBatchRequest(b, tail, IORING_OP_CLOSE, 0, i * 3 + 2);
+    close->file_index = (unsigned)i + 1;
+    return request;
+}
+
+// Kernels from before opening into slots say EINVAL. Those get the one at a
+// time path from then on.
+static void CheckFileBatchOpens(FileBatch *b, int *results, int count) {
+    for (int i = 0; i < count; i++) {
+        if (results[i * 3] == -EINVAL) { 
+            CloseFileBatchRing(b);
+            return;
+        }
+    }
+}
+
+void ReadEntireFilesAt(FileBatch *b, DirHandle *dir, 
+                       FileBatchItem *items, int count, Arena *arena) {
+    if (b->ring < 0 || dir->fd < 0 || count > FILE_BATCH_MAX_ITEMS) {
+        ReadFilesOneByOne(dir, items, count, arena);
+        return;
+    }
+
+    int      results[FILE_BATCH_MAX_ITEMS * 3];
+    unsigned tail     = *b->sq_tail;
+    int      requests = 0;
+    for (int i = 0; i < count * 3; i++) { results[i] = -ECANCELED; }
+
+    for (int i = 0; i < count; i++) {
+        FileBatchItem *item = items + i;
+        item->data = NullSlice();
+        if (item->size > FILE_BATCH_MAX_READ) { continue; }
+
+        memsize size = (memsize)item->size;
+        item->data   = MakeSlice(ArenaPushMany(arena, char, size), size);
+
+        struct io_uring_sqe *read = FileBatchChain(b, &tail, dir, item->name, 
+                                                   O_RDONLY, IORING_OP_READ, i);
+        read->addr = (uint64_t)(uintptr_t)item->data.begin;
+        read->len  = (unsigned)size;
+        requests  += 3;
+    }
+
+    RunFileBatch(b, tail, requests, results);
+    CheckFileBatchOpens(b, results, count);
+
+    // A file that changed size since it was looked at is read again
+    for (int i = 0; i < count; i++) {
+        FileBatchItem *item = items + i;
+        item->ok = results[i * 3] >= 0 && results[i * 3 + 1] == (int)SliceLength(item->data);
+        if (!item->ok) { ReadFilesOneByOne(dir, item, 1, arena); }
+    }
+}
+
+#define FILE_BATCH_MAX_PARTS 1024 // Most iovecs writev takes
+
+// NOTE: Files that are already there at the right size are read back
+// in one batch first, and the ones that come out the same are left alone.
+// The rest are written under their TempFileName in a second batch, and then
+// renamed over the old ones.
+static int FileBatchUnchanged(FileBatch *b, DirHandle *dir, FileBatchItem *items, 
+                              memsize *totals, int count, int *unchanged, Arena *arena) {
+    FileBatchItem existing[FILE_BATCH_MAX_ITEMS];
+    int           existing_of[FILE_BATCH_MAX_ITEMS];
+    int           existing_count = 0;
+    for (int i = 0; i < count; i++) {
+        FileInfo info = {0};
+        unchanged[i]  = 0;
+        if (!GetFileInfoAt(dir, items[i].name, &info) || info.size != totals[i]) { continue; }
+
+        existing[existing_count]      = (FileBatchItem){0};
+        existing[existing_count].name = items[i].name;
+        existing[existing_count].size = info.size;
+        existing_of[existing_count++] = i;
+    }
+
+    if (existing_count) { ReadEntireFilesAt(b, dir, existing, existing_count, arena); }
+
+    int left = count;
+    for (int i = 0; i < existing_count; i++) {
+        FileBatchItem *item = items + existing_of[i];
+        if (existing[i].ok && SliceHasParts(existing[i].data, item->parts, item->parts_count)) {
+            unchanged[existing_of[i]] = 1;
+            item->ok      = 1;
+            item->changed = 0;
+            left--;
+        }
+    }
+
+    return left;
+}
+
+void WriteEntireFilesAt(FileBatch *b, DirHandle *dir, 
+                        FileBatchItem *items, int count, Arena *arena) {
+    if (b->ring < 0 || dir->fd < 0 || count > FILE_BATCH_MAX_ITEMS) {
+        WriteFilesOneByOne(dir, items, count);
+        return;
+    }
+
+    ArenaPos    pos = ArenaSave(arena);
+    int         results  [FILE_BATCH_MAX_ITEMS * 3];
+    memsize     totals   [FILE_BATCH_MAX_ITEMS];
+    int         unchanged[FILE_BATCH_MAX_ITEMS];
+    const char *temps    [FILE_BATCH_MAX_ITEMS];
+    int         requests = 0;
+    for (int i = 0; i < count * 3; i++) { results[i] = -ECANCELED; }
+    for (int i = 0; i < count; i++)     { totals[i]  = PartsLength(items[i].parts, items[i].parts_count); }
+
+    if (!FileBatchUnchanged(b, dir, items, totals, count, unchanged, arena)) {
+        ArenaRestore(arena, pos);
+        return;
+    }
+
+    // Reading back can find out that the ring doesn't work
+    if (b->ring < 0) { 
+        for (int i = 0; i < count; i++) {
+            if (!unchanged[i]) { WriteFilesOneByOne(dir, items + i, 1); }
+        }
+
+        ArenaRestore(arena, pos);
+        return;
+    }
+
+    unsigned tail = *b->sq_tail;
+    for (int i = 0; i < count; i++) {
+        FileBatchItem *item = items + i;
+        temps[i] = 0;
+
+        // NOTE: Past 2 GB the result can't be compared, so that goes
+        // the slow way
+        if (unchanged[i] || item->parts_count > FILE_BATCH_MAX_PARTS || totals[i] > INT_MAX) {
+            continue; 
+        }
+
+        char *temp = ArenaPushMany(arena, char, BUF_SIZE);
+        if (!TempFileName(item->name, temp, BUF_SIZE)) { continue; }
+        temps[i] = temp;
+
+        ArenaAlign(arena, sizeof(void*));
+        struct iovec *iov = ArenaPushMany(arena, struct iovec, item->parts_count);
+        for (int j = 0; j < item->parts_count; j++) {
+            iov[j].iov_base = item->parts[j].begin;
+            iov[j].iov_len  = SliceLength(item->parts[j]);
+        }
+
+        struct io_uring_sqe *write = FileBatchChain(b, &tail, dir, temp, 
+                                                    O_WRONLY | O_CREAT | O_TRUNC, 
+                                                    IORING_OP_WRITEV, i);
+        write->addr = (uint64_t)(uintptr_t)iov;
+        write->len  = (unsigned)item->parts_count;
+        requests   += 3;
+    }
+
+    RunFileBatch(b, tail, requests, results);
+    CheckFileBatchOpens(b, results, count);
+
+    // Anything that didn't all get written is written again the normal way
+    for (int i = 0; i < count; i++) {
+        FileBatchItem *item = items + i;
+        if (unchanged[i]) { continue; }
+
+        item->changed = 1;
+        item->ok      = temps[i]               &&
+                        results[i * 3]     >= 0 && 
+                        results[i * 3 + 1] == (int)totals[i] &&
+                        results[i * 3 + 2] >= 0 &&
+                        RenameFileAt(dir, temps[i], item->name);
+        if (!item->ok) { 
+            if (temps[i]) { RemoveFileAt(dir, temps[i]); }
+            WriteFilesOneByOne(dir, item, 1); 
+        }
+    }
+
+    ArenaRestore(arena, pos);
+}
+
+#else // No io_uring
+
+struct FileBatch {
+    int unused;
+};
+
+FileBatch *AllocFileBatch(void) {
+    return (FileBatch*)calloc(1, sizeof(FileBatch));
+}
+
+void FreeFileBatch(FileBatch *batch) {
+    free(batch);
+}
+
+void ReadEntireFilesAt(FileBatch *batch, DirHandle *dir, 
+                       FileBatchItem *items, int count, Arena *arena) {
+    ReadFilesOneByOne(dir, items, count, arena);
+}
+
+void WriteEntireFilesAt(FileBatch *batch, DirHandle *dir, 
+                        FileBatchItem *items, int count, Arena *arena) {
+    WriteFilesOneByOne(dir, items, count);
+}
+
+#endif
+
+#define COPY_BUFFER_SIZE (1024 * 1024)
+
+// NOTE: A copy is given the modified time of its source, so a file
+// whose copy already has the same size and modified time is left alone. That
+// is what makes copying a big static directory cheap when little changed.
+static int IsSameCopy(struct stat *src, struct stat *dst) {
+    struct timespec src_time = StatModified(src);
+    struct timespec dst_time = StatModified(dst);
+    return S_ISREG(dst->st_mode) && 
+           src->st_size      == dst->st_size && 
+           src_time.tv_sec   == dst_time.tv_sec && 
+           src_time.tv_nsec  == dst_time.tv_nsec;
+}
+
+// Copies size bytes from src to dst, the cheapest way the file system
+// allows. A reflink (FICLONE) shares the source's data, so nothing is copied
+// at all. copy_file_range copies inside the kernel. Whatever those can't do
+// is read and written through the buffer.
+static int CopyFileData(int src, int dst, uint64_t size, char *buffer) {
+#ifdef FICLONE
+    if (size && ioctl(dst, FICLONE, src) == 0) { return 1; }
+#endif
+
+    uint64_t done = 0;
+
+#ifdef SYS_copy_file_range
+    // NOTE: No offsets are passed, so both files' offsets move along,
+    // and the loop below can pick up wherever this stopped
+    while (done < size) {
+        uint64_t want   = size - done;
+        if (want > (1 << 30)) { want = 1 << 30; }
+        long     copied = syscall(SYS_copy_file_range, src, (void*)0, dst, (void*)0, 
+                                  (size_t)want, 0u);
+        if (copied < 0 && errno == EINTR) { continue; }
+        if (copied <= 0) { break; }
+        done += (uint64_t)copied;
+    }
+#endif
+
+    while (done < size) {
+        uint64_t want = size - done;
+        if (want > COPY_BUFFER_SIZE) { want = COPY_BUFFER_SIZE; }
+
+        ssize_t amt_read = read(src, buffer, (size_t)want);
+        if (amt_read < 0 && errno == EINTR) { continue; }
+        if (amt_read <= 0) { return 0; }
+
+        for (ssize_t written = 0; written < amt_read;) {
+            ssize_t amt = write(dst, buffer + written, (size_t)(amt_read - written));
+            if (amt < 0 && errno == EINTR) { continue; }
+            if (amt <= 0) { return 0; }
+            written += amt;
+        }
+
+        done += (uint64_t)amt_read;
+    }
+
+    return 1;
+}
+
+// Copies file src to dst, unless dst is already a copy of it (see
+// IsSameCopy). Links are followed. Directories are skipped, so a link to a
+// directory can't send the copy around in circles.
+static int CopyFileIfChanged(const char *src_path, const char *dst_path, char *buffer) {
+    int src = open(src_path, O_RDONLY | O_CLOEXEC);
+    if (src < 0) { return 0; }
+
+    struct stat src_st;
+    struct stat dst_st;
+    if (fstat(src, &src_st) != 0) {
+        close(src);
         return 0; 
     }
 
-    memsize size = SliceLength(data);
-    memsize amt_written = fwrite(data.begin, sizeof(char), size, file);
+    if (S_ISDIR(src_st.st_mode) || 
+        (stat(dst_path, &dst_st) == 0 && IsSameCopy(&src_st, &dst_st))) {
+        close(src);
+        return 1; 
+    }
 
-    if (amt_written != size) {
-        printf("FUCK\n");
-        fclose(file);
+    int dst = open(dst_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, src_st.st_mode & 0777);
+    if (dst < 0) {
+        close(src);
         return 0;
     }
 
-    fclose(file);
-    return 1;
+    int ok = CopyFileData(src, dst, (uint64_t)src_st.st_size, buffer);
+    if (ok) {
+        struct timespec times[2] = {StatAccessed(&src_st), StatModified(&src_st)};
+        ok = futimens(dst, times) == 0;
+    }
+
+    ok = close(dst) == 0 && ok;
+    close(src);
+    return ok;
 }
 
-// meh
-void CopyDirectory(const char *src_path, const char *src_name,
-                   const char *dst_path, const char *dst_name, 
-                   Arena *arena) {
-    Arena a = *arena;
-    const char *full_src = MakePath(arena, src_path, src_name, 0);
-    const char *full_dst = MakePath(arena, dst_path, dst_name, 0);
-    const char * cmd = ArenaPrintfCStr(arena,
-                           "cp -R -T \"%s\" \"%s\"",
-                           full_src,
-                           full_dst);
-    system(cmd);
+// A file or directory waiting to be copied
+typedef struct CopyItem {
+    struct CopyItem *next;
+    const char      *src;
+    const char      *dst;
+    int              is_dir;
+} CopyItem;
+
+// Copying a directory is split up between threads a file at a time. Listing
+// a directory puts what is in it on the pending list, for whichever thread
+// is free first.
+typedef struct DirCopy {
+    Monitor  *monitor;  // pending, busy and failed are used under its lock
+    CopyItem *pending;
+    int       busy;
+    int       failed;
+    Arena    *arenas;
+} DirCopy;
+
+// Makes directory item->dst, and gives back what is in item->src, to be
+// copied into it
+static CopyItem *ListCopyItems(CopyItem *item, Arena *arena, int *ok) {
+    *ok = mkdir(item->dst, 0777) == 0 || errno == EEXIST;
+    if (!*ok) { return 0; }
+
+    CopyItem  *found = 0;
+    DirIter   *iter  = ArenaPushDirIter(arena);
+    BeginDirIter(iter, item->src);
+    while (GetNextFile(iter)) {
+        const char *name = GetFileName(iter);
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) { continue; }
+
+        ArenaAlign(arena, sizeof(void*));
+        CopyItem *sub = ArenaPush(arena, CopyItem);
+        sub->is_dir   = IsDirectory(iter);
+        sub->src      = MakePath(arena, item->src, name, 0);
+        sub->dst      = MakePath(arena, item->dst, name, 0);
+        sub->next     = found;
+        found         = sub;
+    }
+
+    // NOTE: GetNextFile can't tell the end of the directory apart from
+    // not being able to open it
+    *ok = iter->dirp != 0;
+    EndDirIter(iter);
+    return found;
 }
 
-void CopyFileToDir(const char *src_path, const char *src_name,
-              const char *dst_path, Arena *arena) {
-    Arena a = *arena;
-    const char *full_src = MakePath(arena, src_path, src_name, 0);
-    const char *full_dst = MakePath(arena, dst_path, src_name, 0);
-    const char * cmd = ArenaPrintfCStr(arena,
-                           "cp \"%s\" \"%s\"",
-                           full_src,
-                           full_dst);
-    system(cmd);
+static void DirCopyThread(void *data, int index) {
+    DirCopy *copy   = (DirCopy*)data;
+    Arena   *arena  = copy->arenas + index;
+    char    *buffer = ArenaPushMany(arena, char, COPY_BUFFER_SIZE);
+
+    MonitorLock(copy->monitor);
+    for (;;) {
+        if (!copy->pending) {
+            if (!copy->busy) { break; }
+            MonitorWait(copy->monitor);
+            continue;
+        }
+
+        CopyItem *item = copy->pending;
+        copy->pending  = item->next;
+        copy->busy++;
+        MonitorUnlock(copy->monitor);
+
+        int       ok    = 1;
+        CopyItem *found = item->is_dir ? ListCopyItems(item, arena, &ok) 
+                                       : 0;
+        if (!item->is_dir) { ok = CopyFileIfChanged(item->src, item->dst, buffer); }
+
+        MonitorLock(copy->monitor);
+        while (found) {
+            CopyItem *next = found->next;
+            found->next    = copy->pending;
+            copy->pending  = found;
+            found          = next;
+        }
+
+        if (!ok) { copy->failed++; }
+        copy->busy--;
+        MonitorWakeAll(copy->monitor);
+    }
+
+    MonitorUnlock(copy->monitor);
+}
+
+int CopyDirectory(const char *src_path, const char *src_name,
+                  const char *dst_path, const char *dst_name, 
+                  int threads, Arena *arena) {
+    ArenaPos pos  = ArenaSave(arena);
+    CopyItem root = {
+        .src    = MakePath(arena, src_path, src_name, 0),
+        .dst    = MakePath(arena, dst_path, dst_name, 0),
+        .is_dir = 1,
+    };
+
+    struct stat st;
+    if (stat(root.src, &st) != 0 && errno == ENOENT) {
+        ArenaRestore(arena, pos);
+        return 1; 
+    }
+
+    if (threads > MAX_THREADS) { threads = MAX_THREADS; }
+    if (threads < 1)           { threads = 1; }
+
+    Arena   arenas[MAX_THREADS];
+    DirCopy copy = {0};
+    copy.monitor = AllocMonitor();
+    copy.pending = &root;
+    copy.arenas  = arenas;
+    for (int i = 0; i < threads; i++) { arenas[i] = AllocArena(ARENA_SIZE); }
+
+    RunParallel(DirCopyThread, &copy, threads);
+
+    for (int i = 0; i < threads; i++) { FreeArena(&arenas[i]); }
+    FreeMonitor(copy.monitor);
+    ArenaRestore(arena, pos);
+    return !copy.failed;
+}
+
+int CopyFileToDir(const char *src_path, const char *src_name,
+                  const char *dst_path, Arena *arena) {
+    ArenaPos    pos = ArenaSave(arena);
+    const char *src = MakePath(arena, src_path, src_name, 0);
+    const char *dst = MakePath(arena, dst_path, src_name, 0);
+
+    struct stat st;
+    int ok = (stat(src, &st) != 0 && errno == ENOENT) ||
+             CopyFileIfChanged(src, dst, RawArenaPush(arena, COPY_BUFFER_SIZE));
+    ArenaRestore(arena, pos);
+    return ok;
 }
 
 #endif
 
+DirHandle PathDirHandle(const char *path) {
+    return (DirHandle) {path, -1};
+}
+
 DirIter *ArenaPushDirIter(Arena *a) {
     return ArenaPush(a, DirIter);
 }
 
+int WriteEntireFile(Slice data, const char *file_path) {
+    return WriteEntireFileParts(&data, 1, file_path);
+}
@@ -4,6 +4,7 @@
 #include "common.h"
 #include "arena.h"
 #include "slice.h"
+#include <stdio.h>
 
 // IMPORTANT(eric): The varargs for this function are null terminated!
 // EX: MakePath(arena, "foo", "bar", 0);
@@ -83,17 +84,148 @@ int ReadEntireFile(const char *file_path, Arena *arena, Slice *out);
 // Returns false on failure
 int WriteEntireFile(Slice data, const char *file_path);
 
+// Write whole file from several slices, one after the other.
+// Returns false on failure
+int WriteEntireFileParts(Slice *parts, int parts_count, const char *file_path);
+
+typedef struct FileInfo {
+    uint64_t size;
+    int64_t  modified; // Last write time, in platform specific ticks
+} FileInfo;
+
+// Gets the size and last write time of a file
+// Returns false on failure
+int GetFileInfo(const char *file_path, FileInfo *out);
+
+// A DirHandle is a directory that things can be opened inside of, without
+// going through the current directory, which is shared by every thread.
+//
+// On POSIX, the directory is held open (fd) and names are looked up relative
+// to it (see openat), so its path isn't walked again for every file. A
+// handle can also just go by its path, with fd -1 (see PathDirHandle). That
+// is all there is on Windows.
+typedef struct DirHandle {
+    const char *path; // Absolute
+    int         fd;
+} DirHandle;
+
+// Opens directory "name" inside of dir, or "name" itself (absolute, or
+// relative to the current directory) if dir is null. The handle's path is
+// made in the arena.
+// Returns false on failure
+int OpenDirHandle(DirHandle *dir, const char *name, Arena *arena, DirHandle *out);
+
+// A handle that goes by an absolute path, and holds nothing open
+DirHandle PathDirHandle(const char *path);
+
+// Closes whatever the handle holds open. It still works afterwards, by path.
+void CloseDirHandle(DirHandle *dir);
+
+// The same as the functions above, for "name" inside of dir
+void BeginDirIterAt(DirIter *iter, DirHandle *dir);
+int  MakeDirectoryAt(DirHandle *dir, const char *name);
+int  ReadEntireFileAt(DirHandle *dir, const char *name, Arena *arena, Slice *out);
+int  WriteEntireFilePartsAt(DirHandle *dir, const char *name, Slice *parts, int parts_count);
+int  GetFileInfoAt(DirHandle *dir, const char *name, FileInfo *out);
+
+// Like ReadEntireFileAt, except that files bigger than map_above bytes are
+// mapped into memory (see MapEntireFile), and *out points straight at the
+// mapping, with no copy in the arena. *mapped says which it was. A mapped
+// file has to be given back with UnmapEntireFile once nothing points into
+// it, and it must not be cut short while it is mapped.
+// Returns false on failure
+int  ReadOrMapEntireFileAt(DirHandle *dir, const char *name, uint64_t map_above,
+                           Arena *arena, Slice *out, int *mapped);
+
+// fopen and remove, for "name" inside of dir
+FILE *OpenFileAt(DirHandle *dir, const char *name, const char *mode);
+int   RemoveFileAt(DirHandle *dir, const char *name);
+
+// Makes link_name in dir another name for file "name" in dir (a hard link),
+// replacing whatever link_name was.
+// Returns false if that can't be done (ex: the file system has no hard
+// links), and then link_name is left as it was.
+int   LinkFileAt(DirHandle *dir, const char *name, const char *link_name);
+
+// Renames file "name" in dir to new_name, replacing whatever new_name was, in
+// one step (see rename).
+// Returns false on failure
+int   RenameFileAt(DirHandle *dir, const char *name, const char *new_name);
+
+// Makes the name a file is written under before it replaces "name" (see
+// UpdateEntireFilePartsAt): ".name.tmp", in the same directory.
+// Returns false if it doesn't fit in buf
+int   TempFileName(const char *name, char *buf, memsize buf_size);
+
+// Like WriteEntireFilePartsAt, except that a file that already holds the same
+// bytes is left alone, last write time and all. Otherwise the file is written
+// under its TempFileName, and renamed over "name", so nothing ever sees it
+// half written. *changed says whether it was written.
+// Returns false on failure
+int   UpdateEntireFilePartsAt(DirHandle *dir, const char *name, 
+                              Slice *parts, int parts_count, int *changed);
+
+// Finishes a file written under temp_name, the same way: it is renamed over
+// "name" if they differ, and removed if they don't.
+// Returns false on failure, and temp_name is removed either way
+int   ReplaceFileAt(DirHandle *dir, const char *temp_name, const char *name, int *changed);
+
+// One file of a FileBatch
+typedef struct FileBatchItem {
+    const char *name;
+    uint64_t    size;        // Reads: how big the file is (see GetFileInfoAt)
+    Slice       data;        // Reads: the file, once it is read
+    Slice      *parts;       // Writes: what goes in the file
+    int         parts_count;
+    int         ok;          // Whether it was read or written
+    int         changed;     // Writes: whether the file was different (see UpdateEntireFilePartsAt)
+} FileBatchItem;
+
+#define FILE_BATCH_MAX_ITEMS 64
+
+// A FileBatch reads or writes up to FILE_BATCH_MAX_ITEMS whole files at
+// once. On Linux, it goes through io_uring, so the opens, reads or writes,
+// and closes for the whole batch are handed to the kernel together, instead
+// of taking several system calls per file. Elsewhere, or if io_uring can't
+// be set up, the files are done one at a time with the functions above.
+//
+// A batch is not thread safe. Each thread needs its own.
+struct FileBatch;
+typedef struct FileBatch FileBatch;
+
+FileBatch *AllocFileBatch(void);
+void       FreeFileBatch(FileBatch *batch);
+
+// Reads each item's file inside of dir into the arena, setting data and ok
+void ReadEntireFilesAt(FileBatch *batch, DirHandle *dir, 
+                       FileBatchItem *items, int count, Arena *arena);
+
+// Updates each item's file inside of dir from its parts, the same way as
+// UpdateEntireFilePartsAt, setting ok and changed. The arena is only used
+// while writing.
+void WriteEntireFilesAt(FileBatch *batch, DirHandle *dir, 
+                        FileBatchItem *items, int count, Arena *arena);
+
+// Maps a whole file into memory, read only, with Slice *out pointing at it.
+// Empty files fail to map.
+// Returns false on failure
+int MapEntireFile(const char *file_path, Slice *out);
+void UnmapEntireFile(Slice data);
 
 // Copy the contents of directory "src_name" in directory "src_path"
-// to a directory name "dst_name" in directory "dst_path"
+// to a directory name "dst_name" in directory "dst_path", on up to `threads`
+// threads at once. Files whose copy already has the same size and last
+// write time are skipped. A missing source directory is nothing to copy.
 // Uses the arena for temporary storage
-void CopyDirectory(const char *src_path, const char *src_name,
-                   const char *dst_path, const char *dst_name, 
-                   Arena *arena);
+// Returns false if anything could not be copied
+int CopyDirectory(const char *src_path, const char *src_name,
+                  const char *dst_path, const char *dst_name, 
+                  int threads, Arena *arena);
 
-// Copy file "src_name" from "src_path" to "dst_path"
+// Copy file "src_name" from "src_path" to "dst_path", the same way
 // Users the arena for temporary storage
-void CopyFileToDir(const char *src_path, const char *src_name,
-              const char *dst_path, Arena *arena);
+// Returns false on failure
+int CopyFileToDir(const char *src_path, const char *src_name,
+                  const char *dst_path, Arena *arena);
 
 #endif
@@ -0,0 +1,330 @@
+#include "sc_cache.h"
+#include "paths.h"
+#include <string.h>
+
+static uint32_t SCCacheOffset(char *file_begin, char *p) {
+    return (uint32_t)(p - file_begin);
+}
+
+// Makes sure a stream read back from disk only refers to bytes inside the
+// source, and ends with exactly one End object, so replaying it can not go
+// out of bounds.
+static int SCCacheStreamIsValid(Slice stream, uint64_t source_size) {
+    char *p = stream.begin;
+
+    while ((memsize)(stream.end - p) >= sizeof(SCCacheObject)) {
+        SCCacheObject c;
+        memcpy(&c, p, sizeof(c));
+        p += sizeof(c);
+
+        if (c.type != SCObjectType_Text && c.type != SCObjectType_Func &&
+            c.type != SCObjectType_Backslash && c.type != SCObjectType_End) {
+            return 0;
+        }
+
+        if (c.command >= SCCommand_COUNT || c.args_count > SC_MAX_ARGS) { return 0; }
+        if (c.text_begin  > c.text_end  || c.text_end  > source_size)  { return 0; }
+        if (c.name_begin  > c.name_end  || c.name_end  > source_size)  { return 0; }
+        if (c.block_begin > c.block_end || c.block_end > source_size)  { return 0; }
+
+        memsize args_size = c.args_count * sizeof(SCCacheArg);
+        if ((memsize)(stream.end - p) < args_size) { return 0; }
+
+        for (int i = 0; i < c.args_count; i++) {
+            SCCacheArg a;
+            memcpy(&a, p, sizeof(a));
+            p += sizeof(a);
+
+            if (a.key_begin   > a.key_end   || a.key_end   > source_size) { return 0; }
+            if (a.value_begin > a.value_end || a.value_end > source_size) { return 0; }
+        }
+
+        if (c.type == SCObjectType_End) {
+            return p == stream.end;
+        }
+    }
+
+    return 0;
+}
+
+void SCCacheBegin(SCCache *cache, SCReader *r, SCCacheEntry *entry) {
+    memset(entry, 0, sizeof(*entry));
+    entry->arena_pos = ArenaSave(cache->arena);
+
+    // Only what is in the window of a streaming reader is known
+    if (r->stream) { return; }
+
+    Slice source = {r->begin, r->end};
+    if (SliceLength(source) >= UINT32_MAX) { return; } // Offsets are 32 bit
+
+    const char *source_path = MakePath(cache->arena, r->path, r->file_name, 0);
+    FileInfo    source_info;
+    if (!GetFileInfo(source_path, &source_info)) { return; }
+
+    // The file changed since it was read, leave it alone
+    if (source_info.size != SliceLength(source)) { return; }
+
+    entry->header = (SCCacheHeader) {
+        .magic           = SC_CACHE_MAGIC,
+        .version         = SC_CACHE_VERSION,
+        .source_size     = source_info.size,
+        .source_modified = source_info.modified,
+        .path_hash       = SliceHash(SliceFromCStr(source_path)),
+    };
+
+    const char *cache_name = ArenaPrintfCStr(cache->arena, "%016llx.scb",
+                                             (unsigned long long)entry->header.path_hash);
+    entry->cache_path = MakePath(cache->arena, cache->dir, cache_name, 0);
+
+    // Look for a good cache file
+    Slice file;
+    if (MapEntireFile(entry->cache_path, &file)) {
+        SCCacheHeader header;
+        int good = SliceLength(file) >= sizeof(header);
+
+        if (good) {
+            memcpy(&header, file.begin, sizeof(header));
+            good = header.magic       == SC_CACHE_MAGIC              &&
+                   header.version     == SC_CACHE_VERSION            &&
+                   header.path_hash   == entry->header.path_hash     &&
+                   header.source_size == entry->header.source_size   &&
+                   header.stream_size == SliceLength(file) - sizeof(header);
+        }
+
+        // Same size, different time: the content decides
+        if (good && header.source_modified != entry->header.source_modified) {
+            entry->header.source_hash = SliceHash(source);
+            good         = header.source_hash == entry->header.source_hash;
+            entry->stale = good;
+        }
+
+        Slice stream = {file.begin + sizeof(header), file.end};
+        if (good && SCCacheStreamIsValid(stream, header.source_size)) {
+            entry->mapped = file;
+            r->cached     = stream.begin;
+            return;
+        }
+
+        UnmapEntireFile(file);
+        entry->stale = 0;
+    }
+
+    // No luck, record this read
+    entry->recording    = ArenaBeginString(cache->arena);
+    entry->recording_on = 1;
+    r->record           = cache->arena;
+}
+
+void SCCacheEnd(SCCache *cache, SCReader *r, SCCacheEntry *entry, int complete) {
+    Slice stream = {0};
+
+    if (entry->recording_on) {
+        stream = ArenaEndString(cache->arena, entry->recording);
+
+        // Recording stops once the End object is in
+        if (r->record) { complete = 0; }
+        r->record = 0;
+
+        if (complete) {
+            entry->header.source_hash = SliceHash((Slice) {r->begin, r->end});
+        }
+    } else if (entry->mapped.begin) {
+        r->cached = 0;
+        complete  = entry->stale;
+
+        if (complete) {
+            // NOTE: The file is about to be overwritten, so the stream
+            // has to come out of the mapping first
+            stream = ArenaPushSlice(cache->arena, (Slice) {
+                         entry->mapped.begin + sizeof(SCCacheHeader),
+                         entry->mapped.end
+                     });
+        }
+
+        UnmapEntireFile(entry->mapped);
+    } else {
+        complete = 0;
+    }
+
+    if (complete) {
+        entry->header.stream_size = SliceLength(stream);
+        Slice parts[] = {
+            {(char*)&entry->header, (char*)(&entry->header + 1)},
+            stream,
+        };
+
+        // A cache that can't be written just means lexing next time
+        WriteEntireFileParts(parts, ArrayCount(parts), entry->cache_path);
+    }
+
+    ArenaRestore(cache->arena, entry->arena_pos);
+}
+
+void SCReadCached(SCReader *r, SCObject *out) {
+    SCCacheObject c;
+    memcpy(&c, r->cached, sizeof(c));
+
+    memset(out, 0, sizeof(*out));
+    out->type       = (SCObjectType)c.type;
+    out->command    = (SCCommand)c.command;
+    out->file_begin = r->begin;
+    out->args       = r->args;
+    out->path       = r->path;
+    out->file_name  = r->file_name;
+    out->full_text  = (Slice) {r->begin + c.text_begin, r->begin + c.text_end};
+
+    if (c.type == SCObjectType_Func) {
+        out->function_name = (Slice) {r->begin + c.name_begin, r->begin + c.name_end};
+    }
+
+    if (c.has_block) {
+        out->has_block = 1;
+        out->block     = (Slice) {r->begin + c.block_begin, r->begin + c.block_end};
+    }
+
+    char *arg_data = r->cached + sizeof(c);
+    for (int i = 0; i < c.args_count; i++) {
+        SCCacheArg a;
+        memcpy(&a, arg_data + i * sizeof(a), sizeof(a));
+        r->args[i] = (SCArg) {
+            .key   = {r->begin + a.key_begin,   r->begin + a.key_end},
+            .value = {r->begin + a.value_begin, r->begin + a.value_end},
+        };
+    }
+    out->args_count = c.args_count;
+
+    // Like the lexer, keep handing out the End object once it is reached
+    r->current = out->full_text.end;
+    if (c.type != SCObjectType_End) {
+        r->cached = arg_data + c.args_count * sizeof(SCCacheArg);
+    }
+}
+
+void SCRecordObject(SCReader *r, SCObject *obj) {
+    // Errors are never cached. SCCacheEnd sees that recording stopped early.
+    if (obj->type == SCObjectType_Error) {
+        r->record = 0;
+        return;
+    }
+
+    char *b = r->begin;
+    SCCacheObject c = {
+        .type       = (uint8_t)obj->type,
+        .command    = (uint8_t)obj->command,
+        .has_block  = (uint8_t)obj->has_block,
+        .args_count = (uint8_t)obj->args_count,
+        .text_begin = SCCacheOffset(b, obj->full_text.begin),
+        .text_end   = SCCacheOffset(b, obj->full_text.end),
+    };
+
+    if (obj->type == SCObjectType_Func) {
+        c.name_begin = SCCacheOffset(b, obj->function_name.begin);
+        c.name_end   = SCCacheOffset(b, obj->function_name.end);
+    }
+
+    if (obj->has_block) {
+        c.block_begin = SCCacheOffset(b, obj->block.begin);
+        c.block_end   = SCCacheOffset(b, obj->block.end);
+    }
+
+    ArenaPushData(r->record, (char*)&c, sizeof(c));
+
+    for (int i = 0; i < obj->args_count; i++) {
+        SCCacheArg a = {
+            .key_begin   = SCCacheOffset(b, obj->args[i].key.begin),
+            .key_end     = SCCacheOffset(b, obj->args[i].key.end),
+            .value_begin = SCCacheOffset(b, obj->args[i].value.begin),
+            .value_end   = SCCacheOffset(b, obj->args[i].value.end),
+        };
+        ArenaPushData(r->record, (char*)&a, sizeof(a));
+    }
+
+    // The End object is the last thing in a stream. Readers may keep asking
+    // for it, but it only goes in once.
+    if (obj->type == SCObjectType_End) {
+        r->record = 0;
+    }
+}
+
+#ifndef NDEBUG
+#include <stdio.h>
+#include <assert.h>
+static int TEST_SlicesEqual(Slice a, Slice b) {
+    return a.begin == b.begin && a.end == b.end;
+}
+
+void TEST_SCCache(void) {
+    printf("Testing SCCache\n");
+    const char *test = 
+        "\\info(title=\"Cached\", date=\"2019-01-01\")\n"
+        "Herp derp\\\\ derp\n"
+        "\\section{Section}\n"
+        "\\link(url=\"a.html\", url=\"b.html\"){woop}\n"
+        "derp\n";
+
+    Arena arena = AllocArena(MIN_ARENA_SIZE);
+    Slice text  = SliceFromCStr(test);
+
+    // Record a read of the whole file
+    SCReader    lexed     = MakeSCReader(text, "test_path", "test_file");
+    ArenaString recording = ArenaBeginString(&arena);
+    lexed.record = &arena;
+
+    SCObject obj;
+    do {
+        SCRead(&lexed, &obj);
+    } while (obj.type != SCObjectType_End &&
+             obj.type != SCObjectType_Error);
+
+    SCRead(&lexed, &obj); // Only one End gets recorded
+    assert(!lexed.record);
+    Slice stream = ArenaEndString(&arena, recording);
+    assert(SCCacheStreamIsValid(stream, SliceLength(text)));
+    assert(!SCCacheStreamIsValid((Slice) {stream.begin, stream.end - 1}, SliceLength(text)));
+    assert(!SCCacheStreamIsValid(stream, SliceLength(text) - 1));
+
+    // Replaying should give the same objects as lexing again
+    SCReader replayed = MakeSCReader(text, "test_path", "test_file");
+    lexed             = MakeSCReader(text, "test_path", "test_file");
+    replayed.cached   = stream.begin;
+
+    SCObject cached_obj;
+    do {
+        SCRead(&lexed, &obj);
+        SCRead(&replayed, &cached_obj);
+
+        assert(obj.type == cached_obj.type && obj.command == cached_obj.command);
+        assert(TEST_SlicesEqual(obj.full_text, cached_obj.full_text));
+        assert(lexed.current == replayed.current);
+
+        if (obj.type == SCObjectType_Func) {
+            assert(TEST_SlicesEqual(obj.function_name, cached_obj.function_name));
+            assert(obj.has_block == cached_obj.has_block);
+            assert(!obj.has_block || TEST_SlicesEqual(obj.block, cached_obj.block));
+            assert(obj.args_count == cached_obj.args_count);
+
+            for (int i = 0; i < obj.args_count; i++) {
+                assert(TEST_SlicesEqual(obj.args[i].key,   cached_obj.args[i].key));
+                assert(TEST_SlicesEqual(obj.args[i].value, cached_obj.args[i].value));
+            }
+        }
+    } while (obj.type != SCObjectType_End);
+
+    SCRead(&replayed, &cached_obj);
+    assert(cached_obj.type == SCObjectType_End);
+
+    // Files with errors are not recorded
+    SCReader bad = MakeSCReader(SliceFromCStr("herp \\ derp"), "test_path", "test_file");
+    recording  = ArenaBeginString(&arena);
+    bad.record = &arena;
+    do {
+        SCRead(&bad, &obj);
+    } while (obj.type != SCObjectType_End &&
+             obj.type != SCObjectType_Error);
+    assert(obj.type == SCObjectType_Error && !bad.record);
+    ArenaEndString(&arena, recording);
+
+    FreeArena(&arena);
+    printf("Seems good.\n");
+}
+#endif
@@ -0,0 +1,98 @@
+#pragma once
+#ifndef SC_CACHE_H
+#define SC_CACHE_H
+#include "common.h"
+#include "slice.h"
+#include "arena.h"
+#include "sc_file.h"
+
+// SC object cache (.scb files)
+//
+// Lexing every source file on every build is wasted work when most of them
+// have not changed. The object cache saves the stream of objects SCRead
+// produced for a file, and later builds replay that stream instead of lexing
+// the file again.
+//
+// A cache file is a header followed by one SCCacheObject per object, each
+// directly followed by its SCCacheArg's. Everything is stored as offsets into
+// the source text, so the source still has to be loaded to use the cache.
+// The stream always ends with the End object. Files that fail to read are
+// never cached.
+//
+// NOTE: The files are written in the machine's own byte order, they
+// are not meant to be moved between machines.
+//
+// A cache file is good if the source has the same size and last write time
+// as when the cache was made. If the time changed but the content hash
+// still matches (ex: the file was touched or checked out again), the cache
+// is still used, and gets rewritten with the new time.
+
+#define SC_CACHE_MAGIC   0x31424353 // "SCB1"
+#define SC_CACHE_VERSION 1
+
+typedef struct SCCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t source_size;
+    int64_t  source_modified;
+    uint64_t source_hash;
+    uint64_t path_hash;
+    uint64_t stream_size;  // Bytes of objects following the header
+} SCCacheHeader;
+
+// Slices are stored as begin/end offsets into the source text.
+typedef struct SCCacheObject {
+    uint8_t  type;
+    uint8_t  command;
+    uint8_t  has_block;
+    uint8_t  args_count;
+    uint32_t text_begin;
+    uint32_t text_end;
+    uint32_t name_begin;
+    uint32_t name_end;
+    uint32_t block_begin;
+    uint32_t block_end;
+} SCCacheObject;
+
+typedef struct SCCacheArg {
+    uint32_t key_begin;
+    uint32_t key_end;
+    uint32_t value_begin;
+    uint32_t value_end;
+} SCCacheArg;
+
+typedef struct SCCache {
+    const char *dir;     // Absolute path of the directory holding .scb files
+    Arena      *arena;   // Scratch space for paths and recorded streams
+} SCCache;
+
+// The state of one source file's trip through the cache
+typedef struct SCCacheEntry {
+    ArenaPos      arena_pos;
+    const char   *cache_path;
+    SCCacheHeader header;      // What the cache file should say about the source
+    Slice         mapped;      // The cache file, while it is being replayed
+    int           stale;       // Replaying, but the header needs rewriting
+    ArenaString   recording;   // The recorded stream, while recording
+    int           recording_on;
+} SCCacheEntry;
+
+// Hooks the reader up to the cache. The reader must not have read anything
+// yet. If there is a good cache file for the reader's file, the reader
+// replays it instead of lexing. Otherwise, the reader records the objects it
+// reads for SCCacheEnd to save.
+void SCCacheBegin(SCCache *cache, SCReader *r, SCCacheEntry *entry);
+
+// Finishes up after reading. If recording, and complete is true (the whole
+// file was read, up to the End object), the cache file is written.
+void SCCacheEnd(SCCache *cache, SCReader *r, SCCacheEntry *entry, int complete);
+
+// Used by SCRead
+void SCReadCached(SCReader *r, SCObject *out);
+void SCRecordObject(SCReader *r, SCObject *obj);
+
+#ifndef NDEBUG
+void TEST_SCCache(void);
+#endif
+
+#endif
@@ -1,27 +1,72 @@
 #include "sc_file.h"
-#include <ctype.h>
+#include "sc_cache.h"
+#include "simd.h"
+#include "threads.h"
 #include <string.h>
+#include <assert.h>
+
+// A streaming reader keeps at least this much in the window before reading
+// an object, so short things (an escaped backslash, a function name) don't
+// get cut off by the end of the window.
+#define SC_STREAM_LOOKAHEAD 256
+
+// Function names, indexed by SCCommand
+static const char *g_sc_command_name[SCCommand_COUNT] = {
+    "",
+    "section",
+    "subsection",
+    "paragraph",
+    "ordered_list",
+    "unordered_list",
+    "horizontal_list",
+    "table",
+    "item",
+    "hitem",
+    "row",
+    "html",
+    "code",
+    "quote",
+    "bold",
+    "italic",
+    "inline",
+    "link",
+    "image",
+    "info",
+    "root_is_blog",
+    "title",
+    "copyright",
+    "footer",
+    "nav",
+};
+
+// NOTE: These are the C locale versions of isspace/isalnum/isdigit.
+// They are written out here so that they inline into the scanning loops,
+// instead of going through the ctype table with a function call per byte.
+static inline int IsSpaceChar(int ch);
 
 // Valid characters for function names or argument keys
-static int IsNameOrKeyChar(int c);
+static inline int IsNameOrKeyChar(int c);
 
 // Matches chars that make up a decimal number
-static int IsDigitChar(int ch);
+static inline int IsDigitChar(int ch);
 
 // Fill out an SCObjectType_Error object with the given error message.
 static void SCError(SCReader *r, const char *str, SCObject *out);
 
-// Consume characters from the input, updating the line/col numbers
+// Consume characters from the input
 static void SCConsume(SCReader *r, memsize chars);
 
 // Checks for a character. Consumes if present and fails otherwise
 static int SCExpect(SCReader *r, char c, const char *err, SCObject *out); 
 
+// Consume until either char is reached
+static void SCScanUntil2(SCReader *r, char c0, char c1);
+
 // Consume until char is reached
 static void SCConsumeUntil(SCReader *r, char c);
 
 // Consume while predicate function is true
-static void SCConsumeWhileFunc(SCReader *r, int (*func)(int ch));
+static inline void SCConsumeWhileFunc(SCReader *r, int (*func)(int ch));
 
 // Consume whitespace
 static void SCConsumeWhitespace(SCReader *r);
@@ -61,6 +106,9 @@ static void SCReadArgumentList(SCReader *r, SCObject *out);
 // to paste c-style source without having to add escape characters.
 static void SCReadBlock(SCReader *r, SCObject *out);
 
+// Finds the SCCommand for a function name
+static SCCommand SCLookupCommand(Slice name);
+
 // A function is the only non text item in the file.
 // It is marked by a backslash, following by the function name, ex:
 // \functioncall
@@ -83,10 +131,29 @@ static void SCReadBlock(SCReader *r, SCObject *out);
 // \function(arg1=22, arg2=33){This is the block}
 static void SCReadFunction(SCReader *r, SCObject *out);
 
+// Lexes the next object
+static void SCReadObject(SCReader *r, SCObject *out);
+
+// Reads objects into a document until it gets to the End or an Error, or
+// until the next object would start at or after stop (if stop isn't null).
+// Returns the size of the arrays.
+static memsize SCReadDocumentUntil(SCReader *r, Arena *arena, SCDocument *out, char *stop);
+
+// Building a document: Begin makes room for max_count objects, Push adds
+// them, and End finishes off the arguments.
+static void SCDocumentBegin(SCDocument *doc, Arena *arena, memsize max_count);
+static void SCDocumentPush(SCDocument *doc, SCObject *obj, Arena *arena);
+static void SCDocumentEnd(SCDocument *doc, Arena *arena);
+
+// Lexes the next object of a streaming reader, reading more of the file
+// first if it might not all be in the window
+static void SCReadStreamObject(SCReader *r, SCObject *out);
+
+// Moves the window up to keep, and reads more of the file after it
+static void SCRefill(SCReader *r, char *keep);
+
 SCReader MakeSCReader(Slice text, const char *path, const char *file) {
     return (SCReader) {
-        .line_no    = 1, 
-        .column_no  = 1, 
         .begin      = text.begin, 
         .current    = text.begin, 
         .end        = text.end, 
@@ -96,13 +163,304 @@ SCReader MakeSCReader(Slice text, const char *path, const char *file) {
     };
 }
 
+SCReader MakeSCStreamReader(FILE *stream, memsize window_size, Arena *arena, 
+                            const char *path, const char *file) {
+    char *window = ArenaPushMany(arena, char, window_size);
+
+    return (SCReader) {
+        .begin          = window, 
+        .current        = window, 
+        .end            = window, 
+        .stream         = stream,
+        .window_arena   = arena,
+        .window         = window,
+        .window_size    = window_size,
+        .begin_location = {1, 1},
+        .path           = path,
+        .file_name      = file,
+    };
+} 
+
 void SCRead(SCReader *r, SCObject *out) {
+    if (r->cached) {
+        SCReadCached(r, out);
+        return; 
+    }
+
+    if (r->stream) {
+        SCReadStreamObject(r, out);
+    } else { 
+        SCReadObject(r, out);
+    }
+
+    if (r->record) {
+        SCRecordObject(r, out);
+    }
+} 
+
+void SCReadDocument(SCReader *r, Arena *arena, SCDocument *out) {
+    assert(!r->stream && "Streaming readers can't be read into a document");
+    SCReadDocumentUntil(r, arena, out, 0);
+} 
+
+static memsize SCReadDocumentUntil(SCReader *r, Arena *arena, SCDocument *out, char *stop) {
+    memset(out, 0, sizeof(*out));
+    out->file_begin = r->begin;
+    out->path       = r->path;
+    out->file_name  = r->file_name;
+
+    // Every object other than text starts at a backslash, and there is at
+    // most one text object in front of each of those, plus the End. So
+    // counting backslashes gives enough room without growing the arrays.
+    char   *count_end = stop ? stop : r->end;
+    memsize max_count = 2;
+    for (char *p = r->current; 
+         (p = memchr(p, '\\', (memsize)(count_end - p))); 
+         p++) {
+        max_count += 2;
+    }
+
+    SCDocumentBegin(out, arena, max_count);
+    SCObject obj;
+    while (!stop || r->current < stop) {
+        SCRead(r, &obj);
+        SCDocumentPush(out, &obj, arena);
+
+        if (obj.type == SCObjectType_End ||
+            obj.type == SCObjectType_Error) { break; }
+    }
+
+    SCDocumentEnd(out, arena);
+    return max_count;
+} 
+
+static void SCDocumentBegin(SCDocument *doc, Arena *arena, memsize max_count) {
+    ArenaAlign(arena, sizeof(void*));
+    doc->text       = ArenaPushMany(arena, Slice,   max_count);
+    doc->names      = ArenaPushMany(arena, Slice,   max_count);
+    doc->blocks     = ArenaPushMany(arena, Slice,   max_count);
+    doc->args_begin = ArenaPushMany(arena, int,     max_count + 1);
+    doc->types      = ArenaPushMany(arena, uint8_t, max_count);
+    doc->commands   = ArenaPushMany(arena, uint8_t, max_count);
+
+    // The number of arguments isn't known up front, so they get built like
+    // a string after the arrays, and args points at the start of the string
+    // until SCDocumentEnd
+    ArenaAlign(arena, sizeof(void*));
+    doc->args          = (SCArg*)ArenaBeginString(arena);
+    doc->args_begin[0] = 0;
+} 
+
+static void SCDocumentPush(SCDocument *doc, SCObject *obj, Arena *arena) {
+    int i          = doc->count++;
+    int args_count = doc->args_begin[i];
+    doc->types     [i] = (uint8_t)obj->type;
+    doc->commands  [i] = (uint8_t)obj->command;
+    doc->text      [i] = obj->full_text;
+    doc->names     [i] = obj->function_name;
+    doc->blocks    [i] = obj->has_block ? obj->block : NullSlice();
+
+    if (obj->args_count) {
+        ArenaPushData(arena, (char*)obj->args, obj->args_count * sizeof(SCArg));
+    }
+
+    doc->args_begin[i + 1] = args_count + obj->args_count;
+    doc->error_text        = obj->error_text;
+} 
+
+// Copies objects [first, doc->count) of another document
+static void SCDocumentPushRange(SCDocument *doc, SCDocument *from, int first, Arena *arena) {
+    int     count      = from->count - first;
+    int     args_count = doc->args_begin[doc->count];
+    int     from_args  = from->args_begin[first];
+    int     i          = doc->count;
+
+    memcpy(doc->types    + i, from->types    + first, count * sizeof(uint8_t));
+    memcpy(doc->commands + i, from->commands + first, count * sizeof(uint8_t));
+    memcpy(doc->text     + i, from->text     + first, count * sizeof(Slice));
+    memcpy(doc->names    + i, from->names    + first, count * sizeof(Slice));
+    memcpy(doc->blocks   + i, from->blocks   + first, count * sizeof(Slice));
+
+    for (int j = 1; j <= count; j++) {
+        doc->args_begin[i + j] = args_count + from->args_begin[first + j] - from_args;
+    }
+
+    ArenaPushData(arena, (char*)(from->args + from_args), 
+                  (from->args_begin[from->count] - from_args) * sizeof(SCArg));
+    doc->count     += count;
+    doc->error_text = from->error_text;
+} 
+
+static void SCDocumentEnd(SCDocument *doc, Arena *arena) {
+    doc->args = (SCArg*)ArenaEndString(arena, (ArenaString)doc->args).begin;
+
+    int last = doc->count - 1;
+    if (last < 0 || doc->types[last] != SCObjectType_Error) {
+        doc->error_text = 0;
+    }
+} 
+
+// One piece of a file being read by SCReadDocumentParallel
+typedef struct SCReadChunk {
+    SCReader   reader;
+    char      *begin;     // Where this chunk's reader starts
+    char      *stop;      // Where the next chunk's starts
+    Arena      arena;
+    SCDocument doc;
+    memsize    max_count;
+} SCReadChunk;
+
+static void SCReadChunkThread(void *data, int index) {
+    SCReadChunk *chunk = (SCReadChunk*)data + index;
+    chunk->arena          = AllocArena(ARENA_SIZE);
+    chunk->reader.current = chunk->begin;
+    chunk->max_count      = SCReadDocumentUntil(&chunk->reader, &chunk->arena, &chunk->doc, 
+                                                chunk->stop);
+} 
+
+// Finds somewhere after p that is probably the start of an object: a
+// function call at the start of a line. It could still be inside a block or
+// an argument, which SCReadDocumentParallel sorts out afterwards.
+static char *SCFindChunkStart(char *p, char *end) {
+    while (p && p + 2 < end) {
+        p = memchr(p, '\n', (memsize)(end - p - 2));
+        if (!p) { break; }
+
+        p++;
+        if (p[0] == '\\' && IsNameOrKeyChar(p[1])) { return p; }
+    }
+
+    return 0;
+} 
+
+void SCReadDocumentParallel(SCReader *r, Arena *arena, SCDocument *out, int threads) {
+    // The object cache works one object at a time, so replaying stays
+    // serial. (It's fast anyway.) Recording happens after, see below.
+    if (r->cached || r->stream || threads < 2) {
+        SCReadDocument(r, arena, out);
+        return; 
+    }
+
+    SCReadChunk chunks[MAX_THREADS];
+    int         chunks_count = 0;
+    char       *begin        = r->current;
+    memsize     size         = (memsize)(r->end - r->current);
+    if (threads > MAX_THREADS) { threads = MAX_THREADS; }
+
+    for (int i = 0; i < threads; i++) {
+        char *chunk_begin = begin;
+        if (i) {
+            chunk_begin = SCFindChunkStart(begin + size / threads * i, r->end);
+            if (!chunk_begin || chunk_begin <= chunks[chunks_count - 1].begin) { continue; }
+            chunks[chunks_count - 1].stop = chunk_begin;
+        }
+
+        SCReadChunk *chunk = &chunks[chunks_count++];
+        memset(chunk, 0, sizeof(*chunk));
+        chunk->reader        = *r;
+        chunk->reader.record = 0;
+        chunk->begin         = chunk_begin;
+    }
+
+    RunParallel(SCReadChunkThread, chunks, chunks_count);
+
+    // Stitch the chunks together. Only the first chunk is known to start at
+    // an object. The others guessed, so the real reading (p) is followed
+    // through each chunk: once it lands on the start of one of the chunk's
+    // objects, the rest of the chunk is right too, since reading from the
+    // start of an object always goes the same way. If it never lands on one
+    // (ex: the guess was inside a block), that part is read again here.
+    memsize max_count = 0;
+    for (int i = 0; i < chunks_count; i++) { max_count += chunks[i].max_count; }
+
+    memset(out, 0, sizeof(*out));
+    out->file_begin = r->begin;
+    out->path       = r->path;
+    out->file_name  = r->file_name;
+    SCDocumentBegin(out, arena, max_count);
+
+    char *p    = begin;
+    int   done = 0;
+    for (int i = 0; i < chunks_count && !done; i++) {
+        SCReadChunk *chunk = &chunks[i];
+        SCDocument  *doc   = &chunk->doc;
+        SCReader     again = *r;
+        SCObject     obj;
+        again.current = p;
+        again.record  = 0;
+
+        int j = 0;
+        while (1) {
+            while (j < doc->count && doc->text[j].begin < p) { j++; }
+
+            if (j < doc->count && doc->text[j].begin == p) {
+                SCDocumentPushRange(out, doc, j, arena);
+                p = chunk->reader.current;
+
+                int type = doc->types[doc->count - 1];
+                done = type == SCObjectType_End || type == SCObjectType_Error;
+                break; 
+            }
+
+            if (chunk->stop && p >= chunk->stop) { break; }
+
+            SCRead(&again, &obj);
+            SCDocumentPush(out, &obj, arena);
+            p = again.current;
+
+            if (obj.type == SCObjectType_End ||
+                obj.type == SCObjectType_Error) { 
+                done = 1;
+                break; 
+            }
+        }
+    }
+
+    SCDocumentEnd(out, arena);
+
+    for (int i = 0; i < chunks_count; i++) { FreeArena(&chunks[i].arena); }
+
+    // Leave the reader where a serial read would have
+    r->current = p;
+    r->error   = out->error_text;
+
+    if (r->record) {
+        SCObject obj;
+        for (int i = 0; i < out->count; i++) {
+            SCGetDocumentObject(out, i, &obj);
+            SCRecordObject(r, &obj);
+        }
+    }
+} 
+
+void SCGetDocumentObject(SCDocument *doc, int i, SCObject *out) {
+    memset(out, 0, sizeof(*out));
+
+    out->type          = (SCObjectType)doc->types[i];
+    out->command       = (SCCommand)doc->commands[i];
+    out->file_begin    = doc->file_begin;
+    out->full_text     = doc->text[i];
+    out->function_name = doc->names[i];
+    out->args          = doc->args + doc->args_begin[i];
+    out->args_count    = doc->args_begin[i + 1] - doc->args_begin[i];
+    out->has_block     = !IsNullSlice(doc->blocks[i]);
+    out->block         = doc->blocks[i];
+    out->path          = doc->path;
+    out->file_name     = doc->file_name;
+
+    if (out->type == SCObjectType_Error) {
+        out->error_text = doc->error_text;
+    }
+} 
+
+static void SCReadObject(SCReader *r, SCObject *out) {
     memset(out, 0, sizeof(*out));
 
-    out->line_no   = r->line_no;
-    out->column_no = r->column_no;
-    out->path      = r->path;
-    out->file_name = r->file_name;
+    out->file_begin     = r->begin;
+    out->begin_location = r->begin_location;
+    out->args           = r->args;
+    out->path           = r->path;
+    out->file_name      = r->file_name;
 
     if (r->error) { 
         SCError(r, r->error, out); 
@@ -110,7 +468,8 @@ void SCRead(SCReader *r, SCObject *out) {
     }
 
     if (r->current == r->end) {
-        out->type = SCObjectType_End;
+        out->type      = SCObjectType_End;
+        out->full_text = (Slice) {r->current, r->current};
     } else if (r->current[0] == '\\') {
         if (r->current + 1 == r->end) {
             SCError(r, "Backslash unescaped and with no function at the end of file", out);
@@ -119,8 +478,6 @@ void SCRead(SCReader *r, SCObject *out) {
             SCConsume(r, 2);
             out->type          = SCObjectType_Backslash;
             out->full_text     = (Slice) {backslash_begin, r->current};
-            out->end_line_no   = r->line_no;
-            out->end_column_no = r->column_no;
         } else {
             SCReadFunction(r, out);
         }
@@ -130,12 +487,109 @@ void SCRead(SCReader *r, SCObject *out) {
         char *end          = r->current;
         out->type          = SCObjectType_Text;
         out->full_text     = (Slice) {start, end};
-        out->end_line_no   = r->line_no;
-        out->end_column_no = r->column_no;
     }
 }
 
+static void SCReadStreamObject(SCReader *r, SCObject *out) {
+    // Errors stick, like with a regular reader
+    if (r->error) { 
+        SCReadObject(r, out);
+        return; 
+    }
+
+    if (!r->stream_done && (memsize)(r->end - r->current) < SC_STREAM_LOOKAHEAD) {
+        SCRefill(r, r->current);
+    }
+
+    while (1) {
+        char *start = r->current;
+        SCReadObject(r, out);
+
+        // Anything that stopped short of the end of the window is all there.
+        // Anything that ran into it might keep going past it.
+        if (r->stream_done || r->current < r->end) { break; }
+
+        // Text can be cut anywhere, but only once there is no more room to
+        // be made in front of it. Not while it is all whitespace though,
+        // since whether whitespace opens a paragraph depends on the text
+        // after it (see SCToHTMLText), so the window grows instead.
+        int window_full = start == r->window && 
+                          r->end == r->window + r->window_size;
+        if (out->type == SCObjectType_Text && window_full &&
+            !IsAllWhitespace(out->full_text)) { break; }
+
+        r->current = start;
+        r->error   = 0;
+        SCRefill(r, start);
+    }
+} 
+
+// NOTE: If keep is already at the front of a full window, there is no
+// room to be made, so the window doubles instead. That only happens for a
+// single function bigger than the window, so memory still depends on the
+// biggest function, not on the file.
+static void SCRefill(SCReader *r, char *keep) {
+    r->begin_location = SCAddLocation(r->begin_location, SCFindLocation(r->begin, keep));
+
+    memsize kept           = (memsize)(r->end - keep);
+    memsize current_offset = (memsize)(r->current - keep);
+
+    if (kept == r->window_size) {
+        r->window_size *= 2;
+        char *window = ArenaPushMany(r->window_arena, char, r->window_size);
+        memcpy(window, keep, kept);
+        r->window = window;
+    } else { 
+        memmove(r->window, keep, kept);
+    }
+
+    r->begin   = r->window;
+    r->current = r->window + current_offset;
+    r->end     = r->window + kept;
+
+    memsize wanted = r->window_size - kept;
+    memsize got    = fread(r->end, 1, wanted, r->stream);
+    r->end += got;
+
+    if (got < wanted) {
+        r->stream_done = 1;
+        if (ferror(r->stream)) {
+            r->error = "Could not read the rest of the file";
+        }
+    }
+} 
+
+SCLocation SCAddLocation(SCLocation base, SCLocation offset) {
+    if (!base.line_no) { 
+        return offset; 
+    } else if (offset.line_no == 1) {
+        return (SCLocation) {base.line_no, base.column_no + offset.column_no - 1};
+    } else { 
+        return (SCLocation) {base.line_no + offset.line_no - 1, offset.column_no};
+    }
+} 
+
+SCLocation SCFindLocation(char *file_begin, char *p) {
+    SCLocation location = {1, 1};
+    char *line_begin = file_begin;
+    char *newline;
+
+    while (line_begin < p && 
+           (newline = memchr(line_begin, '\n', (memsize)(p - line_begin)))) {
+        location.line_no++;
+        line_begin = newline + 1;
+    }
+
+    location.column_no = (int)(p - line_begin) + 1;
+    return location;
+} 
+
 Slice SCMakeErrorString(SCObject *obj, Arena *arena, const char *error_text) {
+    SCLocation start = SCAddLocation(obj->begin_location,
+                                     SCFindLocation(obj->file_begin, obj->full_text.begin));
+    SCLocation end   = SCAddLocation(obj->begin_location,
+                                     SCFindLocation(obj->file_begin, obj->full_text.end));
+
     ArenaString error = ArenaBeginString(arena);
     ArenaPushCStr(arena, "Error while reading SC file: ");
     ArenaPushCStr(arena, obj->file_name);
@@ -144,9 +598,9 @@ Slice SCMakeErrorString(SCObject *obj, Arena *arena, const char *error_text) {
     ArenaPushf(arena,    "\nError: %s\n", 
                error_text ? error_text : obj->error_text);
     ArenaPushf(arena,    "Starting location: line %d, col %d\n", 
-               obj->line_no, obj->column_no);
+               start.line_no, start.column_no);
     ArenaPushf(arena,    "Ending location:   line %d, col %d\n",
-               obj->end_line_no, obj->end_column_no);
+               end.line_no, end.column_no);
     return ArenaEndString(arena, error);
 }
 
@@ -164,9 +618,9 @@ void PrintSCObject(SCObject *obj) {
         printf("    args={\n");
         for (int i = 0; i < obj->args_count; i++) {
             printf("     ");
-            SlicePrint(obj->keys[i]);
+            SlicePrint(obj->args[i].key);
             printf(" = \"");
-            SlicePrint(obj->values[i]);
+            SlicePrint(obj->args[i].value);
             printf("\"\n");
         }
         printf("    }\n");
@@ -234,8 +688,10 @@ static void SCReadArgument(SCReader *r, SCObject *out) {
         return;
     }
 
-    out->keys[out->args_count]   = (Slice) {key_begin, key_end};
-    out->values[out->args_count] = (Slice) {value_begin, value_end};
+    out->args[out->args_count] = (SCArg) {
+        .key   = {key_begin, key_end},
+        .value = {value_begin, value_end},
+    };
     out->args_count++;
 
     // Parameter read completed!
@@ -279,10 +735,14 @@ static void SCReadBlock(SCReader *r, SCObject *out) {
 
     char *begin = r->current;
     int level = 1;
-    while (r->current < r->end && level) {
+    while (1) {
+        // Skip straight to the next brace
+        SCScanUntil2(r, '{', '}');
+        if (r->current >= r->end) { break; }
+
         if (*r->current == '{') { 
             level++; 
-        } else if (*r->current == '}') {
+        } else {
             level--;
 
             // Do not consume the last '}' yet
@@ -320,6 +780,7 @@ static void SCReadFunction(SCReader *r, SCObject *out) {
     }
 
     out->function_name = (Slice) {name_begin, r->current};
+    out->command       = SCLookupCommand(out->function_name);
 
     if (r->current < r->end && *r->current == '(') {
         SCReadArgumentList(r, out);
@@ -331,22 +792,74 @@ static void SCReadFunction(SCReader *r, SCObject *out) {
         if (out->type == SCObjectType_Error) { return; }
     }
 
-    out->end_line_no   = r->line_no;
-    out->end_column_no = r->column_no;
     out->full_text.end = r->current;
 }
 
-static int IsNameOrKeyChar(int c) {
-    return c == '_' || isalnum(c);
+// Checks the rest of the name once the length and first char have picked out
+// a candidate.
+static inline
+SCCommand SCMatchCommand(Slice name, SCCommand command) {
+    if (memcmp(name.begin, g_sc_command_name[command], SliceLength(name)) == 0) {
+        return command;
+    }
+
+    return SCCommand_Unknown;
 }
 
-static int IsDigitChar(int ch) {
-    return isdigit(ch) || ch == '.' || ch == '-';
+#define SC_COMMAND_KEY(length, first) (((length) << 8) | (unsigned char)(first))
+
+// NOTE: Names are told apart by their length and first char. That is
+// unique for every command except item/info, table/title and italic/inline,
+// which look at one more char. This has to be kept in sync with the
+// SCCommand list (TEST_SCReader checks it).
+static SCCommand SCLookupCommand(Slice name) {
+    switch (SC_COMMAND_KEY(SliceLength(name), name.begin[0])) {
+    case SC_COMMAND_KEY(3,  'r'): return SCMatchCommand(name, SCCommand_Row);
+    case SC_COMMAND_KEY(3,  'n'): return SCMatchCommand(name, SCCommand_Nav);
+    case SC_COMMAND_KEY(4,  'h'): return SCMatchCommand(name, SCCommand_Html);
+    case SC_COMMAND_KEY(4,  'c'): return SCMatchCommand(name, SCCommand_Code);
+    case SC_COMMAND_KEY(4,  'b'): return SCMatchCommand(name, SCCommand_Bold);
+    case SC_COMMAND_KEY(4,  'l'): return SCMatchCommand(name, SCCommand_Link);
+    case SC_COMMAND_KEY(4,  'i'): 
+        return SCMatchCommand(name, name.begin[1] == 't' ? SCCommand_Item : SCCommand_Info);
+    case SC_COMMAND_KEY(5,  't'): 
+        return SCMatchCommand(name, name.begin[1] == 'a' ? SCCommand_Table : SCCommand_Title);
+    case SC_COMMAND_KEY(5,  'h'): return SCMatchCommand(name, SCCommand_Hitem);
+    case SC_COMMAND_KEY(5,  'q'): return SCMatchCommand(name, SCCommand_Quote);
+    case SC_COMMAND_KEY(5,  'i'): return SCMatchCommand(name, SCCommand_Image);
+    case SC_COMMAND_KEY(6,  'i'): 
+        return SCMatchCommand(name, name.begin[2] == 'a' ? SCCommand_Italic : SCCommand_Inline);
+    case SC_COMMAND_KEY(6,  'f'): return SCMatchCommand(name, SCCommand_Footer);
+    case SC_COMMAND_KEY(7,  's'): return SCMatchCommand(name, SCCommand_Section);
+    case SC_COMMAND_KEY(9,  'p'): return SCMatchCommand(name, SCCommand_Paragraph);
+    case SC_COMMAND_KEY(9,  'c'): return SCMatchCommand(name, SCCommand_Copyright);
+    case SC_COMMAND_KEY(10, 's'): return SCMatchCommand(name, SCCommand_Subsection);
+    case SC_COMMAND_KEY(12, 'o'): return SCMatchCommand(name, SCCommand_OrderedList);
+    case SC_COMMAND_KEY(12, 'r'): return SCMatchCommand(name, SCCommand_RootIsBlog);
+    case SC_COMMAND_KEY(14, 'u'): return SCMatchCommand(name, SCCommand_UnorderedList);
+    case SC_COMMAND_KEY(15, 'h'): return SCMatchCommand(name, SCCommand_HorizontalList);
+    default:                      return SCCommand_Unknown;
+    }
+} 
+
+static inline int IsSpaceChar(int ch) {
+    return ch == ' ' || (ch >= '\t' && ch <= '\r');
+} 
+
+static inline int IsNameOrKeyChar(int c) {
+    return c == '_' || 
+           (c >= 'a' && c <= 'z') || 
+           (c >= 'A' && c <= 'Z') || 
+           (c >= '0' && c <= '9');
+} 
+
+static inline int IsDigitChar(int ch) {
+    return (ch >= '0' && ch <= '9') || ch == '.' || ch == '-';
 }
 
 int IsAllWhitespace(Slice text) {
     while (text.begin != text.end) {
-        if (!isspace(*text.begin)) { return 0; }
+        if (!IsSpaceChar((unsigned char)*text.begin)) { return 0; }
         text.begin++;
     }
 
@@ -357,27 +870,19 @@ static void SCError(SCReader *r, const char *str, SCObject *out) {
     r->error = str;
 
     out->type           = SCObjectType_Error;
-    out->end_line_no    = r->line_no;
-    out->end_column_no  = r->column_no;
     out->full_text.end  = r->current;
     out->error_text     = str;
 
-    if (!out->line_no)   { out->line_no   = r->line_no; }
-    if (!out->column_no) { out->column_no = r->column_no; }
     if (!out->full_text.begin) { out->full_text.begin = r->current; }
 }
 
-// Consume characters from the input, updating the line/col numbers
+// Consume characters from the input
 static void SCConsume(SCReader *r, memsize chars) {
-    while (r->current < r->end && chars--) {
-        if (*r->current == '\n') {
-            r->line_no++;
-            r->column_no = 0;
-        }
-
-        r->current++;
-        r->column_no++;
+    if (chars > (memsize)(r->end - r->current)) {
+        chars = (memsize)(r->end - r->current);
     }
+
+    r->current += chars;
 }
 
 static int SCExpect(SCReader *r, char c, const char *err, SCObject *out) {
@@ -391,22 +896,71 @@ static int SCExpect(SCReader *r, char c, const char *err, SCObject *out) {
 }
 
 
+// NOTE: Plain text runs and blocks make up most of every file, so this
+// is where the reader spends its time. It compares 32 (AVX2) or 16 (SSE2)
+// bytes at a time against the two stop characters. Whatever is left at the
+// end goes through the plain loop.
+static void SCScanUntil2(SCReader *r, char c0, char c1) {
+    char *p   = r->current;
+    char *end = r->end;
+
+#if SIMD_AVX2
+    __m256i stop0_32 = _mm256_set1_epi8(c0);
+    __m256i stop1_32 = _mm256_set1_epi8(c1);
+
+    for (; end - p >= 32; p += 32) {
+        __m256i  chunk = _mm256_loadu_si256((const __m256i*)p);
+        uint32_t stops = (uint32_t)_mm256_movemask_epi8(
+                             _mm256_or_si256(_mm256_cmpeq_epi8(chunk, stop0_32),
+                                             _mm256_cmpeq_epi8(chunk, stop1_32)));
+        if (stops) {
+            r->current = p + CountTrailingZeros32(stops);
+            return;
+        }
+    }
+#endif
+
+#if SIMD_SSE2
+    __m128i stop0_16 = _mm_set1_epi8(c0);
+    __m128i stop1_16 = _mm_set1_epi8(c1);
+
+    for (; end - p >= 16; p += 16) {
+        __m128i  chunk = _mm_loadu_si128((const __m128i*)p);
+        uint32_t stops = (uint32_t)_mm_movemask_epi8(
+                             _mm_or_si128(_mm_cmpeq_epi8(chunk, stop0_16),
+                                          _mm_cmpeq_epi8(chunk, stop1_16)));
+        if (stops) {
+            r->current = p + CountTrailingZeros32(stops);
+            return;
+        }
+    }
+#endif
+
+    while (p < end && *p != c0 && *p != c1) {
+        p++;
+    }
+
+    r->current = p;
+} 
+
 // Consume until char is reached
 static void SCConsumeUntil(SCReader *r, char c) {
-    while (r->current < r->end && *r->current != c) {
-        SCConsume(r, 1);
-    }
+    SCScanUntil2(r, c, c);
 }
 
 // Consume while predicate function is true
-static void SCConsumeWhileFunc(SCReader *r, int (*func)(int ch)) {
-    while (r->current < r->end && func(*r->current)) {
-        SCConsume(r, 1);
+//
+// NOTE: This is inline so that the predicate gets inlined too. These
+// runs (names, numbers, whitespace between args) are short, so they are not
+// worth vectorizing.
+static inline void SCConsumeWhileFunc(SCReader *r, int (*func)(int ch)) {
+    while (r->current < r->end && func((unsigned char)*r->current)) {
+        r->current++;
     }
 }
 
 static void SCConsumeWhitespace(SCReader *r) {
-    SCConsumeWhileFunc(r, isspace);
+    SCConsumeWhileFunc(r, IsSpaceChar);
 }
 
 
@@ -469,10 +1023,12 @@ void TEST_SCReader(void) {
             if (SliceEqCStr(obj.function_name, "herp")) {
                 assert(obj.has_block);
                 assert(obj.args_count == 2);
-                assert(SliceEqCStr(obj.keys[0], "foo"));
-                assert(SliceEqCStr(obj.keys[1], "bar"));
-                assert(SliceEqCStr(obj.values[0], "2"));
-                assert(SliceEqCStr(obj.values[1], "qwer"));
+                assert(SliceEqCStr(obj.args[0].key, "foo"));
+                assert(SliceEqCStr(obj.args[1].key, "bar"));
+                assert(SliceEqCStr(obj.args[0].value, "2"));
+                assert(SliceEqCStr(obj.args[1].value, "qwer"));
+                assert(SliceEqCStr(SCFindArg(&obj, "bar"), "qwer"));
+                assert(IsNullSlice(SCFindArg(&obj, "ba")));
                 assert(SliceEqCStr(obj.block, "woop woop"));
             } else if (SliceEqCStr(obj.function_name, "derp")) {
                 assert(obj.has_block);
@@ -483,6 +1039,118 @@ void TEST_SCReader(void) {
     } while (obj.type != SCObjectType_End &&
              obj.type != SCObjectType_Error);
 
+    // The same file as a document
+    Arena      arena = AllocArena(MIN_ARENA_SIZE);
+    SCDocument doc;
+    reader = MakeSCReader(SliceFromCStr(test), "test_path", "test_file");
+    SCReadDocument(&reader, &arena, &doc);
+    assert(doc.count == ArrayCount(type_seq));
+
+    for (i = 0; i < doc.count; i++) {
+        SCGetDocumentObject(&doc, i, &obj);
+        assert((int)obj.type == type_seq[i]);
+        assert(obj.type != SCObjectType_Func || SliceEqCStr(obj.function_name, name_seq[i]));
+    }
+
+    SCGetDocumentObject(&doc, 7, &obj);
+    assert(obj.has_block && obj.args_count == 2);
+    assert(SliceEqCStr(SCFindArg(&obj, "bar"), "qwer"));
+    SCGetDocumentObject(&doc, 9, &obj);
+    assert(obj.has_block && obj.args_count == 0);
+
+    // Read in pieces, the document should come out the same. The second
+    // piece starts inside the \\herp block.
+    const char *pieces = "aaa\n\\foo\nbbb \\herp(x=1){\n\\derp\n}\n\\derp\nccc\n";
+    for (int threads = 2; threads <= 6; threads++) {
+        SCDocument parallel_doc;
+        reader = MakeSCReader(SliceFromCStr(pieces), "test_path", "test_file");
+        SCReadDocument(&reader, &arena, &doc);
+        reader = MakeSCReader(SliceFromCStr(pieces), "test_path", "test_file");
+        SCReadDocumentParallel(&reader, &arena, &parallel_doc, threads);
+
+        assert(parallel_doc.count == doc.count);
+        for (i = 0; i < doc.count; i++) {
+            assert(parallel_doc.types[i] == doc.types[i]);
+            assert(SliceCmp(parallel_doc.text[i], doc.text[i]) == 0);
+            assert(parallel_doc.args_begin[i + 1] == doc.args_begin[i + 1]);
+        }
+    }
+
+    reader = MakeSCReader(SliceFromCStr("herp \\derp(x=1) \\ derp"), "test_path", "test_file");
+    SCReadDocument(&reader, &arena, &doc);
+    assert(doc.count == 4 && doc.types[3] == SCObjectType_Error && doc.error_text);
+
+    // The same file streamed through a tiny window. The text comes out in
+    // more pieces, but everything else should be the same.
+    Arena window_arena = AllocArena(MIN_ARENA_SIZE);
+    FILE *stream       = tmpfile();
+    assert(stream);
+    fputs(test, stream);
+    rewind(stream);
+
+    reader = MakeSCStreamReader(stream, 8, &window_arena, "test_path", "test_file");
+    ArenaString text = ArenaBeginString(&arena);
+    i = 0;
+    do {
+        SCRead(&reader, &obj);
+        if (obj.type == SCObjectType_Text) {
+            ArenaPushSlice(&arena, obj.full_text);
+            continue;
+        }
+
+        while (type_seq[i] == SCObjectType_Text) { i++; }
+        assert((int)obj.type == type_seq[i]);
+        assert(obj.type != SCObjectType_Func || SliceEqCStr(obj.function_name, name_seq[i]));
+
+        if (obj.command == SCCommand_Unknown && SliceEqCStr(obj.function_name, "herp")) {
+            assert(SliceEqCStr(SCFindArg(&obj, "bar"), "qwer"));
+            assert(SliceEqCStr(obj.block, "woop woop"));
+        }
+        i++;
+    } while (obj.type != SCObjectType_End &&
+             obj.type != SCObjectType_Error);
+    Slice all_text = ArenaEndString(&arena, text);
+
+    reader = MakeSCReader(SliceFromCStr(test), "test_path", "test_file");
+    text   = ArenaBeginString(&arena);
+    do {
+        SCRead(&reader, &obj);
+        if (obj.type == SCObjectType_Text) { ArenaPushSlice(&arena, obj.full_text); }
+    } while (obj.type != SCObjectType_End);
+    assert(SliceCmp(all_text, ArenaEndString(&arena, text)) == 0);
+
+    // Errors past the first window should have the right location
+    const char *bad = "herp derp herp derp\nherp \\derp(x=1) \\ derp";
+    fclose(stream);
+    stream = tmpfile();
+    assert(stream);
+    fputs(bad, stream);
+    rewind(stream);
+    reader = MakeSCStreamReader(stream, 8, &window_arena, "test_path", "test_file");
+    do { SCRead(&reader, &obj); } while (obj.type == SCObjectType_Text || 
+                                         obj.type == SCObjectType_Func);
+    Slice stream_error = SCMakeErrorString(&obj, &arena, 0);
+
+    reader = MakeSCReader(SliceFromCStr(bad), "test_path", "test_file");
+    do { SCRead(&reader, &obj); } while (obj.type == SCObjectType_Text || 
+                                         obj.type == SCObjectType_Func);
+    assert(obj.type == SCObjectType_Error);
+    assert(SliceCmp(stream_error, SCMakeErrorString(&obj, &arena, 0)) == 0);
+    fclose(stream);
+    FreeArena(&window_arena);
+    FreeArena(&arena);
+
+    for (int command = 1; command < SCCommand_COUNT; command++) {
+        Slice name = SliceFromCStr(g_sc_command_name[command]);
+        assert(SCLookupCommand(name) == (SCCommand)command);
+    }
+    assert(SCLookupCommand(SliceFromCStr("iten")) == SCCommand_Unknown);
+
+    SCLocation location = SCFindLocation((char*)test, strstr(test, "\\derp"));
+    assert(location.line_no == 5 && location.column_no == 1);
+    location = SCFindLocation((char*)test, strstr(test, "zxcv"));
+    assert(location.line_no == 6 && location.column_no == 6);
+
     printf("Seems good.\n");
 } 
 #endif
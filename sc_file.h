@@ -4,6 +4,8 @@
 #include "common.h"
 #include "slice.h"
 #include "arena.h"
+#include <string.h>
+#include <stdio.h>
 
 // site.c File Format:
 //
@@ -66,26 +68,78 @@ static const char *g_sc_object_type_name[SCObjectType_COUNT] = {
     "Error",
 };
 
-typedef struct SCObject {
-    SCObjectType type;
+// Every command that some part of site.c understands. The reader looks the
+// function name up in this list, so the parsers can switch on the command
+// instead of comparing strings. Names that are not in the list come out as
+// SCCommand_Unknown.
+typedef enum SCCommand {
+    SCCommand_Unknown,
+
+    // Page commands (see SCToHTML)
+    SCCommand_Section,
+    SCCommand_Subsection,
+    SCCommand_Paragraph,
+    SCCommand_OrderedList,
+    SCCommand_UnorderedList,
+    SCCommand_HorizontalList,
+    SCCommand_Table,
+    SCCommand_Item,
+    SCCommand_Hitem,
+    SCCommand_Row,
+    SCCommand_Html,
+    SCCommand_Code,
+    SCCommand_Quote,
+    SCCommand_Bold,
+    SCCommand_Italic,
+    SCCommand_Inline,
+    SCCommand_Link,
+    SCCommand_Image,
+    SCCommand_Info,
+
+    // nav.sc and blog.sc commands
+    SCCommand_RootIsBlog,
+    SCCommand_Title,
+    SCCommand_Copyright,
+    SCCommand_Footer,
+    SCCommand_Nav,
 
-    // Position of the start of full_text
-    int          line_no;
-    int          column_no;
+    SCCommand_COUNT
+} SCCommand;
 
-    // Position of the end of full_text
-    int          end_line_no;
-    int          end_column_no;
+typedef struct SCLocation {
+    int line_no;
+    int column_no;
+} SCLocation;
+
+// A key = value argument of a function
+typedef struct SCArg {
+    Slice key;
+    Slice value;
+} SCArg;
+
+typedef struct SCObject {
+    SCObjectType type;
 
+    // The start of the file the object was read from. Line and column
+    // numbers are only worked out (from full_text) when an error message is
+    // made, see SCFindLocation.
+    //
+    // When streaming, file_begin is only the start of what is in memory, and
+    // begin_location says where it is in the file. (It's zero otherwise.)
+    char        *file_begin;
+    SCLocation   begin_location;
     Slice        full_text;
 
     // Function object data:
-    Slice  function_name;
-    Slice  keys  [SC_MAX_ARGS];
-    Slice  values[SC_MAX_ARGS];
-    int    args_count;
-    int    has_block;
-    Slice  block;
+    //
+    // NOTE: The arguments live in the SCReader, so most objects (plain
+    // text) stay small. They are only good until the next SCRead.
+    Slice     function_name;
+    SCCommand command;
+    SCArg    *args;
+    int       args_count;
+    int       has_block;
+    Slice     block;
 
     // Error string for SCObjectType_Error
     const char *error_text;
@@ -97,13 +151,30 @@ typedef struct SCObject {
 // language so you don't really need to separate lexing from parsing. It also
 // makes it easier to grab all the plain text out in big chunks.
 typedef struct SCReader {
-    int   line_no;
-    int   column_no;
     char *begin;
     char *current;
     char *end;
     const char *error;
 
+    // Arguments of the last function read
+    SCArg args[SC_MAX_ARGS];
+
+    // Object cache hooks (see sc_cache.h). While cached is set, objects are
+    // replayed from a cache file instead of being lexed. While record is
+    // set, the objects read are also recorded into it.
+    char  *cached;
+    Arena *record;
+
+    // Streaming (see MakeSCStreamReader). Only [begin, end) of the file is
+    // in memory, and the window is topped up from the stream as the reader
+    // gets near its end.
+    FILE      *stream;
+    Arena     *window_arena;
+    char      *window;
+    memsize    window_size;
+    int        stream_done;    // Nothing more to read
+    SCLocation begin_location; // Where begin is in the file
+
     // Only used when printing error messages
     const char *path;
     const char *file_name;
@@ -111,6 +182,23 @@ typedef struct SCReader {
 
 SCReader MakeSCReader(Slice text, const char *path, const char *file);
 
+// Makes a reader that reads the file a window at a time, so files bigger
+// than memory can be read. The window (window_size bytes to start with) is
+// allocated in the arena, which should not have a string open while reading,
+// since the window can grow. For the same reason, the arena should not be
+// restored to a point saved after the reader was made until it is done with.
+// 
+// Objects are the same as with a regular reader, except:
+// - Their slices are only good until the next SCRead, since the window
+//   moves on.
+// - Text runs longer than the window are split into several text objects.
+// - Functions longer than the window (ex: a huge \code block) can't be
+//   split, so the window doubles until they fit. 
+// 
+// Reading errors show up as an SCObjectType_Error.
+SCReader MakeSCStreamReader(FILE *stream, memsize window_size, Arena *arena, 
+                            const char *path, const char *file);
+
 // Read the next object from the SC file
 //
 // If an error occurs, an object of SCObjectType_Error is returned, and the
@@ -120,6 +208,75 @@ SCReader MakeSCReader(Slice text, const char *path, const char *file);
 // returned, and will be returned on all subsequent calls
 void SCRead(SCReader *r, SCObject *out);
 
+// A whole SC file, read up front into one set of arrays, one entry per
+// object. Anything that wants to look at a file more than once (ex: convert
+// it, and also find its info command) reads it into an SCDocument once, and
+// then walks the arrays, instead of driving a reader over it again.
+// 
+// NOTE: The arrays are split up by field so that loops over just the
+// types, or just the text, stay on a few cache lines. Most objects are plain
+// text, and don't care about names, blocks, or arguments.
+typedef struct SCDocument {
+    int      count;       // The last object is always End or Error
+    uint8_t *types;       // SCObjectType
+    uint8_t *commands;    // SCCommand
+    Slice   *text;        // full_text
+    Slice   *names;       // function_name, Func objects only
+    Slice   *blocks;      // Null slice if there is no block
+    int     *args_begin;  // Arguments of object i are args[args_begin[i]] up
+    SCArg   *args;        // to args[args_begin[i + 1]]
+
+    char       *file_begin;
+    const char *error_text; // If the last object is an error
+    const char *path;
+    const char *file_name;
+} SCDocument;
+
+// Reads the rest of the reader's file into an SCDocument, allocated in the
+// arena. The arena should not have a string open. Streaming readers can't
+// be read into a document, since their text doesn't stay put.
+void SCReadDocument(SCReader *r, Arena *arena, SCDocument *out);
+
+// Same as above, but splits the file up and reads the pieces on up to
+// `threads` threads at once, for very big files. The document comes out
+// the same as with SCReadDocument.
+// 
+// NOTE: The pieces start at guessed object boundaries (a function
+// call at the start of a line). A guess can be wrong, say inside a \code
+// block, so the pieces are stitched back together by following where a
+// serial read would have gone, and anything a bad guess got wrong is read
+// again.
+void SCReadDocumentParallel(SCReader *r, Arena *arena, SCDocument *out, int threads);
+
+// Fills in an SCObject for object i of a document. The arguments point
+// into the document, so they last as long as it does.
+void SCGetDocumentObject(SCDocument *doc, int i, SCObject *out);
+
+// Finds the value of the argument named key. If the key is given more than
+// once, the last one wins. Returns a null slice if there is no such argument.
+static inline
+Slice SCFindArg(SCObject *obj, const char *key) {
+    memsize key_length = strlen(key);
+
+    for (int i = obj->args_count - 1; i >= 0; i--) {
+        Slice k = obj->args[i].key;
+        if (SliceLength(k) == key_length && 
+            memcmp(k.begin, key, key_length) == 0) {
+            return obj->args[i].value;
+        }
+    }
+
+    return NullSlice();
+}
+
+// Works out the line and column (both starting at 1) of p in a file. This
+// rescans the file up to p, so it is meant for error messages.
+SCLocation SCFindLocation(char *file_begin, char *p);
+
+// The location of something at `offset` from `base` (ex: offset was found
+// with SCFindLocation from a point in the middle of the file, at base).
+SCLocation SCAddLocation(SCLocation base, SCLocation offset);
+
 // Convenience function to construct an error message with line number info. 
 // If error_text is null, uses the error from the SCObject.
 Slice SCMakeErrorString(SCObject *obj, Arena *arena, const char *error_text);
@@ -139,7 +296,7 @@ Slice SCMakeErrorString(SCObject *obj, Arena *arena, const char *error_text);
 // Convenience macro for handling cases when parsing an sc file
 // Checks to ensure that a command has a block, returns with error if not
 #define R_CheckSCObjectHasBlock(obj, name, arena, error_out_slice_ptr) \
-    if (!(obj.has_block)) {                                           \
+    if (!((obj).has_block)) {                                         \
         *(error_out_slice_ptr) = SCMakeErrorString(&(obj), (arena),   \
                                                    name " commands require a block"); \
         return 0;                                                     \
@@ -1,7 +1,16 @@
 #include "sc_to_html.h"
 #include "sc_file.h"
+#include "threads.h"
+#include "simd.h"
 #include <assert.h>
 #include <ctype.h>
+#include <string.h>
+
+// HTMLWriteEscapedText works through text this many bytes at a time
+#define HTML_ESCAPE_PIECE      4096
+
+// Longest thing a character gets escaped to ("&quot;")
+#define HTML_ESCAPE_MAX_LENGTH 6
 
 typedef enum HTMLTagType {
     HTMLTagType_Article,
@@ -27,38 +36,46 @@ typedef struct HTMLTagStack {
     Arena *arena;
 } HTMLTagStack;
 
-// Text used in <> brackets when opening a tag
-static const char *g_html_tag_type_open_text[HTMLTagType_COUNT] = {
-    "article",
-    "section",
-    "p",
-    "ol",
-    "ul",
-    "ul class=\"horizlist\"",
-    "div class=\"tablediv\"",
-    "table",
-    "li",
-    "tr",
-    "td",
-    "th",
-    "TOS",
+// A whole tag, ready to be pushed as is
+typedef struct HTMLTagText {
+    const char *text;
+    memsize     length;
+} HTMLTagText;
+
+#define HTML_TAG_TEXT(literal) {literal, sizeof(literal) - 1}
+
+// Opening tag for each tag type, newline included
+static const HTMLTagText g_html_tag_open[HTMLTagType_COUNT] = {
+    HTML_TAG_TEXT("<article>\n"),
+    HTML_TAG_TEXT("<section>\n"),
+    HTML_TAG_TEXT("<p>\n"),
+    HTML_TAG_TEXT("<ol>\n"),
+    HTML_TAG_TEXT("<ul>\n"),
+    HTML_TAG_TEXT("<ul class=\"horizlist\">\n"),
+    HTML_TAG_TEXT("<div class=\"tablediv\">\n"),
+    HTML_TAG_TEXT("<table>\n"),
+    HTML_TAG_TEXT("<li>\n"),
+    HTML_TAG_TEXT("<tr>\n"),
+    HTML_TAG_TEXT("<td>\n"),
+    HTML_TAG_TEXT("<th>\n"),
+    HTML_TAG_TEXT("<TOS>\n"),
 };
 
-// Text used in <> brackets when closing a tag
-static const char *g_html_tag_type_close_text[HTMLTagType_COUNT] = {
-    "article",
-    "section",
-    "p",
-    "ol",
-    "ul",
-    "ul",
-    "div",
-    "table",
-    "li",
-    "tr",
-    "td",
-    "th",
-    "TOS",
+// Closing tag for each tag type, newline included
+static const HTMLTagText g_html_tag_close[HTMLTagType_COUNT] = {
+    HTML_TAG_TEXT("</article>\n"),
+    HTML_TAG_TEXT("</section>\n"),
+    HTML_TAG_TEXT("</p>\n"),
+    HTML_TAG_TEXT("</ol>\n"),
+    HTML_TAG_TEXT("</ul>\n"),
+    HTML_TAG_TEXT("</ul>\n"),
+    HTML_TAG_TEXT("</div>\n"),
+    HTML_TAG_TEXT("</table>\n"),
+    HTML_TAG_TEXT("</li>\n"),
+    HTML_TAG_TEXT("</tr>\n"),
+    HTML_TAG_TEXT("</td>\n"),
+    HTML_TAG_TEXT("</th>\n"),
+    HTML_TAG_TEXT("</TOS>\n"),
 };
 
 static void InitHTMLTagStack(HTMLTagStack *s, Arena *arena);
@@ -75,16 +92,82 @@ static void HTMLRiseToLowestSection(HTMLTagStack *s);
 
 static void HTMLWriteAttribute(Slice key, Slice value, Arena *arena);
 
+// Writes all of a function's arguments as attributes, with the url argument
+// renamed to url_attribute (ex: href for links)
+static void HTMLWriteArguments(SCObject *obj, const char *url_attribute, Arena *arena);
+
 // Create a new section at the specified heading level, and with the given
 // heading text
 static void HTMLOpenSection(HTMLTagStack *s, int level, Slice heading);
 
-// Write escaped text wrapped in a tag
-static void HTMLWriteInTag(Slice text, const char *tag, Arena *arena);
+// Write escaped text wrapped in a tag. The tag has to be a string literal,
+// so the whole opening and closing tags are put together at compile time.
+#define HTMLWriteInTag(text, tag, arena)                \
+    do {                                                \
+        ArenaPushLiteral((arena), "<" tag ">\n");       \
+        HTMLWriteEscapedText((text), (arena));          \
+        ArenaPushLiteral((arena), "</" tag ">\n");      \
+    } while (0)
 
 // Close tags until you reach the section tag, then open a new one
 static void HTMLOpenTag(HTMLTagStack *s, HTMLTagType tag);
 
+// Everything the converter keeps track of between objects, so a file can be
+// converted all at once (SCDocumentToHTML) or a piece at a time
+// (SCToHTMLStreamNext)
+typedef struct SCToHTMLState {
+    HTMLTagStack tags;
+    SCInfo      *info;
+    int          found_info;
+
+    // Only set when making HTMLSpans. The HTML made in the arena since the
+    // last span is an open string starting at piece.
+    HTMLSpans   *spans;
+    int          spans_capacity;
+    ArenaString  piece;
+} SCToHTMLState;
+
+struct SCHTMLStream {
+    SCReader     *reader;
+    Arena        *arena;
+    memsize       chunk_size;
+    SCToHTMLState state;
+    int           started;
+    int           done;
+};
+
+// Opens the article tag
+static void SCToHTMLBegin(SCToHTMLState *s, Arena *arena, SCInfo *info);
+
+// Writes plain text
+static void SCToHTMLText(SCToHTMLState *s, Slice text, Arena *arena);
+
+// Writes any other object. Returns 0 with an error in out_error if the
+// object can't be converted.
+static int SCToHTMLObject(SCToHTMLState *s, SCObject *obj, Arena *arena, Slice *out_error);
+
+// Closes every tag that is still open
+static void SCToHTMLEnd(SCToHTMLState *s);
+
+// Writes a piece of the source that goes into the HTML as is. When making
+// spans, big pieces get a span of their own instead of being copied.
+static void SCToHTMLWriteSource(SCToHTMLState *s, Slice text, Arena *arena);
+
+// Starts / finishes the list of spans for objects [first, last) of a
+// document. Nothing else can be allocated in the arena in between. Without
+// make_spans, the HTML all goes in one span, which the caller can use as a
+// plain slice.
+static void SCToHTMLBeginSpans(SCToHTMLState *s, SCDocument *doc, int first, int last, 
+                               int make_spans, Arena *arena, HTMLSpans *spans);
+static void SCToHTMLEndSpans(SCToHTMLState *s, Arena *arena);
+
+// Finds the next character in [p, end) that HTMLWriteEscapedText replaces
+static char *HTMLFindEscape(char *p, char *end);
+
+// Converts objects [first, last) of a document
+static int SCToHTMLRange(SCToHTMLState *s, SCDocument *doc, int first, int last, 
+                         Arena *arena, Slice *out_error);
+
 // Converts the input sc file text into an html file.
 //
 // On success:
@@ -99,239 +182,577 @@ static void HTMLOpenTag(HTMLTagStack *s, HTMLTagType tag);
 //
 // path and file are just strings used when making an error
 // message, they are not opened/read
-int SCToHTML(Slice sc, const char *path, const char *file, Arena *arena, Slice *out_slice) {
+//
+// If info is not null, the title and date of the first \info command are
+// stored in it.
+int SCToHTML(Slice sc, const char *path, const char *file, Arena *arena, 
+             SCInfo *info, Slice *out_slice) {
+    SCReader   reader = MakeSCReader(sc, path, file);
+    SCDocument doc;
+    SCReadDocument(&reader, arena, &doc);
+    return SCDocumentToHTML(&doc, arena, info, out_slice);
+}
+
+int SCDocumentToHTML(SCDocument *doc, Arena *arena, SCInfo *info, Slice *out_slice) {
+    SCToHTMLState state = {0};
+    ArenaString   out_string = ArenaBeginString(arena);
+    SCToHTMLBegin(&state, arena, info);
+
+    if (!SCToHTMLRange(&state, doc, 0, doc->count, arena, out_slice)) { return 0; }
+
+    SCToHTMLEnd(&state);
+    *out_slice = ArenaEndString(arena, out_string);
+    return 1;
+}
+
+static int SCToHTMLRange(SCToHTMLState *s, SCDocument *doc, int first, int last, 
+                         Arena *arena, Slice *out_error) {
     SCObject obj = {0};
-    SCReader reader = MakeSCReader(sc, path, file);
-    HTMLTagStack tags = {0};
-    ArenaString out_string = ArenaBeginString(arena);
-    InitHTMLTagStack(&tags, arena);
-    HTMLPushTag(&tags, HTMLTagType_Article);
-
-    do {
-        SCRead(&reader, &obj);
-        switch (obj.type) {
-        R_HandleSCObjectTypeError(obj, arena, out_slice);
-        case SCObjectType_End: break;
-        default: break;
-
-        case SCObjectType_Text:
+
+    for (int i = first; i < last; i++) {
+        // NOTE: Plain text only needs its text, so the whole object is
+        // only pulled out of the document for everything else
+        if (doc->types[i] == SCObjectType_Text) {
+            SCToHTMLText(s, doc->text[i], arena);
+            continue;
+        }
+
+        SCGetDocumentObject(doc, i, &obj);
+        if (!SCToHTMLObject(s, &obj, arena, out_error)) { return 0; }
+    }
+
+    return 1;
+}
+
+// Objects [first, last) of a document being converted by
+// SCDocumentToHTMLPieces
+typedef struct SCHTMLChunk {
+    SCDocument   *doc;
+    int           first;
+    int           last;
+    int           make_spans;
+    SCToHTMLState state;
+    Arena         arena;
+    HTMLSpans     spans;
+    Slice         error;
+    int           ok;
+} SCHTMLChunk;
+
+static void SCToHTMLChunkThread(void *data, int index) {
+    SCHTMLChunk *chunk = (SCHTMLChunk*)data + index;
+    chunk->arena            = AllocArena(ARENA_SIZE);
+    chunk->state.tags.arena = &chunk->arena;
+
+    SCToHTMLBeginSpans(&chunk->state, chunk->doc, chunk->first, chunk->last, 
+                       chunk->make_spans, &chunk->arena, &chunk->spans);
+    chunk->ok = SCToHTMLRange(&chunk->state, chunk->doc, chunk->first, chunk->last,
+                              &chunk->arena, &chunk->error);
+
+    // Every chunk but the last is followed by a \section, which would start
+    // by closing everything down to the article
+    if (chunk->ok && chunk->last == chunk->doc->count) {
+        SCToHTMLEnd(&chunk->state);
+    } else if (chunk->ok) {
+        while (chunk->state.tags.section_depth > 1) { HTMLPopTag(&chunk->state.tags); }
+    }
+
+    SCToHTMLEndSpans(&chunk->state, &chunk->arena);
+}
+
+// The first object that starts at or after p
+static int SCFindDocumentObject(SCDocument *doc, char *p) {
+    int low = 0, high = doc->count;
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (doc->text[mid].begin < p) { low = mid + 1; } else { high = mid; }
+    }
+
+    return low;
+}
+
+// NOTE: A \section closes everything down to the article, and then
+// opens a section, so what comes after one doesn't depend on much of what
+// came before. The one catch is that anything left open before the first
+// section (ex: an implicit paragraph) stays open under every section after
+// it. So everything up to the first section is converted here first, and
+// the rest is split up at sections, with every piece starting from the
+// state that leaves. (An \info after the first section is always an
+// error, so the pieces don't need to fill in info either.)
+static int SCDocumentToHTMLPieces(SCDocument *doc, Arena *arena, SCInfo *info, int threads,
+                                  int make_spans, HTMLSpans *out, Slice *out_error) {
+    int first_section = 0;
+    while (first_section < doc->count && 
+           (doc->types[first_section] != SCObjectType_Func ||
+            (doc->commands[first_section] != SCCommand_Section &&
+             doc->commands[first_section] != SCCommand_Subsection))) {
+        first_section++;
+    }
+
+    if (threads < 2) { first_section = doc->count; }
+
+    SCToHTMLState state = {0};
+    SCToHTMLBeginSpans(&state, doc, 0, doc->count, make_spans, arena, out);
+    SCToHTMLBegin(&state, arena, info);
+    if (!SCToHTMLRange(&state, doc, 0, first_section, arena, out_error)) { 
+        SCToHTMLEndSpans(&state, arena);
+        return 0; 
+    }
+
+    if (first_section == doc->count) {
+        SCToHTMLEnd(&state);
+        SCToHTMLEndSpans(&state, arena);
+        return 1;
+    }
+
+    state.info = 0;
+
+    // Split the rest up at sections, about evenly by size
+    SCHTMLChunk chunks[MAX_THREADS];
+    int         chunks_count = 0;
+    char       *begin        = doc->text[first_section].begin;
+    memsize     size         = (memsize)(doc->text[doc->count - 1].end - begin);
+    if (threads > MAX_THREADS) { threads = MAX_THREADS; }
+
+    for (int i = 0; i < threads; i++) {
+        int first = first_section;
+        if (i) {
+            first = SCFindDocumentObject(doc, begin + size / threads * i);
+            while (first < doc->count && 
+                   (doc->types[first] != SCObjectType_Func ||
+                    doc->commands[first] != SCCommand_Section)) { 
+                first++; 
+            }
+
+            if (first == doc->count || first <= chunks[chunks_count - 1].first) { continue; }
+            chunks[chunks_count - 1].last = first;
+        }
+
+        SCHTMLChunk *chunk = &chunks[chunks_count++];
+        memset(chunk, 0, sizeof(*chunk));
+        chunk->doc        = doc;
+        chunk->first      = first;
+        chunk->last       = doc->count;
+        chunk->make_spans = make_spans;
+        chunk->state      = state;
+    }
+
+    RunParallel(SCToHTMLChunkThread, chunks, chunks_count);
+
+    // The HTML the chunks made is copied after what is already here, and the
+    // pieces of source they point to get spans of their own again
+    int ok = 1;
+    for (int i = 0; i < chunks_count && ok; i++) {
+        HTMLSpans *spans = &chunks[i].spans;
+        if (!chunks[i].ok) {
+            SCToHTMLEndSpans(&state, arena);
+            *out_error = ArenaPushSlice(arena, chunks[i].error);
+            ok = 0;
+            break;
+        }
+
+        for (int j = 0; j < spans->count; j++) {
+            if (j & 1) {
+                SCToHTMLWriteSource(&state, spans->spans[j], arena);
+            } else {
+                ArenaPushSlice(arena, spans->spans[j]);
+            }
+        }
+    }
+
+    for (int i = 0; i < chunks_count; i++) { FreeArena(&chunks[i].arena); }
+
+    if (ok) { SCToHTMLEndSpans(&state, arena); }
+    return ok;
+}
+
+int SCDocumentToHTMLParallel(SCDocument *doc, Arena *arena, SCInfo *info, int threads,
+                             Slice *out_slice) {
+    HTMLSpans html;
+    if (!SCDocumentToHTMLPieces(doc, arena, info, threads, 0, &html, out_slice)) { return 0; }
+    *out_slice = html.spans[0];
+    return 1;
+}
+
+int SCDocumentToHTMLSpans(SCDocument *doc, Arena *arena, SCInfo *info, int threads,
+                          HTMLSpans *out, Slice *out_error) {
+    return SCDocumentToHTMLPieces(doc, arena, info, threads, 1, out, out_error);
+}
+
+SCHTMLStream *BeginSCToHTMLStream(SCReader *reader, memsize chunk_size, 
+                                  Arena *arena, SCInfo *info) {
+    assert(arena != reader->window_arena && "The window needs an arena of its own");
+    ArenaAlign(arena, sizeof(void*));
+    SCHTMLStream *s = ArenaPush(arena, SCHTMLStream);
+    *s = (SCHTMLStream) {0};
+    s->reader     = reader;
+    s->arena      = arena;
+    s->chunk_size = chunk_size;
+    s->state.info = info;
+    return s;
+}
+
+int SCToHTMLStreamNext(SCHTMLStream *s, Slice *out_slice, int *out_done) {
+    Arena      *arena = s->arena;
+    ArenaString chunk = ArenaBeginString(arena);
+    SCObject    obj;
+
+    // NOTE: The article tag is opened here instead of in
+    // BeginSCToHTMLStream, so that it ends up in the first chunk
+    if (!s->started) {
+        SCToHTMLBegin(&s->state, arena, s->state.info);
+        s->started = 1;
+    }
+
+    while (!s->done && ArenaStringLength(arena, chunk) < s->chunk_size) {
+        int had_info = s->state.found_info;
+        SCRead(s->reader, &obj);
+
+        if (!SCToHTMLObject(&s->state, &obj, arena, out_slice)) { 
+            ArenaEndString(arena, chunk);
+            return 0; 
+        }
+
+        if (obj.type == SCObjectType_End) {
+            SCToHTMLEnd(&s->state);
+            s->done = 1;
+        } else if (!had_info && s->state.found_info) {
+            // The info slices point into the reader's window, so hand them
+            // back before the next read moves it
+            break;
+        }
+    }
+
+    *out_done  = s->done;
+    *out_slice = ArenaEndString(arena, chunk);
+    return 1;
+}
+
+int SCToHTMLStreamFoundInfo(SCHTMLStream *s) {
+    return s->state.found_info;
+}
+
+static void SCToHTMLBegin(SCToHTMLState *s, Arena *arena, SCInfo *info) {
+    InitHTMLTagStack(&s->tags, arena);
+    s->info       = info;
+    s->found_info = 0;
+
+    if (info) { *info = (SCInfo) {0}; }
+    HTMLPushTag(&s->tags, HTMLTagType_Article);
+}
+
+static void SCToHTMLText(SCToHTMLState *s, Slice text, Arena *arena) {
+    // Open up an implicit paragraph if we start putting text right after a
+    // section or article tag
+    if ((HTMLTop(&s->tags) == HTMLTagType_Article ||
+        HTMLTop(&s->tags) == HTMLTagType_Section) &&
+        !IsAllWhitespace(text)) {
+        HTMLPushTag(&s->tags, HTMLTagType_Paragraph);
+    }
+
+    HTMLWriteEscapedText(text, arena);
+}
+
+static int SCToHTMLObject(SCToHTMLState *s, SCObject *obj, Arena *arena, Slice *out_error) {
+    switch (obj->type) {
+    R_HandleSCObjectTypeError(*obj, arena, out_error);
+    case SCObjectType_End: break;
+    default: break;
+
+    case SCObjectType_Text:
+    {
+        SCToHTMLText(s, obj->full_text, arena);
+    } break;
+
+    case SCObjectType_Backslash:
+    {
+        // Open up an implicit paragraph if we start putting text right after a
+        // section or article tag
+        if (HTMLTop(&s->tags) == HTMLTagType_Article ||
+            HTMLTop(&s->tags) == HTMLTagType_Section) {
+            HTMLPushTag(&s->tags, HTMLTagType_Paragraph);
+        }
+
+        ArenaPushChar(arena, '\\');
+    } break;
+
+    case SCObjectType_Func:
+    {
+        // NOTE: The reader has already looked the name up, see
+        // SCLookupCommand
+        switch (obj->command) {
+        case SCCommand_Section:
+        {
+            R_CheckSCObjectHasBlock(*obj, "section", arena, out_error);
+            HTMLOpenSection(&s->tags, 2, obj->block);
+        } break;
+
+        case SCCommand_Subsection:
+        {
+            R_CheckSCObjectHasBlock(*obj, "subsection", arena, out_error);
+            HTMLOpenSection(&s->tags, 3, obj->block);
+        } break;
+
+        case SCCommand_Paragraph:
+        {
+            HTMLOpenTag(&s->tags, HTMLTagType_Paragraph);
+        } break;
+
+        case SCCommand_OrderedList:
+        {
+            HTMLOpenTag(&s->tags, HTMLTagType_OrderedList);
+        } break;
+
+        case SCCommand_UnorderedList:
+        {
+            HTMLOpenTag(&s->tags, HTMLTagType_UnorderedList);
+        } break;
+
+        case SCCommand_HorizontalList:
+        {
+            HTMLOpenTag(&s->tags, HTMLTagType_HorizontalList);
+        } break;
+
+        case SCCommand_Table:
+        {
+            HTMLOpenTag(&s->tags, HTMLTagType_TableDiv);
+            HTMLPushTag(&s->tags, HTMLTagType_Table);
+
+            if (obj->has_block) {
+                HTMLWriteInTag(obj->block, "caption", arena);
+            }
+        } break;
+
+        case SCCommand_Item:
         {
-            // Open up an implicit paragraph if we start putting text right after a
-            // section or article tag
-            if ((HTMLTop(&tags) == HTMLTagType_Article ||
-                HTMLTop(&tags) == HTMLTagType_Section) &&
-                !IsAllWhitespace(obj.full_text)) {
-                HTMLPushTag(&tags, HTMLTagType_Paragraph);
+            if (HTMLTop(&s->tags) == HTMLTagType_ListItem    ||
+                HTMLTop(&s->tags) == HTMLTagType_TableColumn ||
+                HTMLTop(&s->tags) == HTMLTagType_TableHeadingColumn) {
+                HTMLPopTag(&s->tags); 
             }
 
-            HTMLWriteEscapedText(obj.full_text, arena);
+            HTMLTagType top = HTMLTop(&s->tags);
+            if (top != HTMLTagType_UnorderedList  &&
+                top != HTMLTagType_OrderedList    &&
+                top != HTMLTagType_HorizontalList &&
+                top != HTMLTagType_TableRow) {
+                *out_error = SCMakeErrorString(obj, arena, 
+                    "You can only open an \\item in a table row or list");
+                return 0;
+            } else if (top == HTMLTagType_TableRow) {
+                HTMLPushTag(&s->tags, HTMLTagType_TableColumn);
+            } else {
+                HTMLPushTag(&s->tags, HTMLTagType_ListItem);
+            }
         } break;
 
-        case SCObjectType_Backslash:
+        case SCCommand_Hitem:
         {
-            // Open up an implicit paragraph if we start putting text right after a
-            // section or article tag
-            if (HTMLTop(&tags) == HTMLTagType_Article ||
-                HTMLTop(&tags) == HTMLTagType_Section) {
-                HTMLPushTag(&tags, HTMLTagType_Paragraph);
+            if (HTMLTop(&s->tags) == HTMLTagType_TableColumn ||
+                HTMLTop(&s->tags) == HTMLTagType_TableHeadingColumn) {
+                HTMLPopTag(&s->tags); 
+            }
+
+            HTMLTagType top = HTMLTop(&s->tags);
+            if (top != HTMLTagType_TableRow) {
+                *out_error = SCMakeErrorString(obj, arena, 
+                    "You can only open an \\hitem in a table row");
+                return 0;
             }
 
-            ArenaPushChar(arena, '\\');
+            HTMLPushTag(&s->tags, HTMLTagType_TableHeadingColumn);
         } break;
 
-        case SCObjectType_Func:
+        case SCCommand_Row:
         {
-            // NOTE(eric): Pro-Tip: If this gets too big, it should become a cstr -> function
-            // pointer table...
-            if (SliceEqCStr(obj.function_name, "section")) {
-                R_CheckSCObjectHasBlock(obj, "section", arena, out_slice);
-                HTMLOpenSection(&tags, 2, obj.block);
-            } else if (SliceEqCStr(obj.function_name, "subsection")) {
-                R_CheckSCObjectHasBlock(obj, "subsection", arena, out_slice);
-                HTMLOpenSection(&tags, 3, obj.block);
-            } else if (SliceEqCStr(obj.function_name, "paragraph")) {
-                HTMLOpenTag(&tags, HTMLTagType_Paragraph);
-            } else if (SliceEqCStr(obj.function_name, "ordered_list")) {
-                HTMLOpenTag(&tags, HTMLTagType_OrderedList);
-            } else if (SliceEqCStr(obj.function_name, "unordered_list")) {
-                HTMLOpenTag(&tags, HTMLTagType_UnorderedList);
-            } else if (SliceEqCStr(obj.function_name, "horizontal_list")) {
-                HTMLOpenTag(&tags, HTMLTagType_HorizontalList);
-            } else if (SliceEqCStr(obj.function_name, "table")) {
-                HTMLOpenTag(&tags, HTMLTagType_TableDiv);
-                HTMLPushTag(&tags, HTMLTagType_Table);
-
-                if (obj.has_block) {
-                    HTMLWriteInTag(obj.block, "caption", arena);
-                }
-            } else if (SliceEqCStr(obj.function_name, "item")) {
-                if (HTMLTop(&tags) == HTMLTagType_ListItem    ||
-                    HTMLTop(&tags) == HTMLTagType_TableColumn ||
-                    HTMLTop(&tags) == HTMLTagType_TableHeadingColumn) {
-                    HTMLPopTag(&tags);
-                }
+            if (HTMLTop(&s->tags) == HTMLTagType_TableHeadingColumn ||
+                HTMLTop(&s->tags) == HTMLTagType_TableColumn) {
+                HTMLPopTag(&s->tags); 
+            }
 
-                HTMLTagType top = HTMLTop(&tags);
-                if (top != HTMLTagType_UnorderedList  &&
-                    top != HTMLTagType_OrderedList    &&
-                    top != HTMLTagType_HorizontalList &&
-                    top != HTMLTagType_TableRow) {
-                    *out_slice = SCMakeErrorString(&obj, arena,
-                        "You can only open an \\item in a table row or list");
-                    return 0;
-                } else if (top == HTMLTagType_TableRow) {
-                    HTMLPushTag(&tags, HTMLTagType_TableColumn);
+            if (HTMLTop(&s->tags) == HTMLTagType_TableRow) { 
+                HTMLPopTag(&s->tags); 
+            }
+
+            if (HTMLTop(&s->tags) != HTMLTagType_Table) { 
+                *out_error = SCMakeErrorString(obj, arena, 
+                                  "You can only open a \\row in a table");
+                return 0;
+            }
+
+            HTMLPushTag(&s->tags, HTMLTagType_TableRow);
+        } break;
+
+        case SCCommand_Html:
+        {
+            R_CheckSCObjectHasBlock(*obj, "html", arena, out_error);
+            HTMLRiseToLowestSection(&s->tags);
+            SCToHTMLWriteSource(s, obj->block, arena);
+        } break;
+
+        case SCCommand_Code:
+        {
+            R_CheckSCObjectHasBlock(*obj, "code", arena, out_error);
+            HTMLRiseToLowestSection(&s->tags);
+            ArenaPushLiteral(arena, "<pre><code>");
+            Slice text = obj->block;
+
+            // Need to get rid of the first newline, ie:
+            // \code{
+            // FunctionCall();
+            // }
+            // There is a newline there before "FunctionCall". If not
+            // removed, it will be shown since code uses a pre block.
+            while (text.begin != text.end) {
+                if (*text.begin == '\n') {
+                    text.begin++; // Move one past first newline
+                    break;
                 } else {
-                    HTMLPushTag(&tags, HTMLTagType_ListItem);
-                }
-            } else if (SliceEqCStr(obj.function_name, "hitem")) {
-                if (HTMLTop(&tags) == HTMLTagType_TableColumn ||
-                    HTMLTop(&tags) == HTMLTagType_TableHeadingColumn) {
-                    HTMLPopTag(&tags);
+                    text.begin++;
                 }
+            }
 
-                HTMLTagType top = HTMLTop(&tags);
-                if (top != HTMLTagType_TableRow) {
-                    *out_slice = SCMakeErrorString(&obj, arena,
-                        "You can only open an \\hitem in a table row");
-                    return 0;
-                }
+            // Code without anything to escape can go out as is
+            if (s->spans && SliceLength(obj->block) >= HTML_SPAN_MIN_SIZE &&
+                HTMLFindEscape(obj->block.begin, obj->block.end) == obj->block.end) {
+                SCToHTMLWriteSource(s, obj->block, arena);
+            } else {
+                HTMLWriteEscapedText(obj->block, arena);
+            }
+            ArenaPushLiteral(arena, "</code></pre>\n");
+        } break;
 
-                HTMLPushTag(&tags, HTMLTagType_TableHeadingColumn);
-            } else if (SliceEqCStr(obj.function_name, "row")) {
-                if (HTMLTop(&tags) == HTMLTagType_TableHeadingColumn ||
-                    HTMLTop(&tags) == HTMLTagType_TableColumn) {
-                    HTMLPopTag(&tags); 
-                }
+        case SCCommand_Quote:
+        {
+            R_CheckSCObjectHasBlock(*obj, "quote", arena, out_error);
+            HTMLRiseToLowestSection(&s->tags);
+            HTMLWriteInTag(obj->block, "blockquote", arena);
+        } break;
 
-                if (HTMLTop(&tags) == HTMLTagType_TableRow) { 
-                    HTMLPopTag(&tags); 
-                }
+        case SCCommand_Bold:
+        {
+            R_CheckSCObjectHasBlock(*obj, "bold", arena, out_error);
+            HTMLWriteInTag(obj->block, "b", arena);
+        } break;
 
-                if (HTMLTop(&tags) != HTMLTagType_Table) { 
-                    *out_slice = SCMakeErrorString(&obj, arena, 
-                                      "You can only open a \\row in a table");
-                    return 0;
-                }
+        case SCCommand_Italic:
+        {
+            R_CheckSCObjectHasBlock(*obj, "italic", arena, out_error);
+            HTMLWriteInTag(obj->block, "i", arena);
+        } break;
 
-                HTMLPushTag(&tags, HTMLTagType_TableRow);
-            } else if (SliceEqCStr(obj.function_name, "html")) {
-                R_CheckSCObjectHasBlock(obj, "html", arena, out_slice);
-                HTMLRiseToLowestSection(&tags);
-                ArenaPushSlice(arena, obj.block);
-            } else if (SliceEqCStr(obj.function_name, "code")) {
-                R_CheckSCObjectHasBlock(obj, "code", arena, out_slice);
-                HTMLRiseToLowestSection(&tags);
-                ArenaPushCStr(arena, "<pre><code>");
-                Slice text = obj.block;
-
-                // Need to get rid of the first newline, ie:
-                // \code{
-                // FunctionCall();
-                // }
-                // There is a newline there before "FunctionCall". If not
-                // removed, it will be shown since code uses a pre block.
-                while (text.begin != text.end) {
-                    if (*text.begin == '\n') {
-                        text.begin++; // Move one past first newline
-                        break;
-                    } else {
-                        text.begin++;
-                    }
-                }
+        case SCCommand_Inline:
+        {
+            R_CheckSCObjectHasBlock(*obj, "inline", arena, out_error);
+            HTMLWriteInTag(obj->block, "code", arena);
+        } break;
 
-                HTMLWriteEscapedText(obj.block, arena);
-                ArenaPushCStr(arena, "</code></pre>\n");
-            } else if (SliceEqCStr(obj.function_name, "quote")) {
-                R_CheckSCObjectHasBlock(obj, "quote", arena, out_slice);
-                HTMLRiseToLowestSection(&tags);
-                HTMLWriteInTag(obj.block, "blockquote", arena);
-            } else if (SliceEqCStr(obj.function_name, "bold")) {
-                R_CheckSCObjectHasBlock(obj, "bold", arena, out_slice);
-                HTMLWriteInTag(obj.block, "b", arena);
-            } else if (SliceEqCStr(obj.function_name, "italic")) {
-                R_CheckSCObjectHasBlock(obj, "italic", arena, out_slice);
-                HTMLWriteInTag(obj.block, "i", arena);
-            } else if (SliceEqCStr(obj.function_name, "inline")) {
-                R_CheckSCObjectHasBlock(obj, "inline", arena, out_slice);
-                HTMLWriteInTag(obj.block, "code", arena);
-            } else if (SliceEqCStr(obj.function_name, "link")) {
-                R_CheckSCObjectHasBlock(obj, "link", arena, out_slice);
-
-                int found_url = 0;
-                ArenaPushCStr(arena, "<a");
-
-                for (int i = 0; i < obj.args_count; i++) {
-                    if (SliceEqCStr(obj.keys[i], "url")) {
-                        found_url = 1;
-                        HTMLWriteAttribute(SliceFromCStr("href"), obj.values[i], arena);
-                    } else {
-                        HTMLWriteAttribute(obj.keys[i], obj.values[i], arena);
-                    }
-                }
+        case SCCommand_Link:
+        {
+            R_CheckSCObjectHasBlock(*obj, "link", arena, out_error);
 
-                if (!found_url) {
-                    *out_slice = SCMakeErrorString(&obj, arena,
-                                     "Missing required url parameter in link");
-                    return 0;
-                }
+            if (IsNullSlice(SCFindArg(obj, "url"))) {
+                *out_error = SCMakeErrorString(obj, arena, 
+                                 "Missing required url parameter in link");
+                return 0;
+            }
 
-                ArenaPushCStr(arena, ">");
-                HTMLWriteEscapedText(obj.block, arena);
-                ArenaPushCStr(arena, "</a>");
-            } else if (SliceEqCStr(obj.function_name, "image")) {
-                int found_url = 0;
-                HTMLRiseToLowestSection(&tags);
-                ArenaPushCStr(arena, "<img");
-
-                for (int i = 0; i < obj.args_count; i++) {
-                    if (SliceEqCStr(obj.keys[i], "url")) {
-                        found_url = 1; 
-                        HTMLWriteAttribute(SliceFromCStr("src"), obj.values[i], arena);
-                    } else {
-                        HTMLWriteAttribute(obj.keys[i], obj.values[i], arena);
-                    }
-                }
+            ArenaPushLiteral(arena, "<a");
+            HTMLWriteArguments(obj, "href", arena);
+            ArenaPushLiteral(arena, ">");
+            HTMLWriteEscapedText(obj->block, arena);
+            ArenaPushLiteral(arena, "</a>");
+        } break;
 
-                if (!found_url) {
-                    *out_slice = SCMakeErrorString(&obj, arena,
-                                     "Missing required url parameter in image");
-                    return 0;
-                }
+        case SCCommand_Image:
+        {
+            if (IsNullSlice(SCFindArg(obj, "url"))) {
+                *out_error = SCMakeErrorString(obj, arena, 
+                                 "Missing required url parameter in image");
+                return 0;
+            }
 
-                ArenaPushCStr(arena, ">\n");
-            } else if (SliceEqCStr(obj.function_name, "info")) {
-                HTMLRiseToLowestSection(&tags);
+            HTMLRiseToLowestSection(&s->tags);
+            ArenaPushLiteral(arena, "<img");
+            HTMLWriteArguments(obj, "src", arena);
+            ArenaPushLiteral(arena, ">\n");
+        } break;
 
-                if (HTMLTop(&tags) != HTMLTagType_Article) {
-                    *out_slice = SCMakeErrorString(&obj, arena,
-                               "Info command should be at the beginning of the file");
-                    return 0;
-                }
+        case SCCommand_Info:
+        {
+            if (s->info && !s->found_info) {
+                s->info->title = SCFindArg(obj, "title");
+                s->info->date  = SCFindArg(obj, "date");
+            }
+            s->found_info = 1;
 
-                for (int i = 0; i < obj.args_count; i++) {
-                    if (!SliceEqCStr(obj.keys[i], "title")) { continue; }
-                    HTMLWriteInTag(obj.values[i], "h1", arena);
-                }
-            } else {
-                *out_slice = SCMakeErrorString(&obj, arena, "Unknown command");
+            HTMLRiseToLowestSection(&s->tags);
+
+            if (HTMLTop(&s->tags) != HTMLTagType_Article) {
+                *out_error = SCMakeErrorString(obj, arena, 
+                           "Info command should be at the beginning of the file");
                 return 0;
             }
+
+            Slice title = SCFindArg(obj, "title");
+            if (!IsNullSlice(title)) {
+                HTMLWriteInTag(title, "h1", arena);
+            }
         } break;
-        }
-    } while (obj.type != SCObjectType_End &&
-             obj.type != SCObjectType_Error);
 
-    while (HTMLTop(&tags) != HTMLTagType_TOS) {
-        HTMLPopTag(&tags);
+        default:
+        {
+            *out_error = SCMakeErrorString(obj, arena, "Unknown command");
+            return 0; 
+        } break;
+        }
+    } break;
     }
 
-    *out_slice = ArenaEndString(arena, out_string);
     return 1;
 }
 
+static void SCToHTMLEnd(SCToHTMLState *s) {
+    while (HTMLTop(&s->tags) != HTMLTagType_TOS) {
+        HTMLPopTag(&s->tags);
+    }
+}
 
+static void SCToHTMLWriteSource(SCToHTMLState *s, Slice text, Arena *arena) {
+    if (!s->spans || SliceLength(text) < HTML_SPAN_MIN_SIZE || 
+        s->spans->count + 2 >= s->spans_capacity) {
+        ArenaPushSlice(arena, text);
+        return;
+    }
 
+    s->spans->spans[s->spans->count++] = ArenaEndString(arena, s->piece);
+    s->spans->spans[s->spans->count++] = text;
+    s->piece = ArenaBeginString(arena);
+}
+
+static void SCToHTMLBeginSpans(SCToHTMLState *s, SCDocument *doc, int first, int last, 
+                               int make_spans, Arena *arena, HTMLSpans *spans) {
+    // Every piece of source that could get a span is followed by more HTML
+    int capacity = 1;
+    for (int i = first; i < last && make_spans; i++) {
+        if (doc->types[i] == SCObjectType_Func &&
+            (doc->commands[i] == SCCommand_Html || doc->commands[i] == SCCommand_Code) &&
+            SliceLength(doc->blocks[i]) >= HTML_SPAN_MIN_SIZE) {
+            capacity += 2;
+        }
+    }
+
+    ArenaAlign(arena, sizeof(void*));
+    spans->spans      = ArenaPushMany(arena, Slice, capacity);
+    spans->count      = 0;
+    s->spans          = spans;
+    s->spans_capacity = capacity;
+    s->piece          = ArenaBeginString(arena);
+}
+
+static void SCToHTMLEndSpans(SCToHTMLState *s, Arena *arena) {
+    s->spans->spans[s->spans->count++] = ArenaEndString(arena, s->piece);
+    s->spans = 0;
+}
 
 static HTMLTagType HTMLTop(HTMLTagStack *s) { 
     return s->stack[s->tag_pos]; 
@@ -347,7 +768,7 @@ static void InitHTMLTagStack(HTMLTagStack *s, Arena *arena) {
 // Push a tag and print the opening tag
 static void HTMLPushTag(HTMLTagStack *s, HTMLTagType tag) {
     assert(s->tag_pos + 1 < SC_HTML_MAX_TAG_DEPTH);
-    ArenaPushf(s->arena, "<%s>\n", g_html_tag_type_open_text[tag]);
+    ArenaPushData(s->arena, (char*)g_html_tag_open[tag].text, g_html_tag_open[tag].length);
     s->stack[++s->tag_pos] = tag;
 
     // The number of sections is tracked so that subsection/section can
@@ -362,7 +783,7 @@ static void HTMLPushTag(HTMLTagStack *s, HTMLTagType tag) {
 static HTMLTagType HTMLPopTag(HTMLTagStack *s) {
     assert(s->tag_pos > 0);
     HTMLTagType tag = s->stack[s->tag_pos--];
-    ArenaPushf(s->arena, "</%s>\n", g_html_tag_type_close_text[tag]);
+    ArenaPushData(s->arena, (char*)g_html_tag_close[tag].text, g_html_tag_close[tag].length);
 
     // The number of sections is tracked so that subsection/section can
     // find the right place in the stack to rise to before pushing their tag
@@ -382,31 +803,124 @@ static void HTMLRiseToLowestSection(HTMLTagStack *s) {
     }
 }
 
-// NOTE(eric): This escape function only contains characters I've actually
-// used.
+// Finds the next character in [p, end) that HTMLWriteEscapedText replaces
+//
+// NOTE: Same idea as SCScanUntil2: compare 32 (AVX2) or 16 (SSE2)
+// bytes at a time against every special character, and finish off with the
+// plain loop. Most prose has none of them, so this mostly just runs.
+static char *HTMLFindEscape(char *p, char *end) {
+#if SIMD_AVX2
+    __m256i quote_32      = _mm256_set1_epi8('"');
+    __m256i amp_32        = _mm256_set1_epi8('&');
+    __m256i apostrophe_32 = _mm256_set1_epi8('\'');
+    __m256i less_32       = _mm256_set1_epi8('<');
+    __m256i greater_32    = _mm256_set1_epi8('>');
+
+    for (; end - p >= 32; p += 32) {
+        __m256i chunk = _mm256_loadu_si256((const __m256i*)p);
+        __m256i found = _mm256_or_si256(
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, quote_32),
+                            _mm256_cmpeq_epi8(chunk, amp_32)),
+            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, apostrophe_32),
+                            _mm256_or_si256(_mm256_cmpeq_epi8(chunk, less_32),
+                                            _mm256_cmpeq_epi8(chunk, greater_32))));
+
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(found);
+        if (mask) { return p + CountTrailingZeros32(mask); }
+    }
+#endif
+
+#if SIMD_SSE2
+    __m128i quote_16      = _mm_set1_epi8('"');
+    __m128i amp_16        = _mm_set1_epi8('&');
+    __m128i apostrophe_16 = _mm_set1_epi8('\'');
+    __m128i less_16       = _mm_set1_epi8('<');
+    __m128i greater_16    = _mm_set1_epi8('>');
+
+    for (; end - p >= 16; p += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i*)p);
+        __m128i found = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, quote_16),
+                         _mm_cmpeq_epi8(chunk, amp_16)),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk, apostrophe_16),
+                         _mm_or_si128(_mm_cmpeq_epi8(chunk, less_16),
+                                      _mm_cmpeq_epi8(chunk, greater_16))));
+
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(found);
+        if (mask) { return p + CountTrailingZeros32(mask); }
+    }
+#endif
+
+    while (p < end && *p != '"' && *p != '&' && *p != '\'' && *p != '<' && *p != '>') {
+        p++;
+    }
+
+    return p;
+}
+
 // Writes text to the arena, escaping html special characters
+//
+// NOTE: The text goes out in pieces of HTML_ESCAPE_PIECE bytes. Room
+// for the worst case (every byte escaped) is reserved up front for each
+// piece, so clean runs can be memcpy'd straight in without any checks, and
+// only what was actually written gets pushed.
 void HTMLWriteEscapedText(Slice text, Arena *arena) {
-    while (text.begin != text.end) {
-        switch (*text.begin) {
-        case '"': ArenaPushCStr(arena, "&quot;"); break;
-        case '&': ArenaPushCStr(arena, "&amp;"); break;
-        case '<': ArenaPushCStr(arena, "&lt;"); break;
-        case '>': ArenaPushCStr(arena, "&gt;"); break;
-        default: ArenaPushChar(arena, *text.begin); break;
+    char *p = text.begin;
+
+    while (p < text.end) {
+        char *piece_end = p + HTML_ESCAPE_PIECE;
+        if (piece_end > text.end) { piece_end = text.end; }
+
+        ArenaReserve(arena, (memsize)(piece_end - p) * HTML_ESCAPE_MAX_LENGTH);
+        char *out = arena->current;
+
+        while (p < piece_end) {
+            char   *clean_end = HTMLFindEscape(p, piece_end);
+            memsize clean     = (memsize)(clean_end - p);
+            memcpy(out, p, clean);
+            out += clean;
+            p    = clean_end;
+
+            if (p == piece_end) { break; }
+
+            const char *escape = 0;
+            switch (*p) {
+            case '"':  escape = "&quot;"; break;
+            case '&':  escape = "&amp;";  break;
+            case '\'': escape = "&#39;";  break;
+            case '<':  escape = "&lt;";   break;
+            case '>':  escape = "&gt;";   break;
+            }
+
+            memsize length = strlen(escape);
+            memcpy(out, escape, length);
+            out += length;
+            p++;
         }
 
-        text.begin++;
+        RawArenaPush(arena, (memsize)(out - arena->current));
     }
 }
 
 static void HTMLWriteAttribute(Slice key, Slice value, Arena *arena) {
     ArenaPushChar(arena, ' ');
     ArenaPushSlice(arena, key);
-    ArenaPushCStr(arena, "=\"");
+    ArenaPushLiteral(arena, "=\"");
     ArenaPushSlice(arena, value);
     ArenaPushChar(arena, '"');
 }
 
+static void HTMLWriteArguments(SCObject *obj, const char *url_attribute, Arena *arena) {
+    for (int i = 0; i < obj->args_count; i++) {
+        SCArg *arg = &obj->args[i];
+        if (SliceEqCStr(arg->key, "url")) {
+            HTMLWriteAttribute(SliceFromCStr(url_attribute), arg->value, arena);
+        } else {
+            HTMLWriteAttribute(arg->key, arg->value, arena);
+        }
+    }
+}
+
 // Create a new section at the specified heading level, and with the given
 // heading text
 static void HTMLOpenSection(HTMLTagStack *s, int level, Slice heading) {
@@ -418,16 +932,9 @@ static void HTMLOpenSection(HTMLTagStack *s, int level, Slice heading) {
         HTMLPushTag(s, HTMLTagType_Section);
     }
 
-    ArenaPushCStr(s->arena, "<h1>");
+    ArenaPushLiteral(s->arena, "<h1>");
     HTMLWriteEscapedText(heading, s->arena);
-    ArenaPushCStr(s->arena, "</h1>\n");
-}
-
-// Write escaped text wrapped in a tag
-static void HTMLWriteInTag(Slice text, const char *tag, Arena *arena) {
-    ArenaPushf(arena, "<%s>\n", tag);
-    HTMLWriteEscapedText(text, arena);
-    ArenaPushf(arena, "</%s>\n", tag);
+    ArenaPushLiteral(s->arena, "</h1>\n");
 }
 
 // Close tags until you reach the section tag, then open a new one
@@ -446,7 +953,7 @@ void TEST_SCToHTML(void) {
         "herp derp\n"
         "\\bold($$$)";
     Slice result;
-    int failure = !SCToHTML(SliceFromCStr(test), "test_path", "test_file", &test_arena, &result);
+    int failure = !SCToHTML(SliceFromCStr(test), "test_path", "test_file", &test_arena, 0, &result);
 
     assert(failure);
     printf("    It failed with error string:\n");
@@ -490,12 +997,122 @@ void TEST_SCToHTML(void) {
         "}\n";
 
     printf("  This next test should fail\n");
-    failure = !SCToHTML(SliceFromCStr(test), "test_path", "test_file", &test_arena, &result);
+    failure = !SCToHTML(SliceFromCStr(test), "test_path", "test_file", &test_arena, 0, &result);
     assert(!failure);
     printf("    It did not fail\n");
     printf("    Here is the text:\n");
     SlicePrint(result);
 
+    // Converting in pieces should give the same HTML
+    SCReader   reader = MakeSCReader(SliceFromCStr(test), "test_path", "test_file");
+    SCDocument doc;
+    Slice      parallel_result;
+    SCReadDocument(&reader, &test_arena, &doc);
+    for (int threads = 2; threads <= 4; threads++) {
+        int success = SCDocumentToHTMLParallel(&doc, &test_arena, 0, threads, &parallel_result);
+        assert(success && SliceCmp(result, parallel_result) == 0);
+    }
+
+    // Streamed through a small window, the HTML should be the same too. A
+    // run of whitespace that fills the window must not come out before the
+    // paragraph that the text after it opens.
+    Arena       window_arena     = AllocArena(MIN_ARENA_SIZE);
+    Arena       whitespace_arena = AllocArena(MIN_ARENA_SIZE);
+    ArenaString whitespace_test = ArenaBeginString(&whitespace_arena);
+    ArenaPushLiteral(&whitespace_arena, "\\section{One}");
+    for (int i = 0; i < 200; i++) { ArenaPushChar(&whitespace_arena, '\n'); }
+    ArenaPushLiteral(&whitespace_arena, "hello world\n");
+    Slice whitespace_source = ArenaEndString(&whitespace_arena, whitespace_test);
+
+    Slice sources[] = {SliceFromCStr(test), whitespace_source};
+    for (int i = 0; i < (int)ArrayCount(sources); i++) {
+        assert(SCToHTML(sources[i], "test_path", "test_file", &test_arena, 0, &result));
+
+        FILE *stream = tmpfile();
+        assert(stream);
+        fwrite(sources[i].begin, 1, SliceLength(sources[i]), stream);
+        rewind(stream);
+
+        SCReader      stream_reader = MakeSCStreamReader(stream, 64, &window_arena, 
+                                                         "test_path", "test_file");
+        SCHTMLStream *html_stream   = BeginSCToHTMLStream(&stream_reader, 64, &test_arena, 0);
+        ArenaString   streamed      = ArenaBeginString(&whitespace_arena);
+        for (int done = 0; !done;) {
+            Slice chunk;
+            assert(SCToHTMLStreamNext(html_stream, &chunk, &done));
+            ArenaPushSlice(&whitespace_arena, chunk);
+        }
+        assert(SliceCmp(result, ArenaEndString(&whitespace_arena, streamed)) == 0);
+        fclose(stream);
+    }
+    FreeArena(&window_arena);
+    FreeArena(&whitespace_arena);
+
+    // Big \html blocks, and \code blocks with nothing to escape, get spans
+    // pointing into the source. Joined up, the spans are the same HTML.
+    ArenaString span_test = ArenaBeginString(&test_arena);
+    ArenaPushLiteral(&test_arena, "\\info(title=\"Spans\", date=\"2020\")\n");
+    for (int i = 0; i < 6; i++) {
+        ArenaPushLiteral(&test_arena, "\\section{Section} Some text\n\\html{");
+        for (int j = 0; j < HTML_SPAN_MIN_SIZE / 8 + i; j++) {
+            ArenaPushLiteral(&test_arena, "<b>x</b>");
+        }
+        ArenaPushLiteral(&test_arena, "}\n\\code{");
+        for (int j = 0; j < HTML_SPAN_MIN_SIZE / 8; j++) {
+            ArenaPushCStr(&test_arena, i & 1 ? "x = {1};" : "a < b;\n ");
+        }
+        ArenaPushLiteral(&test_arena, "}\nMore text\n");
+    }
+    Slice span_source = ArenaEndString(&test_arena, span_test);
+
+    reader = MakeSCReader(span_source, "test_path", "test_file");
+    SCReadDocument(&reader, &test_arena, &doc);
+    assert(SCDocumentToHTML(&doc, &test_arena, 0, &result));
+
+    for (int threads = 1; threads <= 4; threads++) {
+        HTMLSpans spans;
+        Slice     span_error;
+        assert(SCDocumentToHTMLSpans(&doc, &test_arena, 0, threads, &spans, &span_error));
+        assert(spans.count == 1 + 2 * (6 + 3));
+
+        ArenaString joined = ArenaBeginString(&test_arena);
+        for (int i = 0; i < spans.count; i++) {
+            assert(!(i & 1) || (spans.spans[i].begin >= span_source.begin &&
+                                spans.spans[i].end   <= span_source.end));
+            ArenaPushSlice(&test_arena, spans.spans[i]);
+        }
+        assert(SliceCmp(result, ArenaEndString(&test_arena, joined)) == 0);
+    }
+
+    // Escaping, with the special characters at every offset of the vector
+    // loops and past the end of a piece
+    char escape_test[HTML_ESCAPE_PIECE + 100];
+    for (int i = 0; i < (int)sizeof(escape_test); i++) {
+        escape_test[i] = "ab\"c&d'e<f>ghijklmnopqrstuvwxyz0123"[(i * 7) % 35];
+    }
+
+    Slice escaped = {0};
+    for (int offset = 0; offset < 40; offset++) {
+        Slice       source = {escape_test + offset, escape_test + sizeof(escape_test)};
+        ArenaString str    = ArenaBeginString(&test_arena);
+        HTMLWriteEscapedText(source, &test_arena);
+        escaped = ArenaEndString(&test_arena, str);
+
+        char *e = escaped.begin;
+        for (char *p = source.begin; p < source.end; p++) {
+            const char *expected = *p == '"'  ? "&quot;" : *p == '&' ? "&amp;" :
+                                   *p == '\'' ? "&#39;"  : *p == '<' ? "&lt;"  :
+                                   *p == '>'  ? "&gt;"   : 0;
+            if (expected) {
+                assert(memcmp(e, expected, strlen(expected)) == 0);
+                e += strlen(expected);
+            } else {
+                assert(*e++ == *p);
+            }
+        }
+        assert(e == escaped.end);
+    }
+
     printf("Seems good.\n");
     FreeArena(&test_arena);
 }
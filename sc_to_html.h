@@ -4,9 +4,17 @@
 #include "common.h"
 #include "slice.h"
 #include "arena.h"
+#include "sc_file.h"
 
 #define SC_HTML_MAX_TAG_DEPTH 128
 
+// Every SC file has an info command to provide the title and date for the
+// page.
+typedef struct SCInfo {
+    Slice title;
+    Slice date;
+} SCInfo;
+
 // Converts the input sc file text into an html file.
 // This does not apply things like headers, footer, navigation.
 // This just generates the raw html for the article, similar to
@@ -24,12 +32,72 @@
 //
 // path and file are just strings used when making an error
 // message, they are not opened/read
-int SCToHTML(Slice sc, const char *path, const char *file, Arena *arena, Slice *out_slice);
+//
+// If info is not null, the title and date of the first \info command are
+// stored in it as the page is converted. They are left null if there is no
+// \info, or it does not have them.
+int SCToHTML(Slice sc, const char *path, const char *file, Arena *arena, 
+             SCInfo *info, Slice *out_slice);
+
+// Same as above, but converts a file that has already been read into an
+// SCDocument (SCToHTML reads one into the arena, and leaves it there)
+int SCDocumentToHTML(SCDocument *doc, Arena *arena, SCInfo *info, Slice *out_slice);
+
+// Same again, but splits the document up at \section commands and converts
+// the pieces on up to `threads` threads at once, for very big pages. The
+// HTML comes out the same as with SCDocumentToHTML.
+int SCDocumentToHTMLParallel(SCDocument *doc, Arena *arena, SCInfo *info, int threads,
+                             Slice *out_slice);
+
+// HTML that is kept in pieces, to be written out one after the other (see
+// WriteEntireFileParts). The pieces alternate between HTML made in the arena
+// (even indices) and big pieces of the source that go into the HTML as is,
+// like \html blocks (odd indices). Those are pointed to where they are in
+// the source instead of being copied, so they are only good as long as the
+// source is.
+typedef struct HTMLSpans {
+    Slice *spans;
+    int    count;
+} HTMLSpans;
 
-// IMPORTANT NOTE(eric): This escape function only supports characters I've
-// actually used.  
+// Pieces of the source at least this big are pointed to instead of copied
+#define HTML_SPAN_MIN_SIZE 512
+
+// Same as SCDocumentToHTMLParallel, but makes HTMLSpans. On failure, the
+// error message is stored in out_error.
+int SCDocumentToHTMLSpans(SCDocument *doc, Arena *arena, SCInfo *info, int threads,
+                          HTMLSpans *out, Slice *out_error);
+
+// Converts a file a chunk at a time, for files too big to hold in memory
+// along with their HTML (see MakeSCStreamReader). Ex:
+/*
+    SCReader      reader = MakeSCStreamReader(file, window_size, window_arena, path, name);
+    SCHTMLStream *stream = BeginSCToHTMLStream(&reader, chunk_size, arena, &info);
+    ArenaPos      pos    = ArenaSave(arena);
+    for (int done = 0; !done; ArenaRestore(arena, pos)) {
+        if (!SCToHTMLStreamNext(stream, &html, &done)) { ... html is the error ... }
+        ... write out html ...
+    }
+*/
+// Each chunk is a bit over chunk_size bytes of HTML, allocated in the arena.
+// A chunk also ends right after the \info command, since the info slices
+// are only good until the next call.
 //
-// Writes text to the arena, escaping html special characters
+// The reader's window has to be in an arena other than this one. The window
+// can grow while a chunk is being made, and restoring the arena after the
+// chunk would throw the grown window away.
+typedef struct SCHTMLStream SCHTMLStream;
+
+SCHTMLStream *BeginSCToHTMLStream(SCReader *reader, memsize chunk_size, 
+                                  Arena *arena, SCInfo *info);
+int SCToHTMLStreamNext(SCHTMLStream *s, Slice *out_slice, int *out_done);
+
+// True once the \info command has been converted
+int SCToHTMLStreamFoundInfo(SCHTMLStream *s);
+
+// Writes text to the arena, escaping html special characters. That is
+// " & ' < and >, which covers text both between tags and in quoted
+// attributes.
 void HTMLWriteEscapedText(Slice text, Arena *arena);
 
 #ifndef NDEBUG
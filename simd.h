@@ -0,0 +1,40 @@
+#pragma once
+#ifndef SIMD_H
+#define SIMD_H
+#include "common.h"
+
+// Which vector instruction sets the byte scanners can use. This is decided at
+// compile time: SSE2 is part of x86-64, so it is always on there, and AVX2 is
+// used when the compiler is targeting it (ex: -mavx2 or -march=native).
+// Anything else uses the plain C loops.
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#   define SIMD_SSE2 1
+#   include <emmintrin.h>
+#endif
+
+#if defined(__AVX2__)
+#   define SIMD_AVX2 1
+#   include <immintrin.h>
+#endif
+
+#ifdef _MSC_VER
+#   include <intrin.h>
+
+static inline
+int CountTrailingZeros32(uint32_t x) {
+    unsigned long index;
+    _BitScanForward(&index, x);
+    return (int)index;
+}
+
+#else
+
+// x must not be 0
+static inline
+int CountTrailingZeros32(uint32_t x) {
+    return __builtin_ctz(x);
+}
+
+#endif
+
+#endif
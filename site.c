@@ -51,9 +51,16 @@ build compilation. To perform the unity build, run this (or similar):
 
     clang -O2 -DNDEBUG -DUNITY_BUILD site.c -o site
 
+The SC file reader uses SSE2 on x86-64. Add -mavx2 (or -march=native on a
+machine that has it) to let it use AVX2 too.
+
+bench.c has benchmarks for reading and converting SC files. It builds the same
+way (`clang -O2 -DNDEBUG bench.c -o bench`), and times the SC files given to
+it, or a generated one if there are none.
+
 ## Running site.c
 
-    Usage: site in_dir out_dir [memory]
+    Usage: site [options] in_dir out_dir [memory]
 
 site.c takes two required arguments:
 
@@ -63,9 +70,58 @@ site.c takes two required arguments:
 
 Optionally, you can specify:
 
-* memory, the amount of memory, in megabytes, used by the program. The default
-  is 128 megabytes, which should be enough for any site. I doubt that the
-  combined text of anyone's blog will exceed 128 mb. 
+* memory, the amount of memory, in megabytes, allocated up front. The default
+  is 4 megabytes. The program allocates more as it needs it, so this is only
+  worth setting if you know you have a big site and want to skip the growing.
+
+There are also some options for tuning memory use. They only do anything on
+64 bit Linux (and other POSIX systems), where the arena reserves address space
+up front and only commits memory as it is used:
+
+* `--trim` gives memory back to the OS once a big directory is done, instead
+  of holding on to the peak for the rest of the run.
+* `--huge-pages` asks for transparent huge pages, which can help big blogs.
+* `--populate` prefaults memory as it is committed, instead of taking a page
+  fault on first touch.
+
+To see how much memory a site actually needs, pass `--stats` (or
+`--stats-json` for machine readable output). When the run is done, this
+prints the peak memory use, the directory and stage of generation where the
+peak happened, and a breakdown by stage: nav parsing, blog loading, page
+rendering, archive generation and static copying.
+
+To make rebuilds faster, pass `--cache DIR`. site.c then keeps the lexed form
+of every SC file in DIR (as .scb files), and on later runs reuses it for any
+file whose size and modification time have not changed, instead of lexing the
+file again. If only the modification time changed (ex: a fresh checkout), the
+file's contents are compared by hash before the cache is trusted. The cache
+directory can be deleted at any time.
+
+Pages bigger than 64 MB are not read into memory in one go. Instead, they are
+read through a small window and written out a piece at a time, so memory use
+stays about the same no matter how big the page is. To change the cutoff, pass
+`--stream-above MB`. Blog entries are always read in whole.
+
+Pages bigger than 4 MB are read and converted on several threads at once, one
+per processor by default. Pass `--page-threads N` to change the number, or
+`--page-threads 1` to turn this off.
+
+Pages are made one at a time by default. Pass `--jobs N` to make up to N pages
+at once, each on its own thread, with the biggest pages started first. If
+anything goes wrong, the error reported is the same one you would get without
+`--jobs`. Memory stats (`--stats`) only count the main thread.
+
+With `--jobs`, reading files in and writing pages out also happen on threads
+of their own, so waiting on the disk overlaps with making pages. Up to twice
+as many pages as `--jobs` (plus two) are held in memory between those steps.
+Pass `--pipeline N` to change that number. `--pipeline` also works without
+`--jobs`, to make one page at a time while the next files are read ahead.
+
+Without `--jobs` or `--pipeline`, pass `--io-uring` to read and write the
+small pages of each directory in batches of up to 64. On Linux, each batch's
+opens, reads, writes and closes are handed to the kernel together through
+io_uring, instead of taking several system calls per file. If io_uring is
+missing or turned off, the files are done one at a time as usual.
 
 ## SC File Format
 
@@ -113,7 +169,27 @@ the next section for a nav.sc example.
 You can optionally have a style.css file, which will be copied to the output
 directory. You can also have a `static` subdirectory. The `static` directory`
 will not be processed by the site generator, but will be copied as-is into the
-output directory.
+output directory. Files whose copy in the output already has the same size and
+modification time are skipped, so rebuilding with a big `static` directory
+only copies what changed. With `--jobs N`, N files are copied at once.
+
+Pages are only written when they come out different from the file already in
+the output directory. Pages that are the same are left alone, modification
+time and all, so tools that sync the output only see what really changed. A
+changed page is written under a temporary name, and then renamed over the old
+one. When it is done, the site generator says how many pages it wrote, and
+how many were unchanged.
+
+Pass `--incremental` to skip making pages whose files didn't change at all.
+The site generator then keeps a manifest of what each page was made from in
+the output directory, as `.site-manifest`: the size, modification time and
+contents of its SC file, and for blogs, which entries come before and after
+it, and the size and modification time the page itself was left with. A
+directory where nothing was added, removed or touched is skipped without
+being opened. A file that was touched but reads the same as before is
+skipped too. A page that was edited or deleted in the output directory is
+made again. Changing nav.sc makes everything again. If a build fails, the
+manifest is removed, so the next one makes everything.
 
 You can have any number of subdirectories, recursively. Each subdirectory is
 processed as either a normal directory or a blog directory. To make a
@@ -339,7 +415,8 @@ and prev links based on the dates specified in the info command for
 each page.
 
 Additionally, a blog auto-generates an `index.html` and and an `archive.html`. The
-`index.html` file will be a copy of the most recent blog post. The archive
+`index.html` file will be the same as the most recent blog post (a hard link to
+it, where the file system allows). The archive
 page will contain a chronological listing of all of the posts in the blog.
 
 Remember, a blog requires a `blog.sc` file which contains the title of the
@@ -347,17 +424,17 @@ blog. This title is added as a subtitle to the site title.
 
 ## Memory
 
-site.c uses a single large allocation of memory as stack allocator (aka arena).
+site.c uses a stack allocator (aka arena) for all of its memory.
 Files are loaded into the arena and generated output is written to it. After
 each file in a normal directory is processed, the memory used is rolled back
 and reused. A blog directory loads all files at once, but then reuses memory
 for each page generated.
 
-The point is, unless you have a blog with > ~40mb of text in it, the default
-is fine. Otherwise, use the third argument to request more memory.
-
-Eventually, I'll change the arena implementation to grow as needed, but I
-don't think I'll ever use more than 128mb.
+The arena starts out small and chains on bigger blocks of memory whenever it
+fills up, so there is no fixed limit to run into. The third argument only sets
+how big the first block is. On 64 bit POSIX systems, the arena instead reserves
+a large range of address space and commits memory from it as it goes, so only
+memory that is actually used counts against the process.
 
 ## Why is this called site.c
 
@@ -409,49 +486,179 @@ with semantic tags.
 #include "paths.h"
 #include "sc_file.h"
 #include "sc_to_html.h"
+#include "sc_cache.h"
 #include "site_gen.h"
+#include "site_manifest.h"
+#include "threads.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+
+static void PrintUsage(void) {
+    printf("site.exe: simple static site generator version %s.\n", VERSION_STRING);
+    printf("(c) Eric Alzheimer, 2019\n");
+    printf("Released under the MIT license.\n");
+    printf("Usage: site.exe [options] in_directory out_directory [arena_size]\n");
+    printf("  in_directory  - Directory containing site source data.\n");
+    printf("  out_directory - Directory to generate site html into.\n");
+    printf("                  Will create it if it doesn't exist.\n");
+    printf("  memory - Amount of memory allocated up front, in megabytes, for loading\n" 
+           "           and generating files. Grows as needed. Default amount is 4.\n");
+    printf("Options:\n");
+    printf("  --trim       - Give memory back to the OS after big directories are done.\n");
+    printf("  --huge-pages - Use transparent huge pages for the arena.\n");
+    printf("  --populate   - Prefault arena memory instead of faulting it in as used.\n");
+    printf("  --stats      - Print a summary of memory usage when done.\n");
+    printf("  --stats-json - Like --stats, but prints the summary as JSON.\n");
+    printf("  --cache DIR  - Keep lexed SC files in DIR, to skip re-lexing unchanged\n"
+           "                 files on later runs.\n");
+    printf("  --stream-above MB - Convert pages bigger than this a piece at a time,\n"
+           "                      instead of reading them in whole. Default is 64.\n");
+    printf("  --page-threads N  - Threads used for each page bigger than 4 MB.\n"
+           "                      Default is one per processor.\n");
+    printf("  --jobs N          - Make up to N pages at once, on N threads. Default is 1.\n");
+    printf("  --io-uring        - Read and write small pages in batches, through io_uring\n"
+           "                      on Linux. Only without --jobs and --pipeline.\n");
+    printf("  --pipeline N      - Read and write pages on threads of their own, with up\n"
+           "                      to N pages in memory. Default is 2 per job, plus 2,\n"
+           "                      and off without --jobs.\n");
+    printf("  --incremental     - Only make the pages whose files changed since the last\n"
+           "                      build, going by a manifest kept in the output.\n");
+}
+
+// Parses the number after an option. Anything but a whole number from 0 to
+// INT_MAX is an error.
+static int ParseCountArg(const char *text, int *out) {
+    char *end = 0;
+    errno = 0;
+    long value = strtol(text, &end, 10);
+    if (end == text || *end || errno || value < 0 || value > INT_MAX) { return 0; }
+
+    *out = (int)value;
+    return 1;
+}
 
 int main(int argc, char **argv) {
 
 #ifndef NDEBUG
+    TEST_Arena();
     TEST_SCReader();
     TEST_SCToHTML();
+    TEST_SCCache();
     TEST_GetSCInfo();
     TEST_GenerateNormalPage();
+    TEST_SiteManifest();
 #endif
 
-    if (argc < 3) {
-        printf("site.exe: simple static site generator version %s.\n", VERSION_STRING);
-        printf("(c) Eric Alzheimer, 2019\n");
-        printf("Released under the MIT license.\n");
-        printf("Usage: site.exe in_directory out_directory [arena_size]\n");
-        printf("  in_directory  - Directory containing site source data.\n");
-        printf("  out_directory - Directory to generate site html into.\n");
-        printf("                  Will create it if it doesn't exist.\n");
-        printf("  memory - Amount of memory allocated, in megabytes, for loading and\n" 
-               "           generating files. Default amount is 128.\n");
+    const char *args[3]   = {0};
+    int         args_count = 0;
+    int         arena_flags = 0;
+    int         print_stats = 0, print_stats_json = 0;
+    SiteOptions options = {0};
+    options.stream_above = SITE_STREAM_ABOVE;
+    options.page_threads = ProcessorCount();
+    options.jobs         = 1;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--trim") == 0) {
+            arena_flags |= ArenaFlag_Trim;
+        } else if (strcmp(argv[i], "--huge-pages") == 0) {
+            arena_flags |= ArenaFlag_HugePages;
+        } else if (strcmp(argv[i], "--populate") == 0) {
+            arena_flags |= ArenaFlag_Populate;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            print_stats = 1;
+        } else if (strcmp(argv[i], "--stats-json") == 0) {
+            print_stats_json = 1;
+        } else if (strcmp(argv[i], "--cache") == 0) {
+            if (i + 1 >= argc) {
+                fprintf(stderr, "--cache needs a directory\n");
+                return -1;
+            }
+            options.cache_dir = argv[++i];
+        } else if (strcmp(argv[i], "--stream-above") == 0) {
+            int megabytes = 0;
+            if (i + 1 >= argc || !ParseCountArg(argv[++i], &megabytes)) {
+                fprintf(stderr, "--stream-above needs a size in megabytes\n");
+                return -1;
+            }
+            options.stream_above = (uint64_t)megabytes * 1024 * 1024;
+        } else if (strcmp(argv[i], "--page-threads") == 0) {
+            if (i + 1 >= argc || !ParseCountArg(argv[++i], &options.page_threads)) {
+                fprintf(stderr, "--page-threads needs a number of threads\n");
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--jobs") == 0) {
+            if (i + 1 >= argc || !ParseCountArg(argv[++i], &options.jobs)) {
+                fprintf(stderr, "--jobs needs a number of threads\n");
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--io-uring") == 0) {
+            options.batch_io = 1;
+        } else if (strcmp(argv[i], "--pipeline") == 0) {
+            if (i + 1 >= argc || !ParseCountArg(argv[++i], &options.pipeline_depth)) {
+                fprintf(stderr, "--pipeline needs a number of pages\n");
+                return -1;
+            }
+        } else if (strcmp(argv[i], "--incremental") == 0) {
+            options.incremental = 1;
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return -1;
+        } else if (args_count < (int)ArrayCount(args)) {
+            args[args_count++] = argv[i];
+        } else {
+            fprintf(stderr, "Too many arguments: %s\n", argv[i]);
+            return -1;
+        }
+    }
+
+    if (args_count < 2) {
+        PrintUsage();
         return 0;
     }
 
     memsize arena_size = ARENA_SIZE;
-    if (argc > 3) {
-        arena_size = ((memsize)atoi(argv[3])) * 1024 * 1024;
+    if (args_count > 2) {
+        arena_size = ((memsize)atoi(args[2])) * 1024 * 1024;
         if (arena_size < MIN_ARENA_SIZE) {
             arena_size = MIN_ARENA_SIZE;
         }
     }
 
-    Arena arena  = AllocArena(arena_size);
-    Slice error;
-    if (!GenerateSite(argv[1], argv[2], &arena, &error)) {
+    Arena      arena = AllocArenaEx(arena_size, arena_flags);
+    ArenaStats stats;
+    if (print_stats || print_stats_json) {
+        ArenaEnableStats(&arena, &stats);
+    }
+
+    Slice      error;
+    SiteCounts counts;
+    int        success = GenerateSite(args[0], args[1], &options, &counts, &arena, &error);
+
+    if (!success) {
         fprintf(stderr, "Could not generate site, error happened:\n");
         SliceFPrint(error, stderr);
-        return -1;
+    } else if (!print_stats_json) {
+        // Keeps stdout as nothing but the JSON with --stats-json
+        printf("%d pages written, %d unchanged", counts.written, counts.unchanged);
+        if (options.incremental) { printf(", %d skipped", counts.skipped); }
+        printf("\n");
+    }
+
+    // Print these even on failure, since running out of memory is
+    // one of the things they help track down
+    if (print_stats) {
+        PrintArenaStats(&stats, g_site_phase_name, SitePhase_COUNT, stdout);
+    }
+
+    if (print_stats_json) {
+        PrintArenaStatsJSON(&stats, g_site_phase_name, SitePhase_COUNT, stdout);
     }
 
-    return 0;
+    return success ? 0 : -1;
 }
 
 // Optionally, build every thing as a single translation unit
@@ -461,7 +668,10 @@ int main(int argc, char **argv) {
 #include "arena.c"
 #include "paths.c"
 #include "sc_file.c"
+#include "sc_cache.c"
 #include "sc_to_html.c"
 #include "site_gen.c"
+#include "site_manifest.c"
+#include "threads.c"
 #endif
 
@@ -1,63 +1,81 @@
 #include "site_gen.h"
+#include "site_manifest.h"
 #include "paths.h"
+#include "threads.h"
 #include <string.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <assert.h>
 
-// Every SC file has an info command to provide the title and date for the
-// page.
-typedef struct SCInfo {
-    Slice title;
-    Slice date;
-} SCInfo;
-
-static int GetSCInfo(Slice sc, 
-              const char *path, const char *file, 
-              Arena *arena, SCInfo *out, Slice *error_text) {
-    SCReader reader = MakeSCReader(sc, path, file);
+const char *g_site_phase_name[SitePhase_COUNT] = {
+    "setup",
+    "nav parse",
+    "blog load",
+    "page render",
+    "archive",
+    "static copy",
+};
+
+// Pulls the title and date out of an info command
+static int GetSCInfoFromObject(SCObject *obj, Arena *arena, SCInfo *out, Slice *error_text) {
+    out->title = SCFindArg(obj, "title");
+    out->date  = SCFindArg(obj, "date");
+
+    if (IsNullSlice(out->title) || IsNullSlice(out->date)) {
+        *error_text = SCMakeErrorString(obj, arena,
+                                        "Info command is missing required params");   
+        return 0; 
+    } else {
+        return 1; 
+    }
+}
+
+// Finds the title and date in a file's info command, without converting it
+static int GetSCInfo(SCDocument *doc, Arena *arena, SCInfo *out, Slice *error_text) {
     SCObject obj = {0};
-    int      found_info = 0;
 
-    do {
-        SCRead(&reader, &obj);
-        switch (obj.type) {
-        default: break;
-        R_HandleSCObjectTypeError(obj, arena, error_text);
-        case SCObjectType_Func:
-        {
-            if (!SliceEqCStr(obj.function_name, "info")) { continue; }
-
-            // This increments on:
-            // Having a title.
-            // Having a date.
-            // If all the required stuff is here, it should == 2 by the end
-            for (int i = 0; i < obj.args_count; i++) {
-                if (SliceEqCStr(obj.keys[i], "title")) {
-                    found_info++;
-                    out->title = obj.values[i];
-                } else if (SliceEqCStr(obj.keys[i], "date")) {
-                    found_info++;
-                    out->date = obj.values[i];
-                }
-            }
+    for (int i = 0; i < doc->count; i++) {
+        if (doc->commands[i] != SCCommand_Info) { continue; }
 
-            if (found_info != 2) {
-                *error_text = SCMakeErrorString(&obj, arena,
-                                                "Info command is missing required params");   
-                return 0;
-            } else {
-                return 1;
-            }
-        } break;
+        SCGetDocumentObject(doc, i, &obj);
+        if (obj.type != SCObjectType_Func) { continue; }
+
+        return GetSCInfoFromObject(&obj, arena, out, error_text);
+    }
+
+    // The last object is the End, or whatever error stopped the reading
+    SCGetDocumentObject(doc, doc->count - 1, &obj);
+    *error_text = SCMakeErrorString(&obj, arena,
+                                    obj.type == SCObjectType_Error ? 0 : "Info command not found");
+    return 0;
+}
+
+// Same as above, for a file that is being streamed (see GenerateStreamedPage)
+static int GetStreamedSCInfo(SCReader *r, Arena *arena, SCInfo *out, Slice *error_text) {
+    SCObject obj = {0};
+
+    do {
+        SCRead(r, &obj);
+        if (obj.type == SCObjectType_Func && obj.command == SCCommand_Info) {
+            return GetSCInfoFromObject(&obj, arena, out, error_text);
         }
     } while (obj.type != SCObjectType_End &&
              obj.type != SCObjectType_Error);
 
     *error_text = SCMakeErrorString(&obj, arena,
-                                    "Info command not found");
+                                    obj.type == SCObjectType_Error ? 0 : "Info command not found");
     return 0;
 }
 
+// The header and footer of every page in a site (or a blog), rendered once,
+// split up around the places where the page's title and date go
+typedef struct PageTemplate {
+    Slice header_begin; // Up to the page title, inside <title>
+    Slice header_end;   // The rest of the header, including the nav links
+    Slice footer_begin; // Up to the date
+    Slice footer_end;
+} PageTemplate;
+
 // At the root of a site is a nav.sc file, which lists the toplevel nav links
 // for the site + some extra info like the site title
 typedef struct SiteNavigation {
@@ -68,29 +86,55 @@ typedef struct SiteNavigation {
     Slice labels[SITE_NAVIGATION_MAX_ENTRIES];
     int   nav_count;
     int   root_is_blog;
-} SiteNavigation;
 
-static void GenerateFooter(SiteNavigation *nav, Slice date, Arena *arena) {
-    ArenaPushCStr(arena, 
-        "    <footer>\n"
-        "      <hr>\n"
-        "      <p>\n");
-    ArenaPushSlice(arena, nav->site_copyright);
-    ArenaPushCStr(arena, "<br>");
-    HTMLWriteEscapedText(date, arena);
-    ArenaPushCStr(arena, "<br>");
-    ArenaPushSlice(arena, nav->site_footer);
-    ArenaPushCStr(arena, 
-        "      </p>\n"
-        "    </footer>\n"
-        "  </body>\n"
-        "</html>\n");
-}
+    // NOTE: Not from nav.sc, but these go everywhere the site does.
+    SCCache *cache;   // Null unless the object cache is on
+    Arena   *scratch; // For things only needed while making one page (ex: 
+                      // SCDocuments). If null, the main arena is used.
+    uint64_t stream_above; // See SiteOptions
+    int      page_threads;
+    struct SiteJobs *jobs; // Null unless pages are made on a pool (--jobs)
+    FileBatch       *files; // For reading and writing small pages a batch at
+                            // a time. Only without --jobs.
+    SiteCounts      *counts;
+    SiteManifest    *manifest; // Null unless --incremental
+    DirHandle       *out_root; // The whole output, with --incremental
+
+    // Header and footer for pages outside of blogs (see MakePageTemplate)
+    PageTemplate site_template;
+} SiteNavigation;
 
-static void GenerateHeader(SiteNavigation *nav, 
-                    Slice site_title, Slice site_sub_title, Slice title, 
-                    Arena *arena) {
-    ArenaPushCStr(arena, 
+// A page is kept in pieces, which are written out one after the other (see
+// WriteEntireFileParts). That way the body can be converted first, and the
+// header, which needs the title from the body's info command, made after.
+//
+// NOTE: Nothing is copied to put a page together. Most of the header
+// and footer is the same on every page, so those parts point straight into
+// a PageTemplate, and only the title, date, and blog navigation are made for
+// each page. The body is HTMLSpans, which point at big \html and \code
+// blocks right where they are in the source.
+typedef enum PagePart {
+    PagePart_HeaderBegin,
+    PagePart_Title,
+    PagePart_HeaderEnd,
+    PagePart_BlogNav,     // Blog pages only
+    PagePart_FooterBegin, // The body goes before this
+    PagePart_Date,
+    PagePart_FooterEnd,
+    PagePart_COUNT
+} PagePart;
+
+typedef struct Page {
+    Slice     parts[PagePart_COUNT];
+    HTMLSpans body;
+} Page;
+
+static void MakePageTemplate(SiteNavigation *nav, Slice site_sub_title, 
+                             Arena *arena, PageTemplate *out) {
+    Slice site_title = nav->site_title;
+
+    ArenaString str = ArenaBeginString(arena);
+    ArenaPushLiteral(arena, 
                "<!doctype html>\n"
                "<html lang=\"en\">\n"
                "  <head>\n"
@@ -100,16 +144,13 @@ static void GenerateHeader(SiteNavigation *nav,
     HTMLWriteEscapedText(site_title, arena);
 
     if (!IsNullSlice(site_sub_title)) {
-        ArenaPushCStr(arena, " - ");
+        ArenaPushLiteral(arena, " - ");
         HTMLWriteEscapedText(site_sub_title, arena);
     }
+    out->header_begin = ArenaEndString(arena, str);
 
-    if (!IsNullSlice(title)) {
-        ArenaPushCStr(arena, " - ");
-        HTMLWriteEscapedText(title, arena);
-    }
-
-    ArenaPushCStr(arena, 
+    str = ArenaBeginString(arena);
+    ArenaPushLiteral(arena, 
                "\n"
                "    </title>\n"
                "    <link rel=\"stylesheet\" href=\"/style.css\">\n"
@@ -120,42 +161,293 @@ static void GenerateHeader(SiteNavigation *nav,
     HTMLWriteEscapedText(site_title, arena);
 
     if (!IsNullSlice(site_sub_title)) {
-        ArenaPushCStr(arena, " <small> - ");
+        ArenaPushLiteral(arena, " <small> - ");
         HTMLWriteEscapedText(site_sub_title, arena);
-        ArenaPushCStr(arena, "</small>");
+        ArenaPushLiteral(arena, "</small>");
     }
 
-    ArenaPushCStr(arena, 
+    ArenaPushLiteral(arena, 
                "\n"
                "      </h1>\n"
                "      <nav>\n"
                "        <ul>\n");
     for (int i = 0; i < nav->nav_count; i++) {
-        ArenaPushCStr(arena, " <li><a href=\"");
+        ArenaPushLiteral(arena, " <li><a href=\"");
         ArenaPushSlice(arena, nav->links[i]);
-        ArenaPushCStr(arena, "\">");
+        ArenaPushLiteral(arena, "\">");
         ArenaPushSlice(arena, nav->labels[i]);
-        ArenaPushCStr(arena, "</a></li>\n");
+        ArenaPushLiteral(arena, "</a></li>\n");
     }
-    ArenaPushCStr(arena, 
+    ArenaPushLiteral(arena, 
                "        </ul>\n"
                "      </nav>\n"
                "      <hr>\n"
                "    </header>\n");
+    out->header_end = ArenaEndString(arena, str);
+
+    str = ArenaBeginString(arena);
+    ArenaPushLiteral(arena, 
+        "    <footer>\n"
+        "      <hr>\n"
+        "      <p>\n");
+    ArenaPushSlice(arena, nav->site_copyright);
+    ArenaPushLiteral(arena, "<br>");
+    out->footer_begin = ArenaEndString(arena, str);
+
+    str = ArenaBeginString(arena);
+    ArenaPushLiteral(arena, "<br>");
+    ArenaPushSlice(arena, nav->site_footer);
+    ArenaPushLiteral(arena, 
+        "      </p>\n"
+        "    </footer>\n"
+        "  </body>\n"
+        "</html>\n");
+    out->footer_end = ArenaEndString(arena, str);
 }
 
+// Fills in the header and footer parts of a page from a template. A null
+// title leaves just the site title in <title>.
+static void FillPageTemplate(PageTemplate *t, Slice title, Slice date, 
+                             Arena *arena, Page *page) {
+    page->parts[PagePart_HeaderBegin] = t->header_begin;
+    page->parts[PagePart_HeaderEnd]   = t->header_end;
+    page->parts[PagePart_FooterBegin] = t->footer_begin;
+    page->parts[PagePart_FooterEnd]   = t->footer_end;
+
+    ArenaString str = ArenaBeginString(arena);
+    if (!IsNullSlice(title)) {
+        ArenaPushLiteral(arena, " - ");
+        HTMLWriteEscapedText(title, arena);
+    }
+    page->parts[PagePart_Title] = ArenaEndString(arena, str);
+
+    str = ArenaBeginString(arena);
+    HTMLWriteEscapedText(date, arena);
+    page->parts[PagePart_Date] = ArenaEndString(arena, str);
+}
+
+// Converts the body of a page, picking up its title and date on the way, so
+// the file only gets read through once.
+//
+// NOTE: Only failures take a second look at the document. GetSCInfo
+// used to run before the conversion, so a bad or missing info command is
+// reported ahead of whatever else went wrong, same as before.
+//
+// The body points into source, so it is only good as long as source is.
+static int RenderPageBody(SiteNavigation *nav,
+                          Slice source, const char *path, const char *file,
+                          Arena *arena, SCInfo *info, 
+                          HTMLSpans *out_body, Slice *out_error) {
+    Arena   *doc_arena = nav->scratch ? nav->scratch : arena;
+    ArenaPos doc_pos   = ArenaSave(doc_arena);
+
+    SCReader     reader = MakeSCReader(source, path, file);
+    SCCacheEntry cache_entry;
+    SCDocument   doc;
+    int          threads = SliceLength(source) >= SITE_PARALLEL_ABOVE ? nav->page_threads : 1;
+    if (nav->cache) { SCCacheBegin(nav->cache, &reader, &cache_entry); }
+    SCReadDocumentParallel(&reader, doc_arena, &doc, threads);
+    if (nav->cache) { SCCacheEnd(nav->cache, &reader, &cache_entry, 1); }
+
+    *out_error   = (Slice) {0};
+    int rendered = SCDocumentToHTMLSpans(&doc, arena, info, threads, out_body, out_error) &&
+                   !IsNullSlice(info->title) && !IsNullSlice(info->date);
+
+    if (!rendered) {
+        Slice  info_error;
+        SCInfo unused;
+        if (!GetSCInfo(&doc, arena, &unused, &info_error)) {
+            *out_error = info_error;
+        }
+    }
+
+    if (doc_arena != arena) { ArenaRestore(doc_arena, doc_pos); }
+    return rendered;
+}
+
+// Lines the parts and the body spans up in the arena, in the order they go
+// in the file. Returns how many there are.
+static int LayOutPage(Page *page, Arena *arena, Slice **out_parts) {
+    ArenaAlign(arena, sizeof(void*));
+    Slice *parts = ArenaPushMany(arena, Slice, PagePart_COUNT + page->body.count);
+    int    count = 0;
+
+    for (int i = 0; i < PagePart_COUNT; i++) {
+        if (i == PagePart_FooterBegin) {
+            memcpy(parts + count, page->body.spans, sizeof(Slice) * page->body.count);
+            count += page->body.count;
+        }
+        parts[count++] = page->parts[i];
+    }
+
+    *out_parts = parts;
+    return count;
+}
+
+static void CountWrite(SiteCounts *counts, int changed) {
+    AtomicAdd(changed ? &counts->written : &counts->unchanged, 1);
+}
+
+// Writes the page with one UpdateEntireFilePartsAt, so it is left alone if it
+// comes out the same as last time
+static int WritePage(Page *page, DirHandle *dir, const char *file_name, 
+                     SiteCounts *counts, Arena *arena) {
+    ArenaPos pos     = ArenaSave(arena);
+    Slice   *parts   = 0;
+    int      count   = LayOutPage(page, arena, &parts);
+    int      changed = 0;
+
+    int written = UpdateEntireFilePartsAt(dir, file_name, parts, count, &changed);
+    if (written) { CountWrite(counts, changed); }
+    ArenaRestore(arena, pos);
+    return written;
+}
+
+// On failure, the error message is stored in out_error
 static int GenerateNormalPage(SiteNavigation *nav, 
                        Slice source, const char *path, const char *file, 
-                       Arena *arena, Slice *out_slice) {
-    ArenaString out_string = ArenaBeginString(arena);
-
+                       Arena *arena, Page *page, Slice *out_error) {
     SCInfo info;
-    if (!GetSCInfo(source, path, file, arena, &info, out_slice)) { return 0; }
-    GenerateHeader(nav, nav->site_title, NullSlice(), info.title, arena);
-    if (!SCToHTML(source, path, file, arena, out_slice)) { return 0; }
-    GenerateFooter(nav, info.date, arena);
-    *out_slice = ArenaEndString(arena, out_string);
+    if (!RenderPageBody(nav, source, path, file, arena, 
+                        &info, &page->body, out_error)) { 
+        return 0; 
+    }
+
+    FillPageTemplate(&nav->site_template, info.title, info.date, arena, page);
+    return 1;
+}
+
+// Like GenerateNormalPage followed by WritePage, for files too big to read in
+// whole. The page is converted a chunk at a time, and each chunk is written
+// out before the next one is made, so only the reader's window and a chunk of
+// HTML are in memory at once.
+//
+// NOTE: The header needs the title, so whatever comes before the info
+// command is held on to until it shows up. That is normally just the opening
+// article tag, since the info command has to come before any sections.
+static int GenerateStreamedPage(SiteNavigation *nav, 
+                                DirHandle *in_dir, const char *file,
+                                DirHandle *out_dir, const char *out_file,
+                                Arena *arena, Slice *out_error) {
+    FILE *in = OpenFileAt(in_dir, file, "rb");
+    if (!in) {
+        *out_error = ArenaPrintf(arena, "Could not read file: %s\n", file);
+        return 0; 
+    }
+
+    // NOTE: The page can't be compared until it is all made, so it is
+    // written under another name, and only takes the place of the old one if
+    // it came out different (see ReplaceFileAt)
+    char temp_file[BUF_SIZE];
+    if (!TempFileName(out_file, temp_file, sizeof(temp_file))) {
+        *out_error = ArenaPrintf(arena, "Could not write file: %s\n", out_file);
+        fclose(in);
+        return 0; 
+    }
+
+    // The chunks go in the scratch arena, so they can be thrown away as they
+    // are written without losing the header and footer
+    assert(nav->scratch);
+    Arena   *chunk_arena = nav->scratch;
+    ArenaPos stream_pos  = ArenaSave(chunk_arena);
+
+    SCInfo        info   = {0};
+    SCReader      reader = MakeSCStreamReader(in, SITE_STREAM_WINDOW_SIZE, arena, in_dir->path, file);
+    SCHTMLStream *stream = BeginSCToHTMLStream(&reader, SITE_STREAM_CHUNK_SIZE, 
+                                               chunk_arena, &info);
+
+    ArenaPos    chunk_pos   = ArenaSave(chunk_arena);
+    ArenaString held        = ArenaBeginString(chunk_arena);
+    int         holding     = 1;
+    int         done        = 0;
+    FILE       *out         = 0;
+    Slice       html        = {0};
+    Slice       html_error  = NullSlice();
+    Page        page        = {0};
+
+    while (!done) {
+        if (!SCToHTMLStreamNext(stream, &html, &done)) {
+            html_error = ArenaPushSlice(arena, html);
+            goto failure;
+        }
+
+        if (holding) {
+            if (!SCToHTMLStreamFoundInfo(stream) && !done) { continue; }
+            if (IsNullSlice(info.title) || IsNullSlice(info.date)) { goto failure; }
+
+            Slice body = ArenaEndString(chunk_arena, held);
+            holding = 0;
+
+            FillPageTemplate(&nav->site_template, info.title, info.date, arena, &page);
+
+            out = OpenFileAt(out_dir, temp_file, "wb");
+            if (!out) { goto write_failure; }
+
+            for (int i = 0; i < PagePart_FooterBegin; i++) {
+                Slice part = page.parts[i];
+                if (fwrite(part.begin, 1, SliceLength(part), out) != SliceLength(part)) {
+                    goto write_failure;
+                }
+            }
+
+            if (fwrite(body.begin, 1, SliceLength(body), out) != SliceLength(body)) {
+                goto write_failure;
+            }
+        } else if (fwrite(html.begin, 1, SliceLength(html), out) != SliceLength(html)) {
+            goto write_failure;
+        }
+
+        ArenaRestore(chunk_arena, chunk_pos);
+    }
+
+    int wrote_footer = 1;
+    for (int i = PagePart_FooterBegin; i < PagePart_COUNT; i++) {
+        Slice part = page.parts[i];
+        wrote_footer &= fwrite(part.begin, 1, SliceLength(part), out) == SliceLength(part);
+    }
+
+    int changed = 0;
+    if (fclose(out) != 0 || !wrote_footer) {
+        out = 0;
+        RemoveFileAt(out_dir, temp_file);
+        goto write_failure;
+    }
+
+    out = 0;
+    if (!ReplaceFileAt(out_dir, temp_file, out_file, &changed)) { goto write_failure; }
+    CountWrite(nav->counts, changed);
+
+    fclose(in);
+    ArenaRestore(chunk_arena, stream_pos);
     return 1;
+
+write_failure:
+    *out_error = ArenaPrintf(arena, "Could not write file: %s\n", out_file);
+    if (out) { fclose(out); RemoveFileAt(out_dir, temp_file); }
+    fclose(in);
+    ArenaRestore(chunk_arena, stream_pos);
+    return 0;
+
+failure:
+    // NOTE: Same error precedence as RenderPageBody: info command
+    // problems come first, so the file is read through again to look for
+    // them.
+    if (holding) { ArenaEndString(chunk_arena, held); }
+    if (out)     { fclose(out); RemoveFileAt(out_dir, temp_file); }
+    ArenaRestore(chunk_arena, stream_pos);
+
+    SCInfo unused;
+    Slice  info_error;
+    rewind(in);
+    reader = MakeSCStreamReader(in, SITE_STREAM_WINDOW_SIZE, arena, in_dir->path, file);
+    if (!GetStreamedSCInfo(&reader, arena, &unused, &info_error)) {
+        *out_error = info_error;
+    } else {
+        *out_error = html_error;
+    }
+
+    fclose(in);
+    return 0;
 }
 
 // Changes a file's extension to .html, producing a null terminated cstr
@@ -167,11 +459,11 @@ static const char *SwitchExtension(Slice in_file_name, Arena *arena) {
         curr++;
     }
 
-    char *out_begin = arena->current;
+    ArenaString out_string = ArenaBeginString(arena);
     ArenaPushSlice(arena, (Slice) {in_file_name.begin, curr});
-    ArenaPushCStr(arena, ".html");
+    ArenaPushLiteral(arena, ".html");
     ArenaPushChar(arena, 0);
-    return out_begin;
+    return ArenaEndString(arena, out_string).begin;
 }
 
 typedef struct BlogEntry {
@@ -179,7 +471,15 @@ typedef struct BlogEntry {
     Slice       date;
     const char *in_file_name;
     const char *out_file_name;
-    Slice       file_text;
+    HTMLSpans   body;        // Converted when the entry is loaded
+    int         loaded;      // Whether body is. With --incremental, entries
+                             // whose file didn't change aren't, unless their
+                             // page has to be made again (see LoadBlogEntry).
+    Slice       mapped;      // The entry's file, if it was mapped and the
+                             // body points into it. Unmapped with the blog.
+
+    SiteManifestRecord  record; // With --incremental
+    SiteManifestRecord *old;    // The last build's record, if there was one
 } BlogEntry;
 
 static int BlogEntryCmp(const void *va, const void *vb) {
@@ -190,15 +490,13 @@ static int BlogEntryCmp(const void *va, const void *vb) {
 
 // Generate a blog page. Unlike a normal page, a blog page has a second tier
 // of navigation for moving between blog posts
-static int GenerateBlogPage(SiteNavigation *nav, Slice site_title, Slice blog_title, 
-                     const char *path, const char *file,
+static void GenerateBlogPage(PageTemplate *blog_template, 
                      BlogEntry *prev, BlogEntry *entry, BlogEntry *next, 
-                     Arena *arena, Slice *page_data) { 
-    ArenaString out_string = ArenaBeginString(arena);
+                     Arena *arena, Page *page) { 
+    FillPageTemplate(blog_template, entry->title, entry->date, arena, page);
 
-    GenerateHeader(nav, site_title, blog_title, entry->title, arena);
-
-    ArenaPushCStr(arena,
+    ArenaString out_string = ArenaBeginString(arena);
+    ArenaPushLiteral(arena, 
                "<aside>\n"
                "  <nav>\n"
                "    <ul>\n"
@@ -206,330 +504,1517 @@ static int GenerateBlogPage(SiteNavigation *nav, Slice site_title, Slice blog_ti
 
 
     if (prev) {
-        ArenaPushCStr(arena, "      <li><a href=\"");
+        ArenaPushLiteral(arena, "      <li><a href=\"");
         ArenaPushCStr(arena, prev->out_file_name);
-        ArenaPushCStr(arena, "\">Prev</a></li>\n");
+        ArenaPushLiteral(arena, "\">Prev</a></li>\n");
     } else {
-        ArenaPushCStr(arena, "      <li>Prev</li>");
+        ArenaPushLiteral(arena, "      <li>Prev</li>");
     }
 
     if (next) {
-        ArenaPushCStr(arena, "      <li><a href=\"");
+        ArenaPushLiteral(arena, "      <li><a href=\"");
         ArenaPushCStr(arena, next->out_file_name);
-        ArenaPushCStr(arena, "\">Next</a></li>\n");
+        ArenaPushLiteral(arena, "\">Next</a></li>\n");
     } else {
-        ArenaPushCStr(arena, "      <li>Next</li>");
+        ArenaPushLiteral(arena, "      <li>Next</li>");
     }
 
-    ArenaPushCStr(arena, 
+    ArenaPushLiteral(arena, 
                   "      </div><div><li><a href=\"archive.html\">Archive</a></li>\n");
 
-    ArenaPushCStr(arena, "      <li><a href=\"");
+    ArenaPushLiteral(arena, "      <li><a href=\"");
     ArenaPushCStr(arena, entry->out_file_name);
-    ArenaPushCStr(arena, 
+    ArenaPushLiteral(arena, 
                   "\">Permalink</a></li>\n");
 
-    ArenaPushCStr(arena,
+    ArenaPushLiteral(arena, 
                "     </div>\n"
                "    </ul>\n"
                "  </nav>\n"
                "</aside>\n");
 
-    if (!SCToHTML(entry->file_text, path, file, arena, page_data)) {
+    page->parts[PagePart_BlogNav] = ArenaEndString(arena, out_string);
+    page->body                    = entry->body;
+}
+
+typedef struct Blog {
+    struct Blog    *next;     // With --jobs, blogs are written out in walk order
+    int             order;    // See SiteJob
+    const char     *rel_path; // See SiteDir
+    DirHandle      *in_dir;
+    DirHandle      *out_dir;
+    Slice           title;
+    PageTemplate    page_template;
+    BlogEntry       entries[SITE_BLOG_MAX_ENTRIES];
+    int             entries_count;
+} Blog;
+
+// A page found while walking the input directory.
+//
+// Without --jobs, each page is made as soon as it is found. With it, the
+// walk only queues pages up, and they are made afterwards by a pipeline of
+// threads (see SitePipeline).
+//
+// NOTE: Nothing here goes through the current directory, which all of
+// the threads share. Files are found through their directory's handle (see
+// JobDirHandle).
+typedef struct SiteJob {
+    struct SiteJob *next;
+    int             order;    // Place in the walk, so the first error wins
+    uint64_t        size;     // Of the input file
+    DirHandle      *in_dir;
+    const char     *file;
+    DirHandle      *out_dir;
+    const char     *out_file; // Normal pages only
+    BlogEntry      *entry;    // Blog entries only. These are just converted,
+                              // and written out later with their blog.
+    int             failed;
+    Slice           error;
+
+    // With --incremental, normal pages fill in their record in the new
+    // manifest, and are kept if their file only had its time changed (see
+    // KeptSiteJob)
+    SiteManifestRecord *record;
+    SiteManifestRecord *old;
+    int                 kept;
+} SiteJob;
+
+// Everything the walk has queued up, with --jobs
+typedef struct SiteJobs {
+    Arena     arena;      // The jobs and blogs, and the paths they use
+    int       threads;
+    int       depth;      // Slots in the pipeline (see SitePipeline)
+    int       order;      // Things found in the walk so far
+    SiteJob  *first;
+    SiteJob **last;
+    int       count;
+    Blog     *first_blog;
+    Blog    **last_blog;
+} SiteJobs;
+
+// Big files are converted without reading them in whole
+static int IsStreamedJob(SiteNavigation *nav, SiteJob *job) {
+    return !job->entry && job->size > nav->stream_above;
+}
+
+// With --incremental, what was made last time is only still good if the
+// output is still what the last build left there. Its size and modified time
+// are checked, not its bytes, so that is one stat per page.
+static int IsOutputUnchanged(DirHandle *out_dir, const char *name, SiteManifestRecord *old) {
+    FileInfo info = {0};
+    return old && GetFileInfoAt(out_dir, name, &info) &&
+           info.size     == old->output_size && 
+           info.modified == old->output_modified;
+}
+
+static void KeepOutputInfo(SiteManifestRecord *record, SiteManifestRecord *old) {
+    record->output_size     = old->output_size;
+    record->output_modified = old->output_modified;
+}
+
+// Notes the size and modified time of a page that was just written, or left
+// alone because it came out the same, in its record. If the page can't be
+// found, the zeros never match, and the page is made again next time.
+static void NoteSiteOutput(DirHandle *out_dir, const char *name, SiteManifestRecord *record) {
+    if (!record) { return; }
+
+    FileInfo info = {0};
+    GetFileInfoAt(out_dir, name, &info);
+    record->output_size     = info.size;
+    record->output_modified = info.modified;
+}
+
+// With --incremental, a file whose size or time changed is hashed once it is
+// read in, and if it turns out to be the same as last time, what was made out
+// of it last time is still good, as long as it is still there. A blog entry
+// gets its title and date from the manifest then, and is only converted if
+// its page has to be made again anyway (see KeepBlogPage). Streamed files
+// aren't read in whole, so they aren't hashed.
+static int KeptSiteJob(SiteNavigation *nav, SiteJob *job, Slice file_data) {
+    if (!nav->manifest || IsStreamedJob(nav, job)) { return 0; }
+
+    if (job->entry) {
+        BlogEntry *entry = job->entry;
+        entry->record.source_hash = SliceHash(file_data);
+        if (!entry->old || entry->old->source_hash != entry->record.source_hash) { return 0; }
+
+        entry->title = entry->old->title;
+        entry->date  = entry->old->date;
+        return 1; 
+    }
+
+    job->record->source_hash = SliceHash(file_data);
+    if (!job->old || job->old->source_hash != job->record->source_hash ||
+        !IsOutputUnchanged(job->out_dir, job->out_file, job->old)) { 
         return 0;
     }
 
-    GenerateFooter(nav, entry->date, arena);
+    KeepOutputInfo(job->record, job->old);
+    AtomicAdd(&nav->counts->skipped, 1);
+    return 1;
+}
+
+// Makes a job's page out of its file. A streamed page is read, made and
+// written out right here. A blog entry only has its body converted, since
+// the entries have to be sorted by date before their pages can be put
+// together. Anything else is left in *page, to be written with WritePage.
+// Nothing is made for a job that is kept (see KeptSiteJob).
+static int RenderSiteJob(SiteNavigation *nav, SiteJob *job, Slice file_data, 
+                         Arena *arena, Page *page, Slice *error) {
+    job->kept = KeptSiteJob(nav, job, file_data);
+    if (job->kept) { return 1; }
+
+    if (IsStreamedJob(nav, job)) {
+        if (!GenerateStreamedPage(nav, job->in_dir, job->file, 
+                                  job->out_dir, job->out_file, arena, error)) {
+            return 0; 
+        }
+
+        NoteSiteOutput(job->out_dir, job->out_file, job->record);
+        return 1; 
+    }
+
+    if (job->entry) {
+        SCInfo sc_info = {0};
+        if (!RenderPageBody(nav, file_data, job->in_dir->path, job->file, 
+                            arena, &sc_info, &job->entry->body, error)) { 
+            return 0; 
+        }
+
+        job->entry->title  = sc_info.title;
+        job->entry->date   = sc_info.date;
+        job->entry->loaded = 1;
+        return 1; 
+    }
+
+    return GenerateNormalPage(nav, file_data, job->in_dir->path, job->file, 
+                              arena, page, error);
+}
+
+// Makes one page. A normal page gives back the arena space it used, but a
+// blog entry stays in the arena until its blog has been written.
+static int RunSiteJob(SiteNavigation *nav, SiteJob *job, Arena *arena, Slice *error) {
+    ArenaPos pos       = ArenaSave(arena);
+    Slice    file_data = {0};
+    int      mapped    = 0;
+    Page     page      = {0};
+
+    if (!IsStreamedJob(nav, job) && 
+        !ReadOrMapEntireFileAt(job->in_dir, job->file, SITE_MAP_ABOVE, 
+                               arena, &file_data, &mapped)) {
+        *error = ArenaPrintf(arena, "Could not read file: %s\n", job->file);
+        return 0; 
+    }
+
+    int made = RenderSiteJob(nav, job, file_data, arena, &page, error);
+    if (made && job->entry && job->entry->loaded) { 
+        if (mapped) { job->entry->mapped = file_data; }
+        return 1; 
+    }
+
+    if (made && !job->kept && !IsStreamedJob(nav, job)) {
+        if (WritePage(&page, job->out_dir, job->out_file, nav->counts, arena)) {
+            NoteSiteOutput(job->out_dir, job->out_file, job->record);
+        } else {
+            *error = ArenaPrintf(arena, "Could not write file: %s\n", job->out_file);
+            made   = 0;
+        }
+    }
+
+    if (mapped) { UnmapEntireFile(file_data); }
+    if (made)   { ArenaRestore(arena, pos); }
+    return made;
+}
 
-    *page_data = ArenaEndString(arena, out_string);
+// The handle that jobs for pages in dir use. Without --jobs, that is the
+// walk's own. With it, the pages are made after the walk has closed its
+// handles, so they get one that goes by path, instead of every directory
+// being held open until then.
+static DirHandle *JobDirHandle(SiteNavigation *nav, DirHandle *dir) {
+    if (!nav->jobs) { return dir; }
+
+    Arena *keep = &nav->jobs->arena;
+    ArenaAlign(keep, sizeof(void*));
+    DirHandle *kept = ArenaPush(keep, DirHandle);
+    *kept = PathDirHandle(ArenaCloneCStr(keep, dir->path));
+    return kept;
+}
+
+// Makes the page right away, or queues it up with --jobs
+static int AddSiteJob(SiteNavigation *nav, SiteJob *job, Arena *arena, Slice *error) {
+    SiteJobs *jobs = nav->jobs;
+    if (!jobs) { return RunSiteJob(nav, job, arena, error); }
+
+    ArenaAlign(&jobs->arena, sizeof(void*));
+    SiteJob *queued = ArenaPush(&jobs->arena, SiteJob);
+    *queued       = *job;
+    queued->order = jobs->order++;
+    *jobs->last   = queued;
+    jobs->last    = &queued->next;
+    jobs->count++;
     return 1;
 }
 
-typedef struct Blog {
-    Slice      title;
-    BlogEntry  entries[SITE_BLOG_MAX_ENTRIES];
-    int        entries_count;
-} Blog;
+// Gives back the files of a blog's entries that were mapped, once nothing
+// points into them anymore
+static void UnmapBlogEntries(Blog *blog) {
+    for (int i = 0; i < blog->entries_count; i++) {
+        BlogEntry *entry = blog->entries + i;
+        if (entry->mapped.begin) { UnmapEntireFile(entry->mapped); }
+        entry->mapped = (Slice) {0};
+    }
+}
+
+// With --incremental, entries whose file didn't change aren't converted
+// when their blog is loaded. This converts one after all, when its page has
+// to be made again.
+static int LoadBlogEntry(SiteNavigation *nav, Blog *blog, BlogEntry *entry, 
+                         Arena *arena, Slice *error) {
+    Slice  file_data = {0};
+    int    mapped    = 0;
+    SCInfo sc_info   = {0};
+    if (!ReadOrMapEntireFileAt(blog->in_dir, entry->in_file_name, SITE_MAP_ABOVE, 
+                               arena, &file_data, &mapped)) {
+        *error = ArenaPrintf(arena, "Could not read file: %s\n", entry->in_file_name);
+        return 0; 
+    }
+
+    if (mapped) { entry->mapped = file_data; }
+    if (!RenderPageBody(nav, file_data, blog->in_dir->path, entry->in_file_name, 
+                        arena, &sc_info, &entry->body, error)) { 
+        return 0; 
+    }
+
+    entry->loaded = 1;
+    return 1;
+}
+
+static int MakeBlogPage(SiteNavigation *nav, Blog *blog, 
+                        BlogEntry *prev, BlogEntry *entry, BlogEntry *next, 
+                        Arena *arena, Page *page, Slice *error) {
+    if (!entry->loaded && !LoadBlogEntry(nav, blog, entry, arena, error)) { return 0; }
+    GenerateBlogPage(&blog->page_template, prev, entry, next, arena, page);
+    return 1;
+}
+
+// With --incremental, a blog page depends on its entry's file, the blog's
+// title, and which pages come before and after it. This adds the entry's
+// record, in *added, and says whether the page made last time is still good.
+static int KeepBlogPage(SiteNavigation *nav, Blog *blog, 
+                        BlogEntry *prev, BlogEntry *entry, BlogEntry *next, 
+                        Arena *arena, SiteManifestRecord **added) {
+    *added = 0;
+    if (!nav->manifest) { return 0; }
+
+    ArenaPos    pos  = ArenaSave(arena);
+    ArenaString deps = ArenaBeginString(arena);
+    ArenaPushSlice(arena, blog->title);
+    ArenaPushChar (arena, 0);
+    ArenaPushCStr (arena, prev ? prev->out_file_name : "");
+    ArenaPushChar (arena, 0);
+    ArenaPushCStr (arena, next ? next->out_file_name : "");
+    entry->record.deps_hash = SliceHash(ArenaEndString(arena, deps));
+    entry->record.title     = entry->title;
+    entry->record.date      = entry->date;
+    ArenaRestore(arena, pos);
+
+    // Not being loaded means the file didn't change (see KeptSiteJob)
+    int kept = !entry->loaded && entry->old && 
+               entry->old->deps_hash == entry->record.deps_hash &&
+               IsOutputUnchanged(blog->out_dir, entry->out_file_name, entry->old);
+    if (kept) { 
+        KeepOutputInfo(&entry->record, entry->old);
+        AtomicAdd(&nav->counts->skipped, 1); 
+    }
+
+    *added = AddSiteManifestRecord(nav->manifest, &entry->record);
+    return kept;
+}
+
+// The index is the newest entry's page, so it only changes along with that,
+// or when a different entry is the newest
+static int KeepBlogIndex(SiteNavigation *nav, Blog *blog, BlogEntry *newest, 
+                         Arena *arena, SiteManifestRecord **added) {
+    *added = 0;
+    if (!nav->manifest) { return 0; }
+
+    ArenaPos    pos  = ArenaSave(arena);
+    ArenaString deps = ArenaBeginString(arena);
+    ArenaPushCStr(arena, newest->out_file_name);
+    ArenaPushData(arena, (char*)&newest->record.deps_hash, sizeof(newest->record.deps_hash));
+
+    SiteManifestRecord record = {
+        .key         = SiteManifestKey(blog->rel_path, "index.html"),
+        .source_hash = newest->record.source_hash,
+        .deps_hash   = SliceHash(ArenaEndString(arena, deps)),
+    };
+    ArenaRestore(arena, pos);
+
+    SiteManifestRecord *old  = FindSiteManifestRecord(nav->manifest, record.key);
+    int                 kept = old && 
+                               old->source_hash == record.source_hash && 
+                               old->deps_hash   == record.deps_hash &&
+                               IsOutputUnchanged(blog->out_dir, "index.html", old);
+    if (kept) { KeepOutputInfo(&record, old); }
+
+    *added = AddSiteManifestRecord(nav->manifest, &record);
+    return kept;
+}
+
+// The archive lists every entry, so it changes when any of their names,
+// titles or dates do, or when they come in a different order
+static int KeepBlogArchive(SiteNavigation *nav, Blog *blog, 
+                           Arena *arena, SiteManifestRecord **added) {
+    *added = 0;
+    if (!nav->manifest) { return 0; }
+
+    ArenaPos    pos  = ArenaSave(arena);
+    ArenaString deps = ArenaBeginString(arena);
+    ArenaPushSlice(arena, blog->title);
+    for (int i = 0; i < blog->entries_count; i++) {
+        ArenaPushChar (arena, 0);
+        ArenaPushCStr (arena, blog->entries[i].out_file_name);
+        ArenaPushChar (arena, 0);
+        ArenaPushSlice(arena, blog->entries[i].date);
+        ArenaPushChar (arena, 0);
+        ArenaPushSlice(arena, blog->entries[i].title);
+    }
+
+    SiteManifestRecord record = {
+        .key       = SiteManifestKey(blog->rel_path, "archive.html"),
+        .deps_hash = SliceHash(ArenaEndString(arena, deps)),
+    };
+    ArenaRestore(arena, pos);
+
+    SiteManifestRecord *old  = FindSiteManifestRecord(nav->manifest, record.key);
+    int                 kept = old && old->deps_hash == record.deps_hash &&
+                               IsOutputUnchanged(blog->out_dir, "archive.html", old);
+    if (kept) { 
+        KeepOutputInfo(&record, old);
+        AtomicAdd(&nav->counts->skipped, 1); 
+    }
+
+    *added = AddSiteManifestRecord(nav->manifest, &record);
+    return kept;
+}
+
+// Writes out the pages of a blog once all of its entries are converted. With
+// --incremental, pages that would come out the same as last time are left
+// alone.
+static int WriteBlog(Blog *blog, SiteNavigation *nav, Arena *arena, Slice *error) {
+    // Sort the blog pages
+    qsort(blog->entries, 
+          blog->entries_count, sizeof(*blog->entries),
+          BlogEntryCmp);
+
+    // Generate the blog pages, with ordered navigation links
+    int outer_phase = ArenaStatsPhase(arena, SitePhase_PageRender);
+    for (int i = 0; i < blog->entries_count; i++) {
+        ArenaPos iter_pos = ArenaSave(arena);
+        BlogEntry *entry  = blog->entries + i;
+        BlogEntry *prev   = i > 0                      ? entry - 1 : 0;
+        BlogEntry *next   = i < blog->entries_count - 1 ? entry + 1 : 0;
+
+        Page                page      = {0};
+        SiteManifestRecord *record    = 0;
+        int                 make_page = !KeepBlogPage(nav, blog, prev, entry, next, arena, &record);
+        if (make_page) {
+            if (!MakeBlogPage(nav, blog, prev, entry, next, arena, &page, error)) { return 0; }
+            if (!WritePage(&page, blog->out_dir, entry->out_file_name, nav->counts, arena)) {
+                *error = ArenaPrintf(arena, "Could not write file: %s\n", entry->out_file_name);
+                return 0; 
+            }
+
+            NoteSiteOutput(blog->out_dir, entry->out_file_name, record);
+        }
+
+        // The newest entry is also the blog's index. It is a link to the
+        // entry's page where the file system allows, instead of a second copy.
+        if (i == blog->entries_count-1 && !KeepBlogIndex(nav, blog, entry, arena, &record)) {
+            if (!LinkFileAt(blog->out_dir, entry->out_file_name, "index.html")) {
+                if (!make_page && !MakeBlogPage(nav, blog, prev, entry, next, arena, &page, error)) {
+                    return 0; 
+                }
+
+                if (!WritePage(&page, blog->out_dir, "index.html", nav->counts, arena)) {
+                    *error = ArenaPrintf(arena, "Could not write file: %s\n", "index.html");
+                    return 0; 
+                }
+            }
+
+            NoteSiteOutput(blog->out_dir, "index.html", record);
+        }
+
+        ArenaRestore(arena, iter_pos);
+    }
+
+    ArenaStatsPhase(arena, SitePhase_Archive);
+    SiteManifestRecord *record = 0;
+    if (!KeepBlogArchive(nav, blog, arena, &record)) { // Generate archive page
+        ArenaString str = ArenaBeginString(arena);
+        ArenaPushSlice(arena, blog->title);
+        ArenaPushLiteral(arena, " - Archive");
+        Slice blog_archive_title = ArenaEndString(arena, str);
+
+        Page page = {0};
+        FillPageTemplate(&blog->page_template, SliceFromCStr("Archive"), 
+                         blog->entries_count ? blog->entries[blog->entries_count-1].date 
+                                             : SliceFromCStr(""),
+                         arena, &page);
+
+        str = ArenaBeginString(arena);
+        ArenaPushLiteral(arena, "<article>\n");
+        ArenaPushLiteral(arena, "  <h1>\n");
+        ArenaPushSlice(arena, blog_archive_title);
+        ArenaPushLiteral(arena, "  </h1>\n");
+        ArenaPushLiteral(arena, "    <ul>\n");
+
+        for (int i = 0; i < blog->entries_count; i++) {
+            ArenaPushLiteral(arena, "<li><a href=\"");
+            ArenaPushCStr(arena, blog->entries[i].out_file_name);
+            ArenaPushLiteral(arena, "\">");
+            ArenaPushSlice(arena, blog->entries[i].date);
+            ArenaPushLiteral(arena, " - ");
+            ArenaPushSlice(arena, blog->entries[i].title);
+            ArenaPushLiteral(arena, "</a></li>\n");
+        }
+
+        ArenaPushLiteral(arena, "    </ul>");
+        ArenaPushLiteral(arena, "</article>\n");
+        Slice archive = ArenaEndString(arena, str);
+        page.body     = (HTMLSpans) {&archive, 1};
+
+        if (!WritePage(&page, blog->out_dir, "archive.html", nav->counts, arena)) {
+            *error = ArenaPrintf(arena, "Could not write file: %s\n", "archive.html");
+            return 0; 
+        }
+
+        NoteSiteOutput(blog->out_dir, "archive.html", record);
+    }
+
+    ArenaStatsPhase(arena, outer_phase);
+    return 1;
+}
+
+// A page on its way through the pipeline (see SitePipeline). Each slot has an
+// arena of its own, which holds the file, and then the page made out of it,
+// until the page is written and the slot can take the next one. A big file
+// is mapped instead, and stays mapped until then.
+typedef struct SiteSlot {
+    Arena     arena;
+    SiteJob  *job;
+    Slice     file_data;
+    int       mapped;
+    int       read;      // False if the file could not be read
+    Page      page;
+} SiteSlot;
+
+// First in, first out, holding up to SitePipeline.slots_count slots
+typedef struct SiteSlotQueue {
+    SiteSlot **slots;
+    int        head;
+    int        count;
+} SiteSlotQueue;
+
+typedef enum SiteStage {
+    SiteStage_Read,
+    SiteStage_Render,
+    SiteStage_Write,
+} SiteStage;
+
+// One thread of the pipeline. Each has its own arenas, and its own copy of
+// the navigation pointing at them.
+typedef struct SiteWorker {
+    SiteNavigation nav;
+    Arena          arena;       // Blog entries and errors, which outlive slots
+    Arena          scratch;
+    Arena          cache_arena;
+    SCCache        cache;
+} SiteWorker;
+
+// With --jobs, pages go through three stages: their file is read in, the
+// page is made, and then it is written out. Any thread can do any stage, but
+// only `renderers` threads make pages at once, so the others are left to
+// read ahead and write behind, and waiting on the disk overlaps with making
+// pages.
+//
+// A page waits between stages in one of slots_count slots, so reading can
+// only get so far ahead, and memory use stays bounded.
+typedef struct SitePipeline {
+    Monitor       *monitor;     // Everything below is used under its lock
+    SiteJob      **jobs;
+    int            jobs_count;
+    int            next_job;
+    int            slots_count;
+    SiteSlotQueue  free_slots;
+    SiteSlotQueue  read_slots;  // Waiting to be made
+    SiteSlotQueue  made_slots;  // Waiting to be written
+    int            busy;        // Slots that are in a stage right now
+    int            rendering;
+    int            renderers;
+    int            first_error; // Lowest order of a job that failed so far
+    SiteWorker    *workers;
+} SitePipeline;
+
+static void PushSlot(SitePipeline *p, SiteSlotQueue *q, SiteSlot *slot) {
+    q->slots[(q->head + q->count++) % p->slots_count] = slot;
+}
+
+static SiteSlot *PopSlot(SitePipeline *p, SiteSlotQueue *q) {
+    SiteSlot *slot = q->slots[q->head];
+    q->head = (q->head + 1) % p->slots_count;
+    q->count--;
+    return slot;
+}
+
+// Whether there is a job left to read. Nothing after a failure would have
+// been made without --jobs, so those jobs are passed over.
+static int HasNextSiteJob(SitePipeline *p) {
+    while (p->next_job < p->jobs_count && 
+           p->jobs[p->next_job]->order > p->first_error) {
+        p->next_job++;
+    }
+
+    return p->next_job < p->jobs_count;
+}
+
+// A blog entry's body and info point into its slot, which is about to be
+// reused, so they are copied somewhere that lasts until the blog is written
+static void KeepBlogEntry(BlogEntry *entry, Arena *arena) {
+    entry->title = ArenaPushSlice(arena, entry->title);
+    entry->date  = ArenaPushSlice(arena, entry->date);
+
+    ArenaString body = ArenaBeginString(arena);
+    for (int i = 0; i < entry->body.count; i++) {
+        ArenaPushSlice(arena, entry->body.spans[i]);
+    }
+    Slice kept = ArenaEndString(arena, body);
+
+    ArenaAlign(arena, sizeof(void*));
+    entry->body.spans    = ArenaPush(arena, Slice);
+    entry->body.spans[0] = kept;
+    entry->body.count    = 1;
+}
 
-static int GenerateBlogDirectory(const char *in_dir_absolute,
-                 const char *out_dir_absolute,
+// Lets go of everything the slot held, so it can take the next page
+static void ClearSlot(SiteSlot *slot) {
+    if (slot->mapped) { UnmapEntireFile(slot->file_data); }
+    slot->mapped = 0;
+    ArenaReset(&slot->arena);
+}
+
+// Runs one stage for the page in a slot, without the lock held. Returns the
+// queue the slot goes to next, or 0 if it is done with.
+static SiteSlotQueue *RunSiteStage(SitePipeline *p, SiteWorker *w, 
+                                   SiteSlot *slot, SiteStage stage) {
+    SiteJob       *job   = slot->job;
+    SiteSlotQueue *next  = 0;
+    Slice          error = {0};
+
+    switch (stage) {
+    case SiteStage_Read:
+    {
+        slot->file_data = (Slice) {0};
+        slot->read      = IsStreamedJob(&w->nav, job) ||
+                          ReadOrMapEntireFileAt(job->in_dir, job->file, SITE_MAP_ABOVE,
+                                                &slot->arena, &slot->file_data, 
+                                                &slot->mapped);
+        next            = &p->read_slots;
+    } break;
+
+    case SiteStage_Render:
+    {
+        memset(&slot->page, 0, sizeof(slot->page));
+        if (!slot->read) {
+            job->error  = ArenaPrintf(&w->arena, "Could not read file: %s\n", job->file);
+            job->failed = 1;
+        } else if (!RenderSiteJob(&w->nav, job, slot->file_data, 
+                                  &slot->arena, &slot->page, &error)) {
+            job->error  = ArenaPushSlice(&w->arena, error);
+            job->failed = 1;
+        } else if (job->kept) {
+            // Nothing to write (see KeptSiteJob)
+        } else if (job->entry) {
+            KeepBlogEntry(job->entry, &w->arena);
+        } else if (!IsStreamedJob(&w->nav, job)) {
+            next = &p->made_slots;
+        }
+    } break;
+
+    case SiteStage_Write:
+    {
+        if (WritePage(&slot->page, job->out_dir, job->out_file, w->nav.counts, &slot->arena)) {
+            NoteSiteOutput(job->out_dir, job->out_file, job->record);
+        } else {
+            job->error  = ArenaPrintf(&w->arena, "Could not write file: %s\n", job->out_file);
+            job->failed = 1;
+        }
+    } break;
+    }
+
+    return next;
+}
+
+static void SitePipelineThread(void *data, int index) {
+    SitePipeline *p = (SitePipeline*)data;
+    SiteWorker   *w = p->workers + index;
+
+    MonitorLock(p->monitor);
+    for (;;) {
+        // Later stages go first, so finished pages give their slots back
+        SiteSlot *slot  = 0;
+        SiteStage stage = SiteStage_Read;
+        if (p->made_slots.count) {
+            slot  = PopSlot(p, &p->made_slots);
+            stage = SiteStage_Write;
+        } else if (p->read_slots.count && p->rendering < p->renderers) {
+            slot  = PopSlot(p, &p->read_slots);
+            stage = SiteStage_Render;
+
+            // Read before a failure showed up
+            if (slot->job->order > p->first_error) {
+                ClearSlot(slot);
+                PushSlot(p, &p->free_slots, slot);
+                MonitorWakeAll(p->monitor);
+                continue;
+            }
+
+            p->rendering++;
+        } else if (p->free_slots.count && HasNextSiteJob(p)) {
+            slot      = PopSlot(p, &p->free_slots);
+            slot->job = p->jobs[p->next_job++];
+            stage     = SiteStage_Read;
+        } else if (!p->busy && !p->read_slots.count && !HasNextSiteJob(p)) {
+            break;
+        } else {
+            MonitorWait(p->monitor);
+            continue;
+        }
+
+        p->busy++;
+        MonitorUnlock(p->monitor);
+        SiteSlotQueue *next = RunSiteStage(p, w, slot, stage);
+        MonitorLock(p->monitor);
+        p->busy--;
+
+        if (stage == SiteStage_Render) { p->rendering--; }
+
+        if (slot->job->failed && slot->job->order < p->first_error) {
+            p->first_error = slot->job->order;
+        }
+
+        if (next) {
+            PushSlot(p, next, slot);
+        } else {
+            ClearSlot(slot);
+            PushSlot(p, &p->free_slots, slot);
+        }
+
+        MonitorWakeAll(p->monitor);
+    }
+
+    MonitorUnlock(p->monitor);
+}
+
+// Biggest first, so one huge page doesn't start last and hold everything up
+static int SiteJobCmp(const void *va, const void *vb) {
+    SiteJob *a = *(SiteJob**)va;
+    SiteJob *b = *(SiteJob**)vb;
+    if (a->size != b->size) { return a->size > b->size ? -1 : 1; }
+    return a->order - b->order;
+}
+
+// Makes everything the walk queued up, then writes out the blogs. walked is
+// whether the walk got all the way through. 
+//
+// NOTE: Pages are made in any order, but the error that gets reported
+// is the one that comes first in the walk, same as without --jobs.
+// Workers skip anything that comes after a failure they know about.
+static int RunSiteJobs(SiteNavigation *nav, SiteJobs *jobs, int walked, 
+                       Arena *arena, Slice *error) {
+    SitePipeline p = {0};
+    p.first_error  = walked ? INT_MAX : jobs->order;
+
+    ArenaAlign(&jobs->arena, sizeof(void*));
+    p.jobs = ArenaPushMany(&jobs->arena, SiteJob*, jobs->count);
+    for (SiteJob *job = jobs->first; job; job = job->next) { p.jobs[p.jobs_count++] = job; }
+    qsort(p.jobs, p.jobs_count, sizeof(*p.jobs), SiteJobCmp);
+
+    // Two threads more than make pages, to read and write
+    p.renderers = jobs->threads;
+    if (p.renderers > MAX_THREADS - 2) { p.renderers = MAX_THREADS - 2; }
+    if (p.renderers < 1)               { p.renderers = 1; }
+
+    int threads = p.renderers + 2;
+    if (threads > p.jobs_count) { threads = p.jobs_count; }
+    if (threads < 1)            { threads = 1; }
+
+    p.slots_count = jobs->depth;
+    if (p.slots_count > SITE_PIPELINE_MAX_DEPTH) { p.slots_count = SITE_PIPELINE_MAX_DEPTH; }
+    if (p.slots_count < 1)                       { p.slots_count = 1; }
+
+    SiteSlot *slots = ArenaPushMany(&jobs->arena, SiteSlot, p.slots_count);
+    p.free_slots.slots = ArenaPushMany(&jobs->arena, SiteSlot*, p.slots_count);
+    p.read_slots.slots = ArenaPushMany(&jobs->arena, SiteSlot*, p.slots_count);
+    p.made_slots.slots = ArenaPushMany(&jobs->arena, SiteSlot*, p.slots_count);
+    for (int i = 0; i < p.slots_count; i++) {
+        memset(slots + i, 0, sizeof(*slots));
+        slots[i].arena = AllocArena(ARENA_SIZE);
+        PushSlot(&p, &p.free_slots, slots + i);
+    }
+
+    p.workers = ArenaPushMany(&jobs->arena, SiteWorker, threads);
+    for (int i = 0; i < threads; i++) {
+        SiteWorker *w = p.workers + i;
+        memset(w, 0, sizeof(*w));
+        w->arena       = AllocArena(ARENA_SIZE);
+        w->scratch     = AllocArena(ARENA_SIZE);
+        w->nav         = *nav;
+        w->nav.scratch = &w->scratch;
+        w->nav.jobs    = 0;
+
+        if (nav->cache) {
+            w->cache_arena = AllocArena(ARENA_SIZE);
+            w->cache       = (SCCache) {nav->cache->dir, &w->cache_arena};
+            w->nav.cache   = &w->cache;
+        }
+    }
+
+    p.monitor = AllocMonitor();
+    RunParallel(SitePipelineThread, &p, threads);
+    FreeMonitor(p.monitor);
+
+    SiteJob *failed = 0;
+    for (int i = 0; i < p.jobs_count; i++) {
+        SiteJob *job = p.jobs[i];
+        if (job->failed && (!failed || job->order < failed->order)) { failed = job; }
+    }
+
+    if (failed) {
+        *error = ArenaPushSlice(arena, failed->error);
+    }
+
+    // Blogs can only be written if everything before them went well
+    int first_error = p.first_error;
+    for (Blog *blog = jobs->first_blog; blog && blog->order < first_error; blog = blog->next) {
+        if (!WriteBlog(blog, nav, arena, error)) { 
+            first_error = blog->order;
+            break;
+        }
+    }
+
+    for (int i = 0; i < p.slots_count; i++) { FreeArena(&slots[i].arena); }
+    for (int i = 0; i < threads; i++) {
+        FreeArena(&p.workers[i].arena);
+        FreeArena(&p.workers[i].scratch);
+        if (nav->cache) { FreeArena(&p.workers[i].cache_arena); }
+    }
+
+    return first_error == INT_MAX;
+}
+
+// Without --jobs, the small pages in a directory are read in and written out
+// a batch at a time (see FileBatch), instead of one file at a time
+typedef struct PageBatch {
+    FileBatchItem       items[FILE_BATCH_MAX_ITEMS];
+    int                 count;
+    uint64_t            size;
+    SiteManifestRecord *records[FILE_BATCH_MAX_ITEMS]; // With --incremental,
+    SiteManifestRecord *olds   [FILE_BATCH_MAX_ITEMS]; // see SiteJob
+} PageBatch;
+
+// Whether the page can go in the batch, or has to be made on its own
+static int FitsInPageBatch(SiteNavigation *nav, uint64_t size) {
+    return nav->files && 
+           size <= SITE_BATCH_FILE_SIZE && 
+           size <= nav->stream_above;
+}
+
+// Makes and writes out the pages in the batch, the same as if they had each
+// been made on their own, in order: a page is only written if everything
+// before it went well, and the first thing to go wrong is the error.
+static int RunPageBatch(SiteNavigation *nav, PageBatch *batch, 
+                        DirHandle *in_dir, DirHandle *out_dir, 
+                        Arena *arena, Slice *error) {
+    if (!batch->count) { return 1; }
+
+    ArenaPos       pos   = ArenaSave(arena);
+    FileBatchItem *items = batch->items;
+    ReadEntireFilesAt(nav->files, in_dir, items, batch->count, arena);
+
+    // The pages are made into the arena, and the inputs become the outputs
+    Slice page_error = NullSlice();
+    int   kept[FILE_BATCH_MAX_ITEMS];
+    int   made       = 0;
+    for (; made < batch->count; made++) {
+        FileBatchItem *item = items + made;
+        kept[made] = 0;
+
+        if (!item->ok) {
+            page_error = ArenaPrintf(arena, "Could not read file: %s\n", item->name);
+            break;
+        }
+
+        const char *in_name = item->name;
+        item->name = SwitchExtension(SliceFromCStr(in_name), arena);
+
+        // The same as KeptSiteJob
+        if (nav->manifest) {
+            SiteManifestRecord *old    = batch->olds[made];
+            SiteManifestRecord *record = batch->records[made];
+            record->source_hash = SliceHash(item->data);
+            kept[made] = old && old->source_hash == record->source_hash &&
+                         IsOutputUnchanged(out_dir, item->name, old);
+            if (kept[made]) {
+                KeepOutputInfo(record, old);
+                AtomicAdd(&nav->counts->skipped, 1);
+                continue;
+            }
+        }
+
+        Page page = {0};
+        if (!GenerateNormalPage(nav, item->data, in_dir->path, in_name, 
+                                arena, &page, &page_error)) {
+            break;
+        }
+
+        item->parts_count = LayOutPage(&page, arena, &item->parts);
+    }
+
+    ArenaAlign(arena, sizeof(void*));
+    FileBatchItem       *writes        = ArenaPushMany(arena, FileBatchItem, made);
+    SiteManifestRecord **write_records = ArenaPushMany(arena, SiteManifestRecord*, made);
+    int                  writes_count  = 0;
+    for (int i = 0; i < made; i++) {
+        if (kept[i]) { continue; }
+        write_records[writes_count] = nav->manifest ? batch->records[i] : 0;
+        writes[writes_count++]      = items[i];
+    }
+
+    WriteEntireFilesAt(nav->files, out_dir, writes, writes_count, arena);
+    for (int i = 0; i < writes_count; i++) {
+        if (!writes[i].ok) {
+            *error = ArenaPrintf(arena, "Could not write file: %s\n", writes[i].name);
+            return 0; 
+        }
+
+        CountWrite(nav->counts, writes[i].changed);
+        NoteSiteOutput(out_dir, writes[i].name, write_records[i]);
+    }
+
+    if (made < batch->count) {
+        *error = page_error;
+        return 0; 
+    }
+
+    batch->count = 0;
+    batch->size  = 0;
+    ArenaRestore(arena, pos);
+    return 1;
+}
+
+typedef enum SiteDirKind {
+    SiteDirKind_Normal,
+    SiteDirKind_Blog,
+} SiteDirKind;
+
+// A page, or a subdirectory, found by the scan
+typedef struct SiteEntry {
+    const char     *name;
+    uint64_t        size;     // Pages only
+    int64_t         modified; // Pages only
+    struct SiteDir *dir;      // Subdirectories only
+} SiteEntry;
+
+// A directory of the input, as found by the scan (see ScanSite). The walk
+// goes through these instead of listing directories itself, so it sees
+// everything in the same order every time, whatever order the file system
+// keeps it in.
+//
+// Only .sc files and subdirectories are kept. Static directories are copied
+// as they are, so they aren't scanned.
+typedef struct SiteDir {
+    struct SiteDir *parent;
+    struct SiteDir *next;          // While waiting to be scanned
+    const char     *name;          // The whole path, for the root
+    const char     *path;          // Absolute, once it is opened
+    const char     *rel_path;      // From the root, which is ""
+    SiteDirKind     kind;
+    int             opened;        // False if it could not be opened
+    SiteEntry      *entries;       // Sorted by name
+    int             entries_count;
+    uint64_t        rollup;        // With --incremental (see RollUpSiteDir)
+} SiteDir;
+
+static int SiteEntryCmp(const void *va, const void *vb) {
+    SiteEntry *a = (SiteEntry*)va;
+    SiteEntry *b = (SiteEntry*)vb;
+    return strcmp(a->name, b->name);
+}
+
+// Lists a directory, with the size of each page in it, and gives back the
+// subdirectories it found, to be scanned in turn. They are kept in arena,
+// and scratch is only used while listing.
+static SiteDir *ScanSiteDir(SiteDir *dir, Arena *arena, Arena *scratch) {
+    DirHandle parent = {0};
+    DirHandle handle = {0};
+    if (dir->parent) { parent = PathDirHandle(dir->parent->path); }
+    if (!OpenDirHandle(dir->parent ? &parent : 0, dir->name, arena, &handle)) { return 0; }
+    dir->path   = handle.path;
+    dir->opened = 1;
+
+    ArenaPos   pos      = ArenaSave(scratch);
+    DirIter   *iter     = ArenaPushDirIter(scratch);
+    SiteDir   *found    = 0;
+    SiteDir  **last     = &found;
+    int        capacity = 64;
+    int        count    = 0;
+    ArenaAlign(scratch, sizeof(void*));
+    SiteEntry *entries  = ArenaPushMany(scratch, SiteEntry, capacity);
+
+    BeginDirIterAt(iter, &handle);
+    while (GetNextFile(iter)) {
+        const char *name_cstr = GetFileName(iter);
+        Slice       name      = SliceFromCStr(name_cstr);
+        SiteEntry   entry     = {0};
+
+        if (IsDirectory(iter)) {
+            if (SliceEqCStr(name, "."))      { continue; }
+            if (SliceEqCStr(name, ".."))     { continue; }
+            if (SliceEqCStr(name, "static")) { continue; }
+
+            ArenaAlign(arena, sizeof(void*));
+            SiteDir *sub = ArenaPush(arena, SiteDir);
+            memset(sub, 0, sizeof(*sub));
+            sub->parent   = dir;
+            sub->name     = ArenaCloneCStr(arena, name_cstr);
+            sub->rel_path = dir->rel_path[0] ? ArenaPrintfCStr(arena, "%s/%s", dir->rel_path, name_cstr)
+                                             : sub->name;
+            sub->kind     = SliceStartsWithCStr(name, "blog_") ? SiteDirKind_Blog 
+                                                               : SiteDirKind_Normal;
+            *last         = sub;
+            last          = &sub->next;
+
+            entry.name = sub->name;
+            entry.dir  = sub;
+        } else {
+            if (!SliceEndsWithCStr(name, ".sc")) { continue; }
+
+            FileInfo file_info = {0};
+            GetFileInfoAt(&handle, name_cstr, &file_info);
+            entry.name     = ArenaCloneCStr(arena, name_cstr);
+            entry.size     = file_info.size;
+            entry.modified = file_info.modified;
+        }
+
+        if (count == capacity) {
+            SiteEntry *more = ArenaPushMany(scratch, SiteEntry, capacity * 2);
+            memcpy(more, entries, sizeof(*entries) * count);
+            entries   = more;
+            capacity *= 2;
+        }
+
+        entries[count++] = entry;
+    }
+
+    EndDirIter(iter);
+    CloseDirHandle(&handle);
+
+    qsort(entries, count, sizeof(*entries), SiteEntryCmp);
+    ArenaAlign(arena, sizeof(void*));
+    dir->entries       = ArenaPushMany(arena, SiteEntry, count);
+    dir->entries_count = count;
+    memcpy(dir->entries, entries, sizeof(*entries) * count);
+
+    ArenaRestore(scratch, pos);
+    return found;
+}
+
+// The scan lists directories on several threads at once. Each directory it
+// finds goes on the pending list, for whichever thread is free first.
+typedef struct SiteScan {
+    Monitor *monitor;  // pending and busy are used under its lock
+    SiteDir *pending;
+    int      busy;     // Directories being listed right now
+    Arena   *arenas;
+    Arena   *scratch;
+} SiteScan;
+
+static void SiteScanThread(void *data, int index) {
+    SiteScan *scan = (SiteScan*)data;
+
+    MonitorLock(scan->monitor);
+    for (;;) {
+        if (!scan->pending) {
+            if (!scan->busy) { break; }
+            MonitorWait(scan->monitor);
+            continue;
+        }
+
+        SiteDir *dir  = scan->pending;
+        scan->pending = dir->next;
+        dir->next     = 0;
+        scan->busy++;
+        MonitorUnlock(scan->monitor);
+
+        SiteDir *found = ScanSiteDir(dir, scan->arenas + index, scan->scratch + index);
+
+        MonitorLock(scan->monitor);
+        while (found) {
+            SiteDir *next = found->next;
+            found->next   = scan->pending;
+            scan->pending = found;
+            found         = next;
+        }
+
+        scan->busy--;
+        MonitorWakeAll(scan->monitor);
+    }
+
+    MonitorUnlock(scan->monitor);
+}
+
+// Finds everything under root before anything is made, on `threads`
+// threads. What thread i finds goes in arenas[i], which have to last as
+// long as the tree is used.
+static void ScanSite(SiteDir *root, int threads, Arena *arenas) {
+    if (threads > MAX_THREADS) { threads = MAX_THREADS; }
+    if (threads < 1)           { threads = 1; }
+
+    Arena    scratch[MAX_THREADS];
+    SiteScan scan = {0};
+    scan.monitor  = AllocMonitor();
+    scan.pending  = root;
+    scan.arenas   = arenas;
+    scan.scratch  = scratch;
+    for (int i = 0; i < threads; i++) { scratch[i] = AllocArena(ARENA_SIZE); }
+
+    RunParallel(SiteScanThread, &scan, threads);
+
+    for (int i = 0; i < threads; i++) { FreeArena(&scratch[i]); }
+    FreeMonitor(scan.monitor);
+}
+
+// With --incremental, hashes the names, sizes and modified times of
+// everything the scan found in dir, and the rollups of its subdirectories. A
+// directory with the same rollup as last time has nothing in it that
+// changed, all the way down (see KeepSiteDir).
+static void RollUpSiteDir(SiteDir *dir, Arena *arena) {
+    for (int i = 0; i < dir->entries_count; i++) {
+        if (dir->entries[i].dir) { RollUpSiteDir(dir->entries[i].dir, arena); }
+    }
+
+    ArenaPos    pos    = ArenaSave(arena);
+    ArenaString rollup = ArenaBeginString(arena);
+    ArenaPushData(arena, (char*)&dir->kind, sizeof(dir->kind));
+    for (int i = 0; i < dir->entries_count; i++) {
+        SiteEntry *entry = dir->entries + i;
+        ArenaPushCStr(arena, entry->name);
+        ArenaPushChar(arena, 0);
+        if (entry->dir) {
+            ArenaPushData(arena, (char*)&entry->dir->rollup, sizeof(entry->dir->rollup));
+        } else {
+            ArenaPushData(arena, (char*)&entry->size,     sizeof(entry->size));
+            ArenaPushData(arena, (char*)&entry->modified, sizeof(entry->modified));
+        }
+    }
+
+    dir->rollup = SliceHash(ArenaEndString(arena, rollup));
+    ArenaRestore(arena, pos);
+}
+
+// Whether file "name" in a directory of this kind is made into a page. The
+// others say something about the directory instead.
+static int IsSitePage(SiteDirKind kind, Slice name) {
+    if (SliceEqCStr(name, "nav.sc")) { return 0; }
+    if (kind != SiteDirKind_Blog)    { return 1; }
+
+    return !SliceEqCStr(name, "archive.sc") &&
+           !SliceEqCStr(name, "blog.sc")    &&
+           !SliceEqCStr(name, "index.sc");
+}
+
+// Starts the record for the page made out of `found`, in the new manifest,
+// and gives back the one from the last build
+static SiteManifestRecord *StartPageRecord(SiteNavigation *nav, SiteDir *dir, SiteEntry *found,
+                                           SiteManifestRecord *record) {
+    *record = (SiteManifestRecord) {
+        .key             = SiteManifestKey(dir->rel_path, found->name),
+        .source_size     = found->size,
+        .source_modified = found->modified,
+    };
+
+    return FindSiteManifestRecord(nav->manifest, record->key);
+}
+
+// Whether a page's file has the same size and modified time as last time
+static int IsPageUnchanged(SiteManifestRecord *old, SiteManifestRecord *record) {
+    return old && 
+           old->source_size     == record->source_size && 
+           old->source_modified == record->source_modified;
+}
+
+// Whether the output for file "name" in dir is still what the last build
+// left there (see IsOutputUnchanged). An SC file's output is its .html page,
+// the same as SwitchExtension gives.
+static int IsDirOutputUnchanged(SiteNavigation *nav, SiteDir *dir, const char *name, 
+                                SiteManifestRecord *old) {
+    const char *dot        = strchr(name, '.');
+    int         is_sc      = dot && strcmp(dot, ".sc") == 0;
+    int         name_count = is_sc ? (int)(dot - name) : (int)strlen(name);
+
+    char path[BUF_SIZE];
+    int  length = snprintf(path, sizeof(path), "%s%s%.*s%s", 
+                           dir->rel_path, dir->rel_path[0] ? "/" : "", 
+                           name_count, name, is_sc ? ".html" : "");
+    return length < (int)sizeof(path) && IsOutputUnchanged(nav->out_root, path, old);
+}
+
+// Carries the last build's records for everything in dir over to the new
+// manifest, or with add false, only checks that they are all there, and that
+// their outputs are too. Returns how many pages that is, or -1 if anything
+// is missing.
+static int KeepSiteDirRecords(SiteNavigation *nav, SiteDir *dir, int add) {
+    SiteManifest *m = nav->manifest;
+    if (!dir->opened) { return -1; }
+
+    SiteManifestRecord *record = FindSiteManifestRecord(m, SiteManifestKey(dir->rel_path, 0));
+    if (!record) { return -1; }
+    if (add)     { AddSiteManifestRecord(m, record); }
+
+    int kept = 0;
+    for (int i = 0; i < dir->entries_count; i++) {
+        SiteEntry *entry = dir->entries + i;
+        if (entry->dir) {
+            int sub_kept = KeepSiteDirRecords(nav, entry->dir, add);
+            if (sub_kept < 0) { return -1; }
+            kept += sub_kept;
+            continue;
+        }
+
+        if (!IsSitePage(dir->kind, SliceFromCStr(entry->name))) { continue; }
+
+        record = FindSiteManifestRecord(m, SiteManifestKey(dir->rel_path, entry->name));
+        if (!record) { return -1; }
+        if (add)     { AddSiteManifestRecord(m, record); }
+        if (!add && !IsDirOutputUnchanged(nav, dir, entry->name, record)) { return -1; }
+        kept++;
+    }
+
+    // A blog without entries has no index
+    if (dir->kind == SiteDirKind_Blog) {
+        record = FindSiteManifestRecord(m, SiteManifestKey(dir->rel_path, "archive.html"));
+        if (!record) { return -1; }
+        if (add)     { AddSiteManifestRecord(m, record); }
+        if (!add && !IsDirOutputUnchanged(nav, dir, "archive.html", record)) { return -1; }
+        kept++;
+
+        record = FindSiteManifestRecord(m, SiteManifestKey(dir->rel_path, "index.html"));
+        if (add && record) { AddSiteManifestRecord(m, record); }
+        if (!add && record && !IsDirOutputUnchanged(nav, dir, "index.html", record)) { return -1; }
+    }
+
+    return kept;
+}
+
+// With --incremental, a directory whose rollup is the same as last time, and
+// whose outputs are all still as the last build left them, is kept as it is,
+// without even being opened, and the last build's records for everything in
+// it are carried over. Otherwise, the directory gets its new
+// record, and has to be generated.
+static int KeepSiteDir(SiteNavigation *nav, SiteDir *dir) {
+    SiteManifest *m = nav->manifest;
+    if (!m) { return 0; }
+
+    SiteManifestRecord  record = {.key = SiteManifestKey(dir->rel_path, 0), .deps_hash = dir->rollup};
+    SiteManifestRecord *old    = FindSiteManifestRecord(m, record.key);
+    if (old && old->deps_hash == record.deps_hash && KeepSiteDirRecords(nav, dir, 0) >= 0) {
+        AtomicAdd(&nav->counts->skipped, KeepSiteDirRecords(nav, dir, 1));
+        return 1; 
+    }
+
+    AddSiteManifestRecord(m, &record);
+    return 0;
+}
+
+static int GenerateBlogDirectory(SiteDir *dir,
+                 DirHandle *in_dir,
+                 DirHandle *out_dir,
                  SiteNavigation *nav,
                  Arena *arena,
                  Slice *error);
-static int GenerateNormalDirectory(const char *in_dir_absolute, 
-                      const char *out_dir_absolute,
+static int GenerateNormalDirectory(SiteDir *dir,
+                      DirHandle *in_dir, 
+                      DirHandle *out_dir,
                       SiteNavigation *nav,
                       Arena *arena,
                       Slice *error);
 
-// Generate html files for all of the sc files in a directory
-// Reads sc files from in_dir_absolute, and outputs them
-// to out_dir_absolute.
-static int GenerateDirectory(Slice dir_name,
-                      const char *in_dir_absolute, 
-                      const char *out_dir_absolute,
+// Generate html files for all of the sc files in subdirectory dir
+// Reads sc files from it in in_dir, and outputs them to the
+// directory of the same name in out_dir, which is made if needed.
+static int GenerateDirectory(SiteDir *dir,
+                      DirHandle *in_dir, 
+                      DirHandle *out_dir,
                       SiteNavigation *nav,
                       Arena *arena,
                       Slice *error) {
-    if (SliceStartsWithCStr(dir_name, "blog_")) {
-        return GenerateBlogDirectory(in_dir_absolute, out_dir_absolute, nav, arena, error);
+    if (KeepSiteDir(nav, dir)) { return 1; }
+
+    const char *name        = dir->name;
+    DirHandle   sub_in_dir  = {0};
+    DirHandle   sub_out_dir = {0};
+    if (!dir->opened || !OpenDirHandle(in_dir, name, arena, &sub_in_dir)) {
+        *error = ArenaPrintf(arena, "Could not open directory: %s\nPath was: %s\n",
+                             name, in_dir->path);
+        return 0; 
+    }
+
+    MakeDirectoryAt(out_dir, name);
+    if (!OpenDirHandle(out_dir, name, arena, &sub_out_dir)) {
+        *error = ArenaPrintf(arena, "Could not open output directory: %s\nPath was: %s\n",
+                             name, out_dir->path);
+        CloseDirHandle(&sub_in_dir);
+        return 0; 
+    }
+
+    int generated = 0;
+    if (dir->kind == SiteDirKind_Blog) {
+        generated = GenerateBlogDirectory(dir, &sub_in_dir, &sub_out_dir, nav, arena, error);
     } else {
-        return GenerateNormalDirectory(in_dir_absolute, out_dir_absolute, nav, arena, error);
+        generated = GenerateNormalDirectory(dir, &sub_in_dir, &sub_out_dir, nav, arena, error);
     }
+
+    CloseDirHandle(&sub_in_dir);
+    CloseDirHandle(&sub_out_dir);
+    return generated;
 }
 
-static int GenerateBlogDirectory(const char *in_dir_absolute,
-                 const char *out_dir_absolute,
+static int GenerateBlogDirectory(SiteDir *dir,
+                 DirHandle *in_dir,
+                 DirHandle *out_dir,
                  SiteNavigation *nav,
                  Arena *arena,
                  Slice *error) {
-    ArenaPos original_arena_pos = ArenaSave(arena);
-    DirIter *dir_iter           = ArenaPushDirIter(arena);
-    Blog    *blog               = ArenaPush(arena, Blog);
+    const char *outer_label = ArenaStatsLabel(arena, in_dir->path);
+    int         outer_phase = ArenaStatsPhase(arena, SitePhase_BlogLoad);
+
+    // With --jobs, the blog is written after the walk, so it is kept
+    // somewhere that lasts until then
+    Arena      *keep               = nav->jobs ? &nav->jobs->arena : arena;
+    ArenaPos    original_arena_pos = ArenaSave(arena);
+    ArenaAlign(keep, sizeof(void*));
+    Blog       *blog               = ArenaPush(keep, Blog);
     memset(blog, 0, sizeof(*blog));
+    DirHandle  *job_in_dir         = JobDirHandle(nav, in_dir);
+    blog->out_dir                  = JobDirHandle(nav, out_dir);
+    blog->in_dir                   = job_in_dir;
+    blog->rel_path                 = dir->rel_path;
 
     // Get the blog title from the blog.sc file
-    ChangeDirectory(in_dir_absolute);
     Slice blog_file = {0};
-    if (!ReadEntireFile("blog.sc", arena, &blog_file)) {
+    if (!ReadEntireFileAt(in_dir, "blog.sc", keep, &blog_file)) {
         *error = ArenaPrintf(arena, "Could not read file: blog.sc, "
                              "Does it exist?, every blog folder needs one\n"
-                             "Path was: %s\n", in_dir_absolute);
+                             "Path was: %s\n", in_dir->path);
         return 0;
     }
 
-    SCReader reader = MakeSCReader(blog_file, in_dir_absolute, "blog.sc");
-    SCObject obj = {0};
-    do {
-        SCRead(&reader, &obj);
+    SCReader   reader = MakeSCReader(blog_file, in_dir->path, "blog.sc");
+    SCDocument doc;
+    SCObject   obj = {0};
+    SCReadDocument(&reader, arena, &doc);
+
+    for (int i = 0; i < doc.count; i++) {
+        SCGetDocumentObject(&doc, i, &obj);
         switch (obj.type) {
         case SCObjectType_Func:
         {
-            if (SliceEqCStr(obj.function_name, "title")) {
+            if (obj.command == SCCommand_Title) {
                 R_CheckSCObjectHasBlock(obj, "title", arena, error);
                 blog->title = obj.block;
             } else {
                 *error = ArenaPrintf(arena, "blog.sc file has unknown command\nPath was: %s\n",
-                                     in_dir_absolute);
+                                     in_dir->path);
                 return 0;
             }
         } break;
         R_HandleSCObjectTypeError(obj, arena, error);
         default: break;
         }
-    } while (obj.type != SCObjectType_Error &&
-             obj.type != SCObjectType_End);
+    }
+
+    MakePageTemplate(nav, blog->title, keep, &blog->page_template);
 
     // Load all of the blog pages and generate sub directories
-    MakeDirectory(out_dir_absolute);
-    BeginDirIter(dir_iter, ".");
-    while (GetNextFile(dir_iter)) {
-        const char *file_name_cstr = GetFileName(dir_iter);
-        Slice       file_name      = SliceFromCStr(file_name_cstr);
-
-        if (IsDirectory(dir_iter)) { 
-            if (SliceEqCStr(file_name, "."))      { continue; }
-            if (SliceEqCStr(file_name, ".."))     { continue; }
-            if (SliceEqCStr(file_name, "static")) { continue; }
+    for (int i = 0; i < dir->entries_count; i++) {
+        SiteEntry *found     = dir->entries + i;
+        Slice      file_name = SliceFromCStr(found->name);
+
+        if (found->dir) { 
             ArenaPos before_dir = ArenaSave(arena);
-            const char *sub_in_dir  = MakePath(arena, in_dir_absolute,  file_name_cstr, 0);
-            const char *sub_out_dir = MakePath(arena, out_dir_absolute, file_name_cstr, 0);
-            if (!GenerateDirectory(file_name, sub_in_dir, sub_out_dir,
+            if (!GenerateDirectory(found->dir, in_dir, out_dir,
                                    nav, arena, error)) { goto dir_failure; }
-
-            // IMPORTANT(eric): Need to move back to input dir after
-            // generating sub-dir
-            ChangeDirectory(in_dir_absolute);
             ArenaRestore(arena, before_dir);
             continue;
         }
 
-        if (!SliceEndsWithCStr(file_name, ".sc")) { continue; }
-        if (SliceEqCStr(file_name, "nav.sc"))     { continue; }
-        if (SliceEqCStr(file_name, "archive.sc")) { continue; }
-        if (SliceEqCStr(file_name, "blog.sc")) { continue; }
-        if (SliceEqCStr(file_name, "index.sc")) { continue; }
+        if (!IsSitePage(dir->kind, file_name)) { continue; }
 
         if (blog->entries_count >= SITE_BLOG_MAX_ENTRIES) {
             *error = ArenaPrintf(arena, "Blog has too many entries!");
             goto dir_failure;
         }
 
-        Slice file_data = {0};
-        if (!ReadEntireFile(file_name_cstr, arena, &file_data)) {
-            *error = ArenaPrintf(arena, "Could not read file: %s\n", file_name_cstr);
-            goto dir_failure;
+        BlogEntry *entry = blog->entries + blog->entries_count++;
+        entry->in_file_name  = found->name;
+        entry->out_file_name = SwitchExtension(file_name, keep);
+
+        // An entry whose file is the same as last time isn't read unless one
+        // of its pages has to be made again (see LoadBlogEntry)
+        if (nav->manifest) {
+            entry->old = StartPageRecord(nav, dir, found, &entry->record);
+            if (IsPageUnchanged(entry->old, &entry->record)) {
+                entry->record.source_hash = entry->old->source_hash;
+                entry->title              = entry->old->title;
+                entry->date               = entry->old->date;
+                continue;
+            }
         }
 
-        SCInfo sc_info = {0};
-        if (!GetSCInfo(file_data, in_dir_absolute, file_name_cstr, 
-                       arena, &sc_info, error)) { goto dir_failure; }
-
-        BlogEntry *entry = blog->entries + blog->entries_count;
-        const char *out_file_name_cstr = SwitchExtension(file_name, arena);
-
-        *entry = (BlogEntry) {
-            .title         = sc_info.title,
-            .date          = sc_info.date,
-            .in_file_name  = ArenaCloneCStr(arena, file_name_cstr),
-            .out_file_name = out_file_name_cstr,
-            .file_text     = file_data,
+        // The size is only for picking which job goes first
+        SiteJob job = {
+            .size   = found->size,
+            .in_dir = job_in_dir,
+            .file   = entry->in_file_name,
+            .entry  = entry,
         };
 
-        blog->entries_count++;
+        if (!AddSiteJob(nav, &job, arena, error)) { goto dir_failure; }
     }
 
-    EndDirIter(dir_iter);
-
-    // Sort the blog pages
-    qsort(blog->entries, 
-          blog->entries_count, sizeof(*blog->entries),
-          BlogEntryCmp);
-
-    // Generate the blog pages, with ordered navigation links
-    ChangeDirectory(out_dir_absolute);
-    for (int i = 0; i < blog->entries_count; i++) {
-        ArenaPos iter_pos = ArenaSave(arena);
-        BlogEntry *entry  = blog->entries + i;
-        BlogEntry *prev   = i > 0                      ? entry - 1 : 0;
-        BlogEntry *next   = i < blog->entries_count - 1 ? entry + 1 : 0;
-
-        Slice page_data = {0};
-        if (!GenerateBlogPage(nav, 
-                              nav->site_title, blog->title,
-                              in_dir_absolute, entry->in_file_name, 
-                              prev, entry, next, arena, &page_data)) {
-            *error = page_data;
-            return 0;
-        }
-
-        if (!WriteEntireFile(page_data, entry->out_file_name)) {
-            *error = ArenaPrintf(arena, "Could not write file: %s\n", entry->out_file_name);
-            return 0;
-        }
-
-        if (i == blog->entries_count-1) {
-            if (!WriteEntireFile(page_data, "index.html")) {
-                *error = ArenaPrintf(arena, "Could not write file: %s\n", "index.html");
-                return 0;
-            }
-        }
-
-        ArenaRestore(arena, iter_pos);
-    }
-
-    { // Generate archive page
-        ArenaString str = ArenaBeginString(arena);
-        ArenaPushSlice(arena, blog->title);
-        ArenaPushCStr(arena, " - Archive");
-        Slice blog_archive_title = ArenaEndString(arena, str);
-
-        str = ArenaBeginString(arena);
-        GenerateHeader(nav, 
-                       nav->site_title, blog->title, SliceFromCStr("Archive"), 
-                       arena);
-        ArenaPushCStr(arena, "<article>\n");
-        ArenaPushCStr(arena, "  <h1>\n");
-        ArenaPushSlice(arena, blog_archive_title);
-        ArenaPushCStr(arena, "  </h1>\n");
-        ArenaPushCStr(arena, "    <ul>\n");
-
-        for (int i = 0; i < blog->entries_count; i++) {
-            ArenaPushCStr(arena, "<li><a href=\"");
-            ArenaPushCStr(arena, blog->entries[i].out_file_name);
-            ArenaPushCStr(arena, "\">");
-            ArenaPushSlice(arena, blog->entries[i].date);
-            ArenaPushCStr(arena, " - ");
-            ArenaPushSlice(arena, blog->entries[i].title);
-            ArenaPushCStr(arena, "</a></li>\n");
-        }
-
-        ArenaPushCStr(arena, "    </ul>");
-        ArenaPushCStr(arena, "</article>\n");
-
-        if (blog->entries_count) {
-            GenerateFooter(nav, blog->entries[blog->entries_count-1].date, arena);
-        } else {
-            GenerateFooter(nav, SliceFromCStr(""), arena);
-        }
-
-        if (!WriteEntireFile(ArenaEndString(arena, str), "archive.html")) {
-            *error = ArenaPrintf(arena, "Could not write file: %s\n", "archive.html");
-            return 0;
-        }
+    if (nav->jobs) {
+        blog->order = nav->jobs->order++;
+        *nav->jobs->last_blog = blog;
+        nav->jobs->last_blog  = &blog->next;
+    } else {
+        int written = WriteBlog(blog, nav, arena, error);
+        UnmapBlogEntries(blog);
+        if (!written) { return 0; }
     }
 
+    ArenaStatsPhase(arena, outer_phase);
+    ArenaStatsLabel(arena, outer_label);
     ArenaRestore(arena, original_arena_pos);
     return 1;
 dir_failure:
-    EndDirIter(dir_iter);
+    UnmapBlogEntries(blog);
     return 0;
 }
 
-static int GenerateNormalDirectory(const char *in_dir_absolute, 
-                      const char *out_dir_absolute,
+static int GenerateNormalDirectory(SiteDir *dir,
+                      DirHandle *in_dir, 
+                      DirHandle *out_dir,
                       SiteNavigation *nav,
                       Arena *arena,
                       Slice *error) {
-    ArenaPos original_arena_pos = ArenaSave(arena);
-    DirIter *dir_iter           = ArenaPushDirIter(arena);
-
-    // Generate each file and each subdirectory
-    MakeDirectory(out_dir_absolute);
-    ChangeDirectory(in_dir_absolute);
-    BeginDirIter(dir_iter, ".");
-    while (GetNextFile(dir_iter)) {
-        ArenaPos    iter_pos = ArenaSave(arena);
-        const char *file_name_cstr = GetFileName(dir_iter);
-        Slice       file_name      = SliceFromCStr(file_name_cstr);
-
-        if (IsDirectory(dir_iter)) { 
-            // Skip static directory + dir nav entries
-            if (SliceEqCStr(file_name, "."))      { continue; }
-            if (SliceEqCStr(file_name, ".."))     { continue; }
-            if (SliceEqCStr(file_name, "static")) { continue; }
-
-            // Generate sub-dir
-            const char *sub_in_dir  = MakePath(arena, in_dir_absolute,  file_name_cstr, 0);
-            const char *sub_out_dir = MakePath(arena, out_dir_absolute, file_name_cstr, 0);
-            if (!GenerateDirectory(file_name, sub_in_dir, sub_out_dir,
-                                   nav, arena, error)) { goto failure; }
-        } else {
-            // Skip nav.sc and non-sc files
-            if (!SliceEndsWithCStr(file_name, ".sc")) { continue; }
-            if (SliceEqCStr(file_name, "nav.sc"))    { continue; }
-
-            Slice file_data = {0};
-            Slice page_data = {0};
-
-            // Read sc file
-            ChangeDirectory(in_dir_absolute);
-            if (!ReadEntireFile(file_name_cstr, arena, &file_data)) {
-                *error = ArenaPrintf(arena, "Could not read file: %s\n", file_name_cstr);
-                goto failure;
+    const char *outer_label = ArenaStatsLabel(arena, in_dir->path);
+    int         outer_phase = ArenaStatsPhase(arena, SitePhase_PageRender);
+
+    ArenaPos   original_arena_pos = ArenaSave(arena);
+    PageBatch *batch              = 0;
+    if (nav->files) {
+        ArenaAlign(arena, sizeof(void*));
+        batch = ArenaPush(arena, PageBatch);
+        batch->count = 0;
+        batch->size  = 0;
+    }
+
+    // With --jobs, the pages are made after the walk, so anything they need
+    // is kept somewhere that lasts until then
+    Arena     *keep        = nav->jobs ? &nav->jobs->arena : arena;
+    DirHandle *job_in_dir  = JobDirHandle(nav, in_dir);
+    DirHandle *job_out_dir = JobDirHandle(nav, out_dir);
+
+    // Generate each file and each subdirectory, in order by name
+    for (int i = 0; i < dir->entries_count; i++) {
+        ArenaPos   iter_pos  = ArenaSave(arena);
+        SiteEntry *found     = dir->entries + i;
+        Slice      file_name = SliceFromCStr(found->name);
+
+        if (found->dir) { 
+            // Generate sub-dir, after the pages that come before it
+            if (batch && !RunPageBatch(nav, batch, in_dir, out_dir, arena, error)) { 
+                return 0;
             }
 
-            // Generate page
-            if (!GenerateNormalPage(nav, 
-                                    file_data, in_dir_absolute, file_name_cstr,
-                                    arena, &page_data)) {
-                *error = page_data;
-                goto failure;
+            if (!GenerateDirectory(found->dir, in_dir, out_dir,
+                                   nav, arena, error)) { return 0; }
+        } else {
+            if (!IsSitePage(dir->kind, file_name)) { continue; }
+
+            SiteManifestRecord *record = 0;
+            SiteManifestRecord *old    = 0;
+            if (nav->manifest) {
+                SiteManifestRecord started;
+                old = StartPageRecord(nav, dir, found, &started);
+                if (IsPageUnchanged(old, &started) && 
+                    IsOutputUnchanged(out_dir, SwitchExtension(file_name, arena), old)) {
+                    started.source_hash = old->source_hash;
+                    KeepOutputInfo(&started, old);
+                    AddSiteManifestRecord(nav->manifest, &started);
+                    AtomicAdd(&nav->counts->skipped, 1);
+                    ArenaRestore(arena, iter_pos);
+                    continue;
+                }
+
+                record = AddSiteManifestRecord(nav->manifest, &started);
             }
 
-            const char *out_file_name_cstr = SwitchExtension(file_name, arena);
+            // The size decides whether the page is streamed
+            if (FitsInPageBatch(nav, found->size)) {
+                FileBatchItem *item = batch->items + batch->count;
+                memset(item, 0, sizeof(*item));
+                item->name = found->name;
+                item->size = found->size;
+                batch->records[batch->count] = record;
+                batch->olds[batch->count]    = old;
+                batch->size += found->size;
+                batch->count++;
+
+                if (batch->count == FILE_BATCH_MAX_ITEMS || batch->size >= SITE_BATCH_SIZE) {
+                    if (!RunPageBatch(nav, batch, in_dir, out_dir, arena, error)) { 
+                        return 0; 
+                    }
+                }
+
+                continue;
+            }
 
-            // Write it out
-            ChangeDirectory(out_dir_absolute);
-            if (!WriteEntireFile(page_data, out_file_name_cstr)) {
-                *error = ArenaPrintf(arena, "Could not write file: %s\n", out_file_name_cstr);
-                goto failure;
+            if (batch && !RunPageBatch(nav, batch, in_dir, out_dir, arena, error)) { 
+                return 0; 
             }
+
+            SiteJob job = {
+                .size     = found->size,
+                .in_dir   = job_in_dir,
+                .file     = found->name,
+                .out_dir  = job_out_dir,
+                .out_file = SwitchExtension(file_name, keep),
+                .record   = record,
+                .old      = old,
+            };
+
+            if (!AddSiteJob(nav, &job, arena, error)) { return 0; }
         }
 
         ArenaRestore(arena, iter_pos);
     }
 
+    if (batch && !RunPageBatch(nav, batch, in_dir, out_dir, arena, error)) { 
+        return 0; 
+    }
+
     // NOTE(eric): If an error happens, the error handling intentionally
     // returns early without resetting the arena, 
     // since the error message is stored in the arena.
@@ -538,151 +2023,282 @@ static int GenerateNormalDirectory(const char *in_dir_absolute,
     //
     // Otherwise, if there is no error, site generation leaves
     // no relevant memory behind, so the used arena data is released
+    ArenaStatsPhase(arena, outer_phase);
+    ArenaStatsLabel(arena, outer_label);
     ArenaRestore(arena, original_arena_pos);
-    EndDirIter(dir_iter);
     return 1;
-failure:
-    EndDirIter(dir_iter);
-    return 0;
 }
 
 int GenerateSite(const char *in_dir_relative,
                  const char *out_dir_relative,
+                 SiteOptions *options,
+                 SiteCounts *counts,
                  Arena *arena, 
                  Slice *error) {
-
-    // First, we take the input paths
-    // (in_dir_relative, out_directory_relative)
-    // which /might/ be relative paths, and convert them
-    // into guaranteed absolute paths. This way, you can
-    // chdir to them w/out have to chdir back to the original
-    // directory first.
-    ArenaPos original_arena_pos = ArenaSave(arena);
-    char *original_directory    = ArenaPushMany(arena, char, BUF_SIZE);
-    char *in_dir_absolute       = ArenaPushMany(arena, char, BUF_SIZE);
-    char *out_dir_absolute      = ArenaPushMany(arena, char, BUF_SIZE);
-    CurrentDirectory(original_directory, BUF_SIZE);
-
-    if (!ChangeDirectory(in_dir_relative)) {
-        *error = ArenaPrintf(arena, "Could not change to input directory:\n%s\n",
+    *counts = (SiteCounts) {0};
+
+    // First, we open the input and output directories, which /might/ be
+    // given as relative paths. Everything else is found through these
+    // handles, so the current directory is never changed, and the handles
+    // know their absolute paths for error messages.
+    ArenaPos  original_arena_pos = ArenaSave(arena);
+    DirHandle in_dir             = {0};
+    DirHandle out_dir            = {0};
+
+    if (!OpenDirHandle(0, in_dir_relative, arena, &in_dir)) {
+        *error = ArenaPrintf(arena, "Could not open input directory:\n%s\n",
                              in_dir_relative);
         return 0;
-    } else {
-        CurrentDirectory(in_dir_absolute, BUF_SIZE);
-    }
-
-    if (!ChangeDirectory(original_directory)) {
-        *error = ArenaPrintf(arena, "Could not change to original directory:\n%s\n",
-                             original_directory);
-        return 0;
     }
 
     MakeDirectory(out_dir_relative);
-    if (!ChangeDirectory(out_dir_relative)) {
-        *error = ArenaPrintf(arena, "Could not change to output directory:\n%s\n",
+    if (!OpenDirHandle(0, out_dir_relative, arena, &out_dir)) {
+        *error = ArenaPrintf(arena, "Could not open output directory:\n%s\n",
                              out_dir_relative);
+        CloseDirHandle(&in_dir);
         return 0;
-    } else {
-        CurrentDirectory(out_dir_absolute, BUF_SIZE);
     }
 
-    ChangeDirectory(in_dir_absolute);
+    // The cache directory is relative to where we started, too. The cache
+    // only needs its path.
+    const char *cache_dir_absolute = 0;
+    if (options->cache_dir) {
+        DirHandle cache_dir = {0};
+        MakeDirectory(options->cache_dir);
+        if (!OpenDirHandle(0, options->cache_dir, arena, &cache_dir)) {
+            *error = ArenaPrintf(arena, "Could not open cache directory:\n%s\n",
+                                 options->cache_dir);
+            CloseDirHandle(&in_dir);
+            CloseDirHandle(&out_dir);
+            return 0; 
+        }
+
+        CloseDirHandle(&cache_dir);
+        cache_dir_absolute = cache_dir.path;
+    }
+
+    const char *outer_label = ArenaStatsLabel(arena, in_dir.path);
+    int         outer_phase = ArenaStatsPhase(arena, SitePhase_NavParse);
 
     // Next, we read the nav.sc file. This will give us the name of the site,
     // and the list of navigation links shown at the top of each page.
     Slice nav_data = {0};
-    if (!ReadEntireFile("nav.sc", arena, &nav_data)) {
+    if (!ReadEntireFileAt(&in_dir, "nav.sc", arena, &nav_data)) {
         *error = ArenaPrintf(arena, "Could not read the nav file (nav.sc)" 
                                     " from the root of the input directory");
         return 0;
     }
 
     SiteNavigation nav    = {0};
-    SCReader       reader = MakeSCReader(nav_data, in_dir_absolute, "nav.sc");
+    SCReader       reader = MakeSCReader(nav_data, in_dir.path, "nav.sc");
+    SCDocument     doc;
     SCObject       obj    = {0};
     int            found_title = 0;
+    SCReadDocument(&reader, arena, &doc);
 
-    do {
-        SCRead(&reader, &obj);
+    for (int i = 0; i < doc.count; i++) {
+        SCGetDocumentObject(&doc, i, &obj);
         switch (obj.type) {
         R_HandleSCObjectTypeError(obj, arena, error);
 
         case SCObjectType_Func: 
         {
-            if (SliceEqCStr(obj.function_name, "root_is_blog")) {
+            switch (obj.command) {
+            case SCCommand_RootIsBlog:
+            {
                 nav.root_is_blog = 1;
-            } else if (SliceEqCStr(obj.function_name, "title")) {
+            } break;
+
+            case SCCommand_Title:
+            {
                 R_CheckSCObjectHasBlock(obj, "title", arena, error);
                 nav.site_title = obj.block;
-            } else if (SliceEqCStr(obj.function_name, "copyright")) {
+            } break;
+
+            case SCCommand_Copyright:
+            {
                 R_CheckSCObjectHasBlock(obj, "copyright", arena, error);
                 nav.site_copyright = obj.block;
-            } else if (SliceEqCStr(obj.function_name, "footer")) {
+            } break;
+
+            case SCCommand_Footer:
+            {
                 R_CheckSCObjectHasBlock(obj, "footer", arena, error);
                 nav.site_footer = obj.block;
-            } else if (SliceEqCStr(obj.function_name, "nav")) {
+            } break;
+
+            case SCCommand_Nav:
+            {
                 if (nav.nav_count >= SITE_NAVIGATION_MAX_ENTRIES) {
                     *error = SCMakeErrorString(&obj, arena, "Maximum nav count reached");
                     return 0;
                 }
 
-                int found_label = 0, found_link = 0;
-                for (int i = 0; i < obj.args_count; i++) {
-                    if (SliceEqCStr(obj.keys[i], "label")) {
-                        found_label = 1;
-                        nav.labels[nav.nav_count] = obj.values[i];
-                    } else if (SliceEqCStr(obj.keys[i], "link")) {
-                        found_link = 1;
-                        nav.links[nav.nav_count] = obj.values[i];
-                    }
-                }
+                nav.labels[nav.nav_count] = SCFindArg(&obj, "label");
+                nav.links [nav.nav_count] = SCFindArg(&obj, "link");
 
-                if (!found_label || !found_link) {
+                if (IsNullSlice(nav.labels[nav.nav_count]) || 
+                    IsNullSlice(nav.links [nav.nav_count])) {
                     *error = SCMakeErrorString(&obj, arena, 
                                                "nav command is missing label or link param");
                     return 0;
                 }
 
                 nav.nav_count++;
+            } break;
+
+            default: break;
             }
         } break;
         default: break;
         }
-    } while (obj.type != SCObjectType_End &&
-             obj.type != SCObjectType_Error);
+    }
+
+    // NOTE: The cache gets its own arena, since it records while pages
+    // are being written into the main one
+    Arena   cache_arena = {0};
+    SCCache cache       = {0};
+    if (cache_dir_absolute) {
+        cache_arena = AllocArena(ARENA_SIZE);
+        cache       = (SCCache) {cache_dir_absolute, &cache_arena};
+        nav.cache   = &cache;
+    }
+
+    // NOTE: The scratch arena counts towards the main arena's stats, so
+    // --stats still shows everything that is in use
+    Arena scratch_arena = AllocArena(ARENA_SIZE);
+    scratch_arena.stats = arena->stats;
+    nav.scratch         = &scratch_arena;
+    nav.stream_above    = options->stream_above;
+    nav.page_threads    = options->page_threads;
+    nav.counts          = counts;
+
+    // NOTE: The manifest has its own arena too, since records are added
+    // all through the walk
+    SiteManifest manifest = {0};
+    if (options->incremental) {
+        LoadSiteManifest(&manifest, &out_dir, SliceHash(nav_data));
+        nav.manifest = &manifest;
+        nav.out_root = &out_dir;
+    }
+
+    // With --jobs or --pipeline, the walk below only queues pages up
+    SiteJobs jobs = {0};
+    if (options->jobs > 1 || options->pipeline_depth > 0) {
+        jobs.arena     = AllocArena(ARENA_SIZE);
+        jobs.threads   = options->jobs;
+        jobs.depth     = options->pipeline_depth;
+        if (jobs.depth <= 0) { 
+            jobs.depth = options->jobs * SITE_PIPELINE_DEPTH_PER_JOB + 2; 
+        }
+        jobs.last      = &jobs.first;
+        jobs.last_blog = &jobs.first_blog;
+        nav.jobs       = &jobs;
+    }
+
+    if (options->batch_io && !nav.jobs) { nav.files = AllocFileBatch(); }
+
+    MakePageTemplate(&nav, NullSlice(), arena, &nav.site_template);
+
+    // Find everything there is to make, with as many threads as make pages
+    Arena scan_arenas[MAX_THREADS];
+    int   scan_threads = options->jobs > 1 ? options->jobs : 1;
+    if (scan_threads > MAX_THREADS) { scan_threads = MAX_THREADS; }
+    for (int i = 0; i < scan_threads; i++) { scan_arenas[i] = AllocArena(ARENA_SIZE); }
+
+    ArenaAlign(arena, sizeof(void*));
+    SiteDir *root = ArenaPush(arena, SiteDir);
+    memset(root, 0, sizeof(*root));
+    root->name     = in_dir.path;
+    root->rel_path = "";
+    root->kind     = nav.root_is_blog ? SiteDirKind_Blog : SiteDirKind_Normal;
+    ScanSite(root, scan_threads, scan_arenas);
+    if (nav.manifest) { RollUpSiteDir(root, arena); }
 
     // Generate the root directory
+    ArenaStatsPhase(arena, outer_phase);
     int success = 0;
-    if (nav.root_is_blog) {
-        success = GenerateBlogDirectory(in_dir_absolute,
-                               out_dir_absolute,
+    if (!root->opened) {
+        *error = ArenaPrintf(arena, "Could not open input directory:\n%s\n", in_dir.path);
+    } else if (KeepSiteDir(&nav, root)) {
+        success = 1;
+    } else if (root->kind == SiteDirKind_Blog) {
+        success = GenerateBlogDirectory(root,
+                               &in_dir,
+                               &out_dir,
                                &nav,
                                arena, 
                                error);
     } else {
-        success = GenerateNormalDirectory(in_dir_absolute,
-                                       out_dir_absolute,
+        success = GenerateNormalDirectory(root,
+                                       &in_dir,
+                                       &out_dir,
                                        &nav,
                                        arena,
                                        error);
     }
 
+    if (nav.jobs) {
+        success = RunSiteJobs(&nav, &jobs, success, arena, error);
+    }
+
     // Copy the stylesheet and static directory
-    ChangeDirectory(original_directory);
     if (success) { 
-        CopyDirectory(in_dir_absolute, "static",
-                      out_dir_absolute, "static",
-                      arena);
-        CopyFileToDir(in_dir_absolute, "style.css",
-                 out_dir_absolute,
-                 arena);
+        ArenaStatsPhase(arena, SitePhase_StaticCopy);
+        if (!CopyDirectory(in_dir.path, "static",
+                           out_dir.path, "static",
+                           scan_threads, arena)) {
+            *error  = ArenaPrintf(arena, "Could not copy the static directory\n"
+                                         "Path was: %s\n", in_dir.path);
+            success = 0;
+        } else if (!CopyFileToDir(in_dir.path, "style.css",
+                                  out_dir.path,
+                                  arena)) {
+            *error  = ArenaPrintf(arena, "Could not copy file: style.css\n"
+                                         "Path was: %s\n", in_dir.path);
+            success = 0;
+        }
+    }
+
+    // A build that failed part way might have left pages newer than the last
+    // manifest says, so there is no manifest after it
+    if (nav.manifest) {
+        if (!success) {
+            RemoveFileAt(&out_dir, SITE_MANIFEST_NAME);
+        } else if (!SaveSiteManifest(&manifest, &out_dir)) {
+            *error  = ArenaPrintf(arena, "Could not write file: %s\n", SITE_MANIFEST_NAME);
+            success = 0;
+        }
+
+        FreeSiteManifest(&manifest);
+    }
+
+    if (success) { 
+        ArenaStatsPhase(arena, outer_phase);
+        ArenaStatsLabel(arena, outer_label);
         ArenaRestore(arena, original_arena_pos); 
     }
+
+    if (nav.cache) { FreeArena(&cache_arena); }
+    if (nav.jobs)  { FreeArena(&jobs.arena); }
+    if (nav.files) { FreeFileBatch(nav.files); }
+    for (int i = 0; i < scan_threads; i++) { FreeArena(&scan_arenas[i]); }
+    FreeArena(&scratch_arena);
+    CloseDirHandle(&in_dir);
+    CloseDirHandle(&out_dir);
     return success;
 }
 
 #ifndef NDEBUG
 #include <stdio.h>
+static SCDocument *TEST_ReadDocument(const char *text, Arena *arena) {
+    SCReader    reader = MakeSCReader(SliceFromCStr(text), "test_path", "test_file");
+    ArenaAlign(arena, sizeof(void*));
+    SCDocument *doc    = ArenaPush(arena, SCDocument);
+    SCReadDocument(&reader, arena, doc);
+    return doc;
+}
+
 void TEST_GetSCInfo(void) {
     SCInfo info;
     Slice  error_text;
@@ -698,7 +2314,7 @@ void TEST_GetSCInfo(void) {
     Arena test_arena = AllocArena(ARENA_SIZE);
 
     printf("  This first test should succeed\n");
-    assert(GetSCInfo(SliceFromCStr(test), "test_path", "test_file", &test_arena, &info, &error_text));
+    assert(GetSCInfo(TEST_ReadDocument(test, &test_arena), &test_arena, &info, &error_text));
     printf("    Good\n");
     printf("    Title: "); SlicePrint(info.title); printf("\n");
     printf("    Date: ");  SlicePrint(info.date);  printf("\n");
@@ -706,14 +2322,14 @@ void TEST_GetSCInfo(void) {
     test = "\\info(foo=\"bar\")";
 
     printf("  This next test should fail\n");
-    assert(!GetSCInfo(SliceFromCStr(test), "test_path", "test_file", &test_arena, &info, &error_text));
+    assert(!GetSCInfo(TEST_ReadDocument(test, &test_arena), &test_arena, &info, &error_text));
     printf("    Good\n");
     SlicePrint(error_text);
     printf("\n");
 
     test = "\\blah qwer";
     printf("  This next test should fail\n");
-    assert(!GetSCInfo(SliceFromCStr(test), "test_path", "test_file", &test_arena, &info, &error_text));
+    assert(!GetSCInfo(TEST_ReadDocument(test, &test_arena), &test_arena, &info, &error_text));
     printf("    Good\n");
     SlicePrint(error_text);
     printf("\n");
@@ -725,6 +2341,7 @@ void TEST_GetSCInfo(void) {
 void TEST_GenerateNormalPage(void) {
     Arena test_arena = AllocArena(ARENA_SIZE);
     Slice result;
+    Page  page = {0};
 
     SiteNavigation nav = {0};
     nav.site_title = SliceFromCStr("Awesome test site");
@@ -733,6 +2350,7 @@ void TEST_GenerateNormalPage(void) {
     nav.labels[0] = SliceFromCStr("zombo");
     nav.links [1] = SliceFromCStr("http://wombo.com");
     nav.labels[1] = SliceFromCStr("wombo");
+    MakePageTemplate(&nav, NullSlice(), &test_arena, &nav.site_template);
 
     SCInfo info;
     info.title = SliceFromCStr("Page title");
@@ -743,7 +2361,7 @@ void TEST_GenerateNormalPage(void) {
     int success = GenerateNormalPage(&nav, 
                                      SliceFromCStr("qwer \\boop qwer"), 
                                      "test_path", "test_file",
-                                     &test_arena, &result);
+                                     &test_arena, &page, &result);
     assert(!success);
     printf("    It did fail, error is:\n");
     SlicePrint(result);
@@ -755,7 +2373,7 @@ void TEST_GenerateNormalPage(void) {
                                                    " \\boop qwer"),
                                      "test_path",
                                      "test_file",
-                                     &test_arena, &result);
+                                     &test_arena, &page, &result);
     assert(!success);
     printf("    It did fail, error is:\n");
     SlicePrint(result);
@@ -767,7 +2385,7 @@ void TEST_GenerateNormalPage(void) {
                                                    " qwer "),
                                      "test_path",
                                      "test_file",
-                                     &test_arena, &result);
+                                     &test_arena, &page, &result);
     assert(!success);
     printf("    It did fail, error is:\n");
     SlicePrint(result);
@@ -778,10 +2396,24 @@ void TEST_GenerateNormalPage(void) {
                                                    " qwer "
                                                    " \\bold{woo} qwer"),
                                      "test_path", "test_file",
-                                     &test_arena, &result);
+                                     &test_arena, &page, &result);
     assert(success);
+    // Normal pages fill every part except the blog navigation.
+    assert(SliceEqCStr(page.parts[PagePart_Title], " - zzz"));
+    assert(SliceEqCStr(page.parts[PagePart_Date], "22"));
+    assert(!IsNullSlice(page.parts[PagePart_HeaderBegin]));
+    assert(!IsNullSlice(page.parts[PagePart_HeaderEnd]));
+    assert(!IsNullSlice(page.parts[PagePart_FooterBegin]));
+    assert(!IsNullSlice(page.parts[PagePart_FooterEnd]));
+    assert(SliceLength(page.parts[PagePart_BlogNav]) == 0);
     printf("    It did pass, text is:\n");
-    SlicePrint(result);
+    for (int i = 0; i < PagePart_COUNT; i++) {
+        if (i == PagePart_BlogNav) { continue; }
+        if (i == PagePart_FooterBegin) {
+            for (int j = 0; j < page.body.count; j++) { SlicePrint(page.body.spans[j]); }
+        }
+        SlicePrint(page.parts[i]);
+    }
 
     FreeArena(&test_arena);
 }
@@ -7,12 +7,103 @@
 #include "arena.h"
 #include "sc_file.h"
 #include "sc_to_html.h"
+#include "sc_cache.h"
 
 #define SITE_NAVIGATION_MAX_ENTRIES 32
 #define SITE_BLOG_MAX_ENTRIES 4096
 
+// Pages bigger than SITE_STREAM_ABOVE bytes are converted a chunk at a time
+// instead of being read in whole (see MakeSCStreamReader). They are read
+// through a SITE_STREAM_WINDOW_SIZE window, and written out in chunks of
+// about SITE_STREAM_CHUNK_SIZE.
+#define SITE_STREAM_ABOVE       ((uint64_t)64 * 1024 * 1024)
+#define SITE_STREAM_WINDOW_SIZE (1024 * 1024)
+#define SITE_STREAM_CHUNK_SIZE  (256 * 1024)
+
+// Pages bigger than SITE_MAP_ABOVE bytes, that aren't streamed, are mapped
+// into memory instead of being read into the arena (see
+// ReadOrMapEntireFileAt). Below it, setting up the mapping costs more than
+// copying the file. It is the same as SITE_BATCH_FILE_SIZE, so batched
+// pages are never mapped.
+#define SITE_MAP_ABOVE          (256 * 1024)
+
+// Pages at least this big are read and converted on several threads at once
+// (see SCReadDocumentParallel)
+#define SITE_PARALLEL_ABOVE     (4 * 1024 * 1024)
+
+// With --io-uring, pages up to SITE_BATCH_FILE_SIZE bytes are read and
+// written up to FILE_BATCH_MAX_ITEMS at a time (see FileBatch), with at most
+// SITE_BATCH_SIZE bytes of them read in at once.
+#define SITE_BATCH_FILE_SIZE (256 * 1024)
+#define SITE_BATCH_SIZE      (4 * 1024 * 1024)
+
+// Pages in flight at once with --jobs, for each thread making them, plus one
+// being read and one being written (see SitePipeline). --pipeline overrides
+// it, up to SITE_PIPELINE_MAX_DEPTH.
+#define SITE_PIPELINE_DEPTH_PER_JOB 2
+#define SITE_PIPELINE_MAX_DEPTH     256
+
+// The stages of site generation. Arena usage is attributed to these when
+// stats are turned on (see ArenaStatsPhase)
+typedef enum SitePhase {
+    SitePhase_Setup,
+    SitePhase_NavParse,
+    SitePhase_BlogLoad,
+    SitePhase_PageRender,
+    SitePhase_Archive,
+    SitePhase_StaticCopy,
+    SitePhase_COUNT
+} SitePhase;
+
+// Printed with the stats, in site_gen.c
+extern const char *g_site_phase_name[SitePhase_COUNT];
+
+// Things that change how the site is generated, but not what it looks like
+typedef struct SiteOptions {
+    // Directory for the SC object cache (see sc_cache.h), created if it does
+    // not exist. If null, there is no caching.
+    const char *cache_dir;
+
+    // Pages bigger than this many bytes are streamed (SITE_STREAM_ABOVE by
+    // default). Blog entries are always read in whole.
+    uint64_t stream_above;
+
+    // Threads used to read and convert one big page. 1 turns it off.
+    int page_threads;
+
+    // Pages made at once, each on its own thread. 1 makes them one at a
+    // time, as they are found.
+    int jobs;
+
+    // Read and write small pages a batch at a time, through io_uring on
+    // Linux (see FileBatch). Only without jobs or pipeline_depth.
+    int batch_io;
+
+    // Pages in flight at once, between having their file read, being made,
+    // and being written, which each happen on their own threads. 0 leaves it
+    // up to jobs, and turns it off if that is 1.
+    int pipeline_depth;
+
+    // Keep a manifest of what each page was made from in the output
+    // directory, and only make the pages whose sources changed since the
+    // last build (see site_manifest.h).
+    int incremental;
+} SiteOptions;
+
+// Pages are only written if they come out different from what is already in
+// the output directory (see UpdateEntireFilePartsAt). These say how many were
+// written, and how many were left alone. With --incremental, skipped says how
+// many weren't even made, since nothing they were made from changed.
+typedef struct SiteCounts {
+    volatile int written;
+    volatile int unchanged;
+    volatile int skipped;
+} SiteCounts;
+
 int GenerateSite(const char *in_dir_relative,
                  const char *out_dir_relative,
+                 SiteOptions *options,
+                 SiteCounts *counts,
                  Arena *arena, 
                  Slice *error);
 
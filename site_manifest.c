@@ -0,0 +1,232 @@
+#include "site_manifest.h"
+#include <stdio.h>
+#include <string.h>
+
+void LoadSiteManifest(SiteManifest *m, DirHandle *out_dir, uint64_t site_hash) {
+    memset(m, 0, sizeof(*m));
+    m->arena     = AllocArena(ARENA_SIZE);
+    m->site_hash = site_hash;
+    m->last      = &m->first;
+
+    Slice file = {0};
+    if (ReadEntireFileAt(out_dir, SITE_MANIFEST_NAME, &m->arena, &file)) {
+        ReadSiteManifest(m, file);
+    }
+}
+
+void FreeSiteManifest(SiteManifest *m) {
+    FreeArena(&m->arena);
+    memset(m, 0, sizeof(*m));
+}
+
+int SaveSiteManifest(SiteManifest *m, DirHandle *out_dir) {
+    ArenaPos pos     = ArenaSave(&m->arena);
+    Slice    file    = FormatSiteManifest(m);
+    int      changed = 0;
+    int      saved   = UpdateEntireFilePartsAt(out_dir, SITE_MANIFEST_NAME, &file, 1, &changed);
+    ArenaRestore(&m->arena, pos);
+    return saved;
+}
+
+uint64_t SiteManifestKey(const char *dir, const char *name) {
+    char buf[BUF_SIZE];
+    int  length = snprintf(buf, sizeof(buf), "%s/%s", dir, name ? name : "");
+    if (length < 0)                 { length = 0; }
+    if (length >= (int)sizeof(buf)) { length = (int)sizeof(buf) - 1; }
+    return SliceHash(MakeSlice(buf, (memsize)length));
+}
+
+SiteManifestRecord *FindSiteManifestRecord(SiteManifest *m, uint64_t key) {
+    if (!m->table) { return 0; }
+
+    for (uint64_t i = key & m->table_mask; m->table[i]; i = (i + 1) & m->table_mask) {
+        if (m->table[i]->key == key) { return m->table[i]; }
+    }
+
+    return 0;
+}
+
+SiteManifestRecord *AddSiteManifestRecord(SiteManifest *m, SiteManifestRecord *record) {
+    Slice title = ArenaPushSlice(&m->arena, record->title);
+    Slice date  = ArenaPushSlice(&m->arena, record->date);
+
+    ArenaAlign(&m->arena, sizeof(void*));
+    SiteManifestRecord *added = ArenaPush(&m->arena, SiteManifestRecord);
+    *added       = *record;
+    added->next  = 0;
+    added->title = title;
+    added->date  = date;
+
+    *m->last = added;
+    m->last  = &added->next;
+    m->count++;
+    return added;
+}
+
+// Titles and dates are padded so the next record starts 8 byte aligned
+static memsize SiteManifestPadding(memsize length) {
+    return (memsize)(-length) & 7;
+}
+
+int ReadSiteManifest(SiteManifest *m, Slice file) {
+    m->table      = 0;
+    m->table_mask = 0;
+
+    SiteManifestHeader header;
+    if (SliceLength(file) < sizeof(header)) { return 0; }
+
+    memcpy(&header, file.begin, sizeof(header));
+    if (header.magic     != SITE_MANIFEST_MAGIC   ||
+        header.version   != SITE_MANIFEST_VERSION ||
+        header.site_hash != m->site_hash          ||
+        header.records_count > SliceLength(file) / sizeof(SiteManifestFileRecord)) {
+        return 0;
+    }
+
+    uint64_t table_size = 16;
+    while (table_size < header.records_count * 2) { table_size *= 2; }
+
+    ArenaPos             pos     = ArenaSave(&m->arena);
+    ArenaAlign(&m->arena, sizeof(void*));
+    SiteManifestRecord  *records = ArenaPushMany(&m->arena, SiteManifestRecord, header.records_count);
+    SiteManifestRecord **table   = ArenaPushMany(&m->arena, SiteManifestRecord*, table_size);
+    memset(table, 0, sizeof(*table) * table_size);
+
+    char *p = file.begin + sizeof(header);
+    for (uint64_t i = 0; i < header.records_count; i++) {
+        SiteManifestFileRecord r;
+        if ((memsize)(file.end - p) < sizeof(r)) { goto bad_file; }
+        memcpy(&r, p, sizeof(r));
+        p += sizeof(r);
+
+        memsize strings = (memsize)r.title_length + r.date_length;
+        if ((memsize)(file.end - p) < strings + SiteManifestPadding(strings)) { goto bad_file; }
+
+        SiteManifestRecord *record = records + i;
+        *record = (SiteManifestRecord) {
+            .key             = r.key,
+            .source_size     = r.source_size,
+            .source_modified = r.source_modified,
+            .source_hash     = r.source_hash,
+            .deps_hash       = r.deps_hash,
+            .output_size     = r.output_size,
+            .output_modified = r.output_modified,
+            .title           = MakeSlice(p, r.title_length),
+            .date            = MakeSlice(p + r.title_length, r.date_length),
+        };
+        p += strings + SiteManifestPadding(strings);
+
+        uint64_t slot = record->key & (table_size - 1);
+        while (table[slot]) { slot = (slot + 1) & (table_size - 1); }
+        table[slot] = record;
+    }
+
+    if (p != file.end) { goto bad_file; }
+
+    m->table      = table;
+    m->table_mask = table_size - 1;
+    return 1;
+
+bad_file:
+    ArenaRestore(&m->arena, pos);
+    return 0;
+}
+
+Slice FormatSiteManifest(SiteManifest *m) {
+    static const char zeros[8] = {0};
+    SiteManifestHeader header = {
+        .magic         = SITE_MANIFEST_MAGIC,
+        .version       = SITE_MANIFEST_VERSION,
+        .site_hash     = m->site_hash,
+        .records_count = m->count,
+    };
+
+    ArenaAlign(&m->arena, 8);
+    ArenaString file = ArenaBeginString(&m->arena);
+    ArenaPushData(&m->arena, (char*)&header, sizeof(header));
+
+    for (SiteManifestRecord *record = m->first; record; record = record->next) {
+        SiteManifestFileRecord r = {
+            .key             = record->key,
+            .source_size     = record->source_size,
+            .source_modified = record->source_modified,
+            .source_hash     = record->source_hash,
+            .deps_hash       = record->deps_hash,
+            .output_size     = record->output_size,
+            .output_modified = record->output_modified,
+            .title_length    = (uint32_t)SliceLength(record->title),
+            .date_length     = (uint32_t)SliceLength(record->date),
+        };
+
+        memsize strings = (memsize)r.title_length + r.date_length;
+        ArenaPushData(&m->arena, (char*)&r, sizeof(r));
+        ArenaPushSlice(&m->arena, record->title);
+        ArenaPushSlice(&m->arena, record->date);
+        ArenaPushData(&m->arena, (char*)zeros, SiteManifestPadding(strings));
+    }
+
+    return ArenaEndString(&m->arena, file);
+}
+
+#ifndef NDEBUG
+#include <stdio.h>
+#include <assert.h>
+void TEST_SiteManifest(void) {
+    printf("Testing SiteManifest\n");
+
+    SiteManifest saved = {0};
+    saved.arena     = AllocArena(MIN_ARENA_SIZE);
+    saved.site_hash = 1234;
+    saved.last      = &saved.first;
+
+    SiteManifestRecord entry = {
+        .key             = SiteManifestKey("blog_test", "entry.sc"),
+        .source_size     = 10,
+        .source_modified = 20,
+        .source_hash     = 30,
+        .deps_hash       = 40,
+        .output_size     = 50,
+        .output_modified = 60,
+        .title           = SliceFromCStr("An entry"),
+        .date            = SliceFromCStr("2019-01-01"),
+    };
+    SiteManifestRecord dir = {
+        .key       = SiteManifestKey("blog_test", 0),
+        .deps_hash = 70,
+    };
+    AddSiteManifestRecord(&saved, &entry);
+    AddSiteManifestRecord(&saved, &dir);
+    assert(entry.key != dir.key);
+    assert(entry.key != SiteManifestKey("", "blog_test/entry.sc"));
+
+    Slice file = FormatSiteManifest(&saved);
+    assert(SliceLength(file) % 8 == 0);
+
+    SiteManifest loaded = {0};
+    loaded.arena     = AllocArena(MIN_ARENA_SIZE);
+    loaded.site_hash = 1234;
+    assert(ReadSiteManifest(&loaded, file));
+
+    SiteManifestRecord *found = FindSiteManifestRecord(&loaded, entry.key);
+    assert(found);
+    assert(found->source_size     == 10 && found->source_modified == 20);
+    assert(found->source_hash     == 30 && found->deps_hash       == 40);
+    assert(found->output_size     == 50 && found->output_modified == 60);
+    assert(SliceCmp(found->title, entry.title) == 0);
+    assert(SliceCmp(found->date,  entry.date)  == 0);
+
+    found = FindSiteManifestRecord(&loaded, dir.key);
+    assert(found && found->deps_hash == 70 && SliceLength(found->title) == 0);
+    assert(!FindSiteManifestRecord(&loaded, SiteManifestKey("blog_test", "other.sc")));
+
+    // Cut short, or made for another nav.sc
+    assert(!ReadSiteManifest(&loaded, (Slice) {file.begin, file.end - 8}));
+    assert(!FindSiteManifestRecord(&loaded, entry.key));
+    loaded.site_hash = 4321;
+    assert(!ReadSiteManifest(&loaded, file));
+
+    FreeSiteManifest(&saved);
+    FreeSiteManifest(&loaded);
+    printf("Seems good.\n");
+}
+#endif
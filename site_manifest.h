@@ -0,0 +1,116 @@
+#pragma once
+#ifndef SITE_MANIFEST_H
+#define SITE_MANIFEST_H
+#include "common.h"
+#include "slice.h"
+#include "arena.h"
+#include "paths.h"
+
+// Build manifest (--incremental)
+//
+// The manifest remembers what every output of the last build was made from:
+// the size, last write time and hash of its SC file, and a hash of anything
+// else that went into it, like a blog page's neighbors (its deps). It also
+// remembers the size and last write time the output itself had. Later
+// builds look each output up by its key, and only make it again if one of
+// those changed, or the output was changed or removed since. Whole
+// directories are kept the same way, with a hash of everything the scan
+// found in them standing in for the deps.
+//
+// Every page depends on nav.sc, so the manifest keeps one hash of it for the
+// whole site, and a different nav.sc throws the old manifest out. So does a
+// different SITE_MANIFEST_VERSION, which has to go up whenever site.c
+// changes what pages come out as, or what goes in a record.
+//
+// The manifest lives in the output directory, as SITE_MANIFEST_NAME. It is
+// written after a build that went all the way through, and removed after
+// one that didn't, since some outputs might be newer than it says.
+//
+// A manifest file is a header followed by one SiteManifestFileRecord per
+// output, each directly followed by its title and date, and padded to 8
+// bytes.
+//
+// NOTE: Like the object cache, it is written in the machine's own
+// byte order, and isn't meant to be moved between machines.
+
+#define SITE_MANIFEST_NAME    ".site-manifest"
+#define SITE_MANIFEST_MAGIC   0x31464d53 // "SMF1"
+#define SITE_MANIFEST_VERSION 2
+
+typedef struct SiteManifestHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t site_hash;     // Of nav.sc
+    uint64_t records_count;
+} SiteManifestHeader;
+
+typedef struct SiteManifestFileRecord {
+    uint64_t key;
+    uint64_t source_size;
+    int64_t  source_modified;
+    uint64_t source_hash;
+    uint64_t deps_hash;
+    uint64_t output_size;
+    int64_t  output_modified;
+    uint32_t title_length;
+    uint32_t date_length;
+} SiteManifestFileRecord;
+
+// What one output was made from
+typedef struct SiteManifestRecord {
+    struct SiteManifestRecord *next;
+    uint64_t key;             // See SiteManifestKey
+    uint64_t source_size;     // Of its SC file, if it has one
+    int64_t  source_modified;
+    uint64_t source_hash;     // 0 if the file wasn't read in whole
+    uint64_t deps_hash;
+    uint64_t output_size;     // Of the page, as it was left. 0 for a
+    int64_t  output_modified; // directory.
+    Slice    title;           // Blog entries only, so their blog can be put
+    Slice    date;            // together without converting them again
+} SiteManifestRecord;
+
+typedef struct SiteManifest {
+    Arena                arena;
+    uint64_t             site_hash;
+
+    // The last build's records, in a table by key
+    SiteManifestRecord **table;
+    uint64_t             table_mask;
+
+    // This build's records, in the order they were added
+    SiteManifestRecord  *first;
+    SiteManifestRecord **last;
+    uint64_t             count;
+} SiteManifest;
+
+// Sets up the manifest for a build of a site whose nav.sc hashes to
+// site_hash, with the last build's records from out_dir. If there is no
+// manifest there, or it is for something else, there are no records.
+void LoadSiteManifest(SiteManifest *m, DirHandle *out_dir, uint64_t site_hash);
+void FreeSiteManifest(SiteManifest *m);
+
+// Writes this build's records to out_dir, if they changed since last time.
+// Returns false on failure
+int SaveSiteManifest(SiteManifest *m, DirHandle *out_dir);
+
+// The key of the output for "name", in directory dir of the site ("" for
+// the root). A directory has a key too, with a null name.
+uint64_t SiteManifestKey(const char *dir, const char *name);
+
+// The last build's record for key, or null
+SiteManifestRecord *FindSiteManifestRecord(SiteManifest *m, uint64_t key);
+
+// Adds a copy of record to this build's records, title and date included,
+// and returns the copy. It can be filled in more later. Not thread safe.
+SiteManifestRecord *AddSiteManifestRecord(SiteManifest *m, SiteManifestRecord *record);
+
+// Used by LoadSiteManifest and SaveSiteManifest
+int   ReadSiteManifest(SiteManifest *m, Slice file);
+Slice FormatSiteManifest(SiteManifest *m);
+
+#ifndef NDEBUG
+void TEST_SiteManifest(void);
+#endif
+
+#endif
@@ -48,3 +48,25 @@ int SliceEndsWithCStr(Slice a, const char *b) {
     return memcmp(a.begin + (alen - blen), b, blen) == 0;
 }
 
+
+uint64_t SliceHash(Slice data) {
+    const uint64_t k = 0xff51afd7ed558ccdull;
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ SliceLength(data);
+    char    *p = data.begin;
+
+    while (data.end - p >= 8) {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        h  = (h ^ word) * k;
+        h ^= h >> 32;
+        p += 8;
+    }
+
+    uint64_t tail = 0;
+    memcpy(&tail, p, (memsize)(data.end - p));
+    h  = (h ^ tail) * k;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
+    return h;
+}
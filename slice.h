@@ -54,4 +54,8 @@ int SliceEqCStr(Slice a, const char *b);
 int SliceStartsWithCStr(Slice a, const char *b); 
 int SliceEndsWithCStr(Slice a, const char *b); 
 
+// A quick 64 bit hash, good enough to notice a changed file. Not meant to
+// stand up to anyone trying to make collisions.
+uint64_t SliceHash(Slice data);
+
 #endif
@@ -0,0 +1,152 @@
+#include "threads.h"
+#include <stdlib.h>
+
+typedef struct ParallelCall {
+    ParallelFunc *func;
+    void         *data;
+    int           index;
+} ParallelCall;
+
+#ifdef _WIN32
+#include <windows.h>
+
+static DWORD WINAPI ParallelThreadProc(void *param) {
+    ParallelCall *call = (ParallelCall*)param;
+    call->func(call->data, call->index);
+    return 0;
+}
+
+void RunParallel(ParallelFunc *func, void *data, int count) {
+    ParallelCall calls  [MAX_THREADS];
+    HANDLE       threads[MAX_THREADS];
+    if (count > MAX_THREADS) { count = MAX_THREADS; }
+
+    // If a thread can't be started, its share is done on this thread instead
+    for (int i = 1; i < count; i++) {
+        calls[i]   = (ParallelCall) {func, data, i};
+        threads[i] = CreateThread(0, 0, ParallelThreadProc, &calls[i], 0, 0);
+        if (!threads[i]) { func(data, i); }
+    }
+
+    func(data, 0);
+
+    for (int i = 1; i < count; i++) {
+        if (threads[i]) {
+            WaitForSingleObject(threads[i], INFINITE);
+            CloseHandle(threads[i]);
+        }
+    }
+}
+
+int ProcessorCount(void) {
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+}
+
+int AtomicAdd(volatile int *value, int amount) {
+    return (int)InterlockedExchangeAdd((volatile LONG*)value, amount);
+}
+
+void AtomicMin(volatile int *value, int amount) {
+    LONG seen = *value;
+    while (amount < seen) {
+        LONG before = InterlockedCompareExchange((volatile LONG*)value, amount, seen);
+        if (before == seen) { break; }
+        seen = before;
+    }
+}
+
+struct Monitor {
+    CRITICAL_SECTION   lock;
+    CONDITION_VARIABLE changed;
+};
+
+Monitor *AllocMonitor(void) {
+    Monitor *m = (Monitor*)malloc(sizeof(Monitor));
+    InitializeCriticalSection(&m->lock);
+    InitializeConditionVariable(&m->changed);
+    return m;
+}
+
+void FreeMonitor(Monitor *m) {
+    DeleteCriticalSection(&m->lock);
+    free(m);
+}
+
+void MonitorLock(Monitor *m)    { EnterCriticalSection(&m->lock); }
+void MonitorUnlock(Monitor *m)  { LeaveCriticalSection(&m->lock); }
+void MonitorWait(Monitor *m)    { SleepConditionVariableCS(&m->changed, &m->lock, INFINITE); }
+void MonitorWakeAll(Monitor *m) { WakeAllConditionVariable(&m->changed); }
+
+#else // POSIX
+#include <pthread.h>
+#include <unistd.h>
+
+static void *ParallelThreadProc(void *param) {
+    ParallelCall *call = (ParallelCall*)param;
+    call->func(call->data, call->index);
+    return 0;
+}
+
+void RunParallel(ParallelFunc *func, void *data, int count) {
+    ParallelCall calls  [MAX_THREADS];
+    pthread_t    threads[MAX_THREADS];
+    int          started[MAX_THREADS];
+    if (count > MAX_THREADS) { count = MAX_THREADS; }
+
+    // If a thread can't be started, its share is done on this thread instead
+    for (int i = 1; i < count; i++) {
+        calls[i]   = (ParallelCall) {func, data, i};
+        started[i] = pthread_create(&threads[i], 0, ParallelThreadProc, &calls[i]) == 0;
+        if (!started[i]) { func(data, i); }
+    }
+
+    func(data, 0);
+
+    for (int i = 1; i < count; i++) {
+        if (started[i]) { pthread_join(threads[i], 0); }
+    }
+}
+
+int ProcessorCount(void) {
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (int)count : 1;
+}
+
+int AtomicAdd(volatile int *value, int amount) {
+    return __atomic_fetch_add(value, amount, __ATOMIC_SEQ_CST);
+}
+
+void AtomicMin(volatile int *value, int amount) {
+    int seen = __atomic_load_n(value, __ATOMIC_SEQ_CST);
+    while (amount < seen &&
+           !__atomic_compare_exchange_n(value, &seen, amount, 0, 
+                                        __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+    }
+}
+
+struct Monitor {
+    pthread_mutex_t lock;
+    pthread_cond_t  changed;
+};
+
+Monitor *AllocMonitor(void) {
+    Monitor *m = (Monitor*)malloc(sizeof(Monitor));
+    pthread_mutex_init(&m->lock, 0);
+    pthread_cond_init(&m->changed, 0);
+    return m;
+}
+
+void FreeMonitor(Monitor *m) {
+    pthread_cond_destroy(&m->changed);
+    pthread_mutex_destroy(&m->lock);
+    free(m);
+}
+
+void MonitorLock(Monitor *m)    { pthread_mutex_lock(&m->lock); }
+void MonitorUnlock(Monitor *m)  { pthread_mutex_unlock(&m->lock); }
+void MonitorWait(Monitor *m)    { pthread_cond_wait(&m->changed, &m->lock); }
+void MonitorWakeAll(Monitor *m) { pthread_cond_broadcast(&m->changed); }
+
+#endif
@@ -0,0 +1,56 @@
+#pragma once
+#ifndef THREADS_H
+#define THREADS_H
+#include "common.h"
+
+// The most threads RunParallel will run at once
+#define MAX_THREADS 64
+
+// A function run on several threads at once. index goes from 0 to the
+// number of threads - 1, so each call can pick out its own share of the work
+// from data.
+typedef void ParallelFunc(void *data, int index);
+
+// Calls func(data, i) for i from 0 to count - 1, each on its own thread, and
+// waits until they have all returned. The calling thread runs i = 0 itself.
+//
+// NOTE: Arenas are not thread safe, so each call should only push to
+// an arena of its own.
+void RunParallel(ParallelFunc *func, void *data, int count);
+
+// Number of processors the OS says are available, at least 1
+int ProcessorCount(void);
+
+// Adds amount to *value in one step, even with other threads doing the same,
+// and returns what *value was before
+int AtomicAdd(volatile int *value, int amount);
+
+// Lowers *value to amount, unless it is already lower
+void AtomicMin(volatile int *value, int amount);
+
+// A Monitor is a lock, with a condition that threads holding it can wait on
+// until something changes.
+//
+// ex:
+/*
+ * MonitorLock(m);
+ * while (!ready) { MonitorWait(m); }
+ * ... use what is ready ...
+ * MonitorUnlock(m);
+ */
+struct Monitor;
+typedef struct Monitor Monitor;
+
+Monitor *AllocMonitor(void);
+void     FreeMonitor(Monitor *m);
+void     MonitorLock(Monitor *m);
+void     MonitorUnlock(Monitor *m);
+
+// Lets go of the lock until another thread calls MonitorWakeAll, then takes
+// it back. Wake ups can also just happen, so check again after waiting.
+void     MonitorWait(Monitor *m);
+
+// Wakes every thread waiting on the monitor
+void     MonitorWakeAll(Monitor *m);
+
+#endif
@@ -1,4 +1,4 @@
 #!/bin/sh
 
-clang -O2 -DNDEBUG -DUNITY_BUILD site.c -o site
+clang -O2 -DNDEBUG -DUNITY_BUILD site.c -o site -pthread
 